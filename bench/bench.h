@@ -0,0 +1,29 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <time.h>
+
+#include <common/int.h>
+
+// Seconds since some arbitrary point, for timing things
+static inline double bench_time() {
+    struct timespec ts = {0};
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+// Run |expr| repeatedly for at least |min_secs|, and store the average time
+// per run in |out_secs|.
+#define BENCH_RUN(out_secs, min_secs, expr)           \
+do {                                                  \
+    u32 _runs = 0;                                    \
+    const double _start = bench_time();               \
+    double _elapsed = 0;                              \
+    while (_elapsed < (min_secs)) {                   \
+        expr;                                         \
+        _runs++;                                      \
+        _elapsed = bench_time() - _start;             \
+    }                                                 \
+    (out_secs) = _elapsed / _runs;                    \
+} while(0)
+
+#endif // BENCH_H
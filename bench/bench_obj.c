@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/file.h>
+#include <common/logging.h>
+#include <common/model.h>
+
+#include "bench.h"
+
+static const char* model_paths[] = {
+    "../bin/98905F1F.obj",
+    "../bin/C33C601F.obj",
+    "../bin/F071C01F.obj",
+};
+
+// Vertex layout from before vertices were packed
+typedef struct {
+    vec3 position;
+    vec4 color;
+}float_vertex;
+
+// The OBJ loader as it used to be: one pass to count everything, then another
+// to sscanf() each line. It writes NULs into the text while it works.
+static model obj_load_sscanf(u8* txt) {
+    float_vertex* vertices = NULL;
+    u16* indices = NULL;
+    u16 vert_count = 0;
+    u16 idx_count = 0;
+
+    for (u8 i = 1; i < 3; i++) {
+        const bool tally_pass = (i == 1);
+        float_vertex* vpos = vertices;
+        u16* ipos = indices;
+
+        char* line = (char*)txt;
+        while (*line != 0x00) {
+            char* line_end = strchr(line, '\n');
+            if (line_end == NULL) {
+                break;
+            }
+            const char end = *line_end;
+            *line_end = 0x00;
+
+            if (line[0] != '#') {
+                if (line[0] == 'f') {
+                    if (tally_pass) {
+                        idx_count += 3;
+                    }
+                    else {
+                        sscanf(line, "f %hd %hd %hd", &ipos[0], &ipos[1], &ipos[2]);
+                        ipos[0]--;
+                        ipos[1]--;
+                        ipos[2]--;
+                        ipos += 3;
+                    }
+                }
+                if (strstr(line, "v ") != NULL) {
+                    if (tally_pass) {
+                        vert_count++;
+                    }
+                    else {
+                        sscanf(line, "v %f %f %f %f %f %f", &vpos->position[0], &vpos->position[1],&vpos->position[2], &vpos->color[0], &vpos->color[1], &vpos->color[2]);
+                        vpos->color[3] = 1.0f;
+                        vpos++;
+                    }
+                }
+            }
+
+            *line_end = end;
+            line = line_end + 1;
+        }
+
+        if (tally_pass) {
+            vertices = calloc(vert_count, sizeof(float_vertex));
+            indices = calloc(idx_count, sizeof(u16));
+            if (vertices == NULL || indices == NULL) {
+                break;
+            }
+        }
+    }
+
+    return (model) {
+        .vertices = vertices,
+        .indices = indices,
+        .vert_count = vert_count,
+        .idx_count = idx_count,
+    };
+}
+
+static void model_free(model m) {
+    free((void*)m.vertices);
+    free((void*)m.indices);
+}
+
+static void load_old(u8* txt) {
+    model_free(obj_load_sscanf(txt));
+}
+
+static void load_new(const u8* txt) {
+    model_free(obj_load_raw(txt));
+}
+
+static void load_optimized(const u8* txt) {
+    model_free(obj_load(txt));
+}
+
+// Compare the old two-pass sscanf() loader against the new parser on the part
+// models we ship. The parser also packs the vertices, but that's part of
+// reading each one. The index optimization obj_load() does on top is timed
+// separately, since the old loader didn't do anything like it.
+void bench_obj() {
+    for (u32 i = 0; i < ARRAY_SIZE(model_paths); i++) {
+        u64 size = 0;
+        u8* txt = file_load_sized(model_paths[i], &size);
+        if (txt == NULL) {
+            LOG_MSG(error, "Couldn't open \"%s\"\n", model_paths[i]);
+            continue;
+        }
+
+        const model old_model = obj_load_sscanf(txt);
+        const model new_model = obj_load_raw(txt);
+        const bool same = old_model.vert_count == new_model.vert_count && old_model.idx_count == new_model.idx_count;
+        model_free(old_model);
+        model_free(new_model);
+        if (!same) {
+            LOG_MSG(error, "\"%s\" loads differently with the new loader\n", model_paths[i]);
+        }
+
+        const double mib = (double)size / (1024 * 1024);
+        double old_secs = 0;
+        double new_secs = 0;
+        double optimized_secs = 0;
+        BENCH_RUN(old_secs, 0.5, load_old(txt));
+        BENCH_RUN(new_secs, 0.5, load_new(txt));
+        BENCH_RUN(optimized_secs, 0.5, load_optimized(txt));
+        LOG_MSG(info, "%s (%5.1f KiB): sscanf %6.1f MiB/s, parser %6.1f MiB/s (%.2fx), parser + optimize %6.1f MiB/s, vertices %d -> %d bytes\n",
+                model_paths[i], (double)size / 1024, mib / old_secs, mib / new_secs, old_secs / new_secs, mib / optimized_secs,
+                (u32)(new_model.vert_count * sizeof(float_vertex)), (u32)(new_model.vert_count * sizeof(vertex)));
+        free(txt);
+    }
+}
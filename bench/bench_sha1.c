@@ -0,0 +1,59 @@
+#include <stdlib.h>
+
+#include <common/file.h>
+#include <common/logging.h>
+#include <common/sha1.h>
+#include <stfs.h>
+
+#include "bench.h"
+
+static const char* package_path = "../bin/explore_2.bin";
+
+// Hash every block of a batch of packages one at a time, as the STFS code
+// used to.
+static void hash_single(const u8* const* blocks, u32 count, sha1_digest* out) {
+    for (u32 i = 0; i < count; i++) {
+        out[i] = SHA1_buf(blocks[i], STFS_BLOCK_SIZE);
+    }
+}
+
+// Compare SHA1_buf() against SHA1_buf_many() on the blocks of 1 package (like
+// verifying a single vehicle) and 64 packages (like a batch job).
+void bench_sha1() {
+    mapped_file pkg = file_map(package_path);
+    if (pkg.data == NULL) {
+        LOG_MSG(error, "Couldn't open \"%s\"\n", package_path);
+        return;
+    }
+    const u32 blocks_per_pkg = pkg.size / STFS_BLOCK_SIZE;
+    const u32 max_pkgs = 64;
+    const u8** blocks = calloc(blocks_per_pkg * max_pkgs, sizeof(*blocks));
+    sha1_digest* out = calloc(blocks_per_pkg * max_pkgs, sizeof(*out));
+    if (blocks == NULL || out == NULL) {
+        free(blocks);
+        free(out);
+        file_unmap(&pkg);
+        return;
+    }
+    // Each package in the batch is the same file, but that doesn't matter
+    for (u32 i = 0; i < blocks_per_pkg * max_pkgs; i++) {
+        blocks[i] = pkg.data + ((i % blocks_per_pkg) * STFS_BLOCK_SIZE);
+    }
+
+    LOG_MSG(info, "SHA1 backend: %s\n", SHA1_backend_name(SHA1_get_backend()));
+    const u32 pkg_counts[] = {1, max_pkgs};
+    for (u32 i = 0; i < ARRAY_SIZE(pkg_counts); i++) {
+        const u32 count = blocks_per_pkg * pkg_counts[i];
+        const double mib = (double)count * STFS_BLOCK_SIZE / (1024 * 1024);
+        double single = 0;
+        double many = 0;
+        BENCH_RUN(single, 0.5, hash_single(blocks, count, out));
+        BENCH_RUN(many, 0.5, SHA1_buf_many(blocks, count, STFS_BLOCK_SIZE, out));
+        LOG_MSG(info, "%3d package(s), %4d blocks: SHA1_buf %7.1f MiB/s, SHA1_buf_many %7.1f MiB/s (%.2fx)\n",
+                pkg_counts[i], count, mib / single, mib / many, single / many);
+    }
+
+    free(blocks);
+    free(out);
+    file_unmap(&pkg);
+}
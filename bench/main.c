@@ -0,0 +1,23 @@
+#include <stdbool.h>
+
+#include <common/int.h>
+#include <common/logging.h>
+
+void bench_sha1();
+void bench_obj();
+
+typedef void (*benchproc)(void);
+benchproc benches[] = {
+    bench_sha1,
+    bench_obj,
+};
+
+int main() {
+    enable_win_ansi();
+
+    LOG_MSG(info, "Running %d benchmarks\n", ARRAY_SIZE(benches));
+    for (u32 i = 0; i < ARRAY_SIZE(benches); i++) {
+        benches[i]();
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "int.h"
+#include "logging.h"
+#include "brick_map.h"
+
+enum {
+    // Smallest hash table we bother with, small vehicles never grow past it
+    BRICK_TABLE_MIN_BITS = 4,
+    // Fibonacci hashing multiplier (2^32 / golden ratio)
+    BRICK_HASH_MULT = 0x9E3779B9,
+};
+
+brick_map brick_map_create(u32 brick_size) {
+    return (brick_map) {
+        .brick_size = brick_size,
+    };
+}
+
+void brick_map_destroy(brick_map* map) {
+    free(map->data);
+    free(map->keys);
+    free(map->table);
+    *map = brick_map_create(map->brick_size);
+}
+
+// Spread the low 4 bits of a value out so there are 2 zero bits between each
+static u16 brick_spread_bits(u8 val) {
+    u16 out = 0;
+    for (u8 i = 0; i < 4; i++) {
+        out |= ((val >> i) & 1) << (i * 3);
+    }
+    return out;
+}
+
+u16 brick_key(u8 x, u8 y, u8 z) {
+    x /= BRICK_DIM;
+    y /= BRICK_DIM;
+    z /= BRICK_DIM;
+    return (brick_spread_bits(x) << 2) | (brick_spread_bits(y) << 1) | brick_spread_bits(z);
+}
+
+void brick_key_decode(u16 key, u8 out[3]) {
+    memset(out, 0x00, 3);
+    for (u8 i = 0; i < 4; i++) {
+        out[0] |= ((key >> (i * 3 + 2)) & 1) << i;
+        out[1] |= ((key >> (i * 3 + 1)) & 1) << i;
+        out[2] |= ((key >> (i * 3)) & 1) << i;
+    }
+    for (u8 i = 0; i < 3; i++) {
+        out[i] *= BRICK_DIM;
+    }
+}
+
+u16 brick_cell_idx(u8 x, u8 y, u8 z) {
+    return ((x % BRICK_DIM) * BRICK_DIM * BRICK_DIM) + ((y % BRICK_DIM) * BRICK_DIM) + (z % BRICK_DIM);
+}
+
+static u32 brick_hash(const brick_map* map, u16 key) {
+    return ((u32)key * BRICK_HASH_MULT) >> (32 - map->table_bits);
+}
+
+// Find the table slot holding a key, or the empty slot where it would go
+static u32 brick_find_slot(const brick_map* map, u16 key) {
+    const u32 mask = (1u << map->table_bits) - 1;
+    u32 slot = brick_hash(map, key);
+    while (map->table[slot] != 0 && map->keys[map->table[slot] - 1] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Throw out the hash table and put every brick back in. The table is kept at
+// most half full.
+static bool brick_rehash(brick_map* map, u8 table_bits) {
+    u16* table = calloc((size_t)1 << table_bits, sizeof(*table));
+    if (table == NULL) {
+        LOG_MSG(error, "Failed to allocate a brick table with %d slots\n", 1 << table_bits);
+        return false;
+    }
+    free(map->table);
+    map->table = table;
+    map->table_bits = table_bits;
+    for (u32 i = 0; i < map->count; i++) {
+        map->table[brick_find_slot(map, map->keys[i])] = i + 1;
+    }
+    return true;
+}
+
+void* brick_map_get(const brick_map* map, u16 key) {
+    if (map->count == 0) {
+        return NULL;
+    }
+    const u16 idx = map->table[brick_find_slot(map, key)];
+    if (idx == 0) {
+        return NULL;
+    }
+    return brick_map_get_idx(map, idx - 1);
+}
+
+void* brick_map_get_or_add(brick_map* map, u16 key) {
+    void* brick = brick_map_get(map, key);
+    if (brick != NULL) {
+        return brick;
+    }
+
+    // Make room for another brick
+    if (map->count >= map->capacity) {
+        const u32 capacity = MAX(map->capacity * 2, 4);
+        u8* data = realloc(map->data, (size_t)capacity * map->brick_size);
+        if (data == NULL) {
+            LOG_MSG(error, "Failed to grow brick map to %d bricks\n", capacity);
+            return NULL;
+        }
+        map->data = data;
+        u16* keys = realloc(map->keys, capacity * sizeof(*keys));
+        if (keys == NULL) {
+            LOG_MSG(error, "Failed to grow brick map to %d bricks\n", capacity);
+            return NULL;
+        }
+        map->keys = keys;
+        map->capacity = capacity;
+    }
+    if (map->table == NULL || (map->count + 1) * 2 > (1u << map->table_bits)) {
+        const u8 table_bits = MAX(map->table_bits + 1, BRICK_TABLE_MIN_BITS);
+        if (!brick_rehash(map, table_bits)) {
+            return NULL;
+        }
+    }
+
+    const u32 idx = map->count++;
+    map->keys[idx] = key;
+    map->table[brick_find_slot(map, key)] = idx + 1;
+    brick = brick_map_get_idx(map, idx);
+    memset(brick, 0x00, map->brick_size);
+    return brick;
+}
+
+void brick_map_remove(brick_map* map, u16 key) {
+    if (map->count == 0) {
+        return;
+    }
+    const u32 mask = (1u << map->table_bits) - 1;
+    u32 slot = brick_find_slot(map, key);
+    const u32 idx = map->table[slot];
+    if (idx == 0) {
+        return;
+    }
+
+    // Shift later entries in the same run back, so lookups don't stop early
+    // at the hole we're leaving.
+    map->table[slot] = 0;
+    for (u32 next = (slot + 1) & mask; map->table[next] != 0; next = (next + 1) & mask) {
+        const u32 home = brick_hash(map, map->keys[map->table[next] - 1]);
+        // Only move it if its home slot is at or before the hole (wrapping)
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            map->table[slot] = map->table[next];
+            map->table[next] = 0;
+            slot = next;
+        }
+    }
+
+    // Move the last brick into the hole
+    const u32 last = map->count - 1;
+    if (idx - 1 != last) {
+        memcpy(brick_map_get_idx(map, idx - 1), brick_map_get_idx(map, last), map->brick_size);
+        map->keys[idx - 1] = map->keys[last];
+        map->table[brick_find_slot(map, map->keys[last])] = idx;
+    }
+    map->count--;
+}
+
+void brick_map_clear(brick_map* map) {
+    map->count = 0;
+    if (map->table != NULL) {
+        memset(map->table, 0x00, ((size_t)1 << map->table_bits) * sizeof(*map->table));
+    }
+}
+
+void* brick_map_get_idx(const brick_map* map, u32 idx) {
+    return map->data + ((size_t)idx * map->brick_size);
+}
@@ -0,0 +1,68 @@
+#ifndef BRICK_MAP_H
+#define BRICK_MAP_H
+#include <stdbool.h>
+
+#include "int.h"
+
+// Sparse storage for a 3D grid of up to 128x128x128 cells. The grid is split
+// into 8x8x8 bricks, and a brick is only allocated once something is stored in
+// it, so memory scales with the size of whatever is in the grid instead of the
+// size of the grid.
+// What goes in a brick is up to the user, this only finds bricks by position.
+// Bricks are keyed by the Morton code of their position, so bricks that are
+// close together in space get keys that are close together too.
+
+enum {
+    BRICK_DIM = 8,
+    BRICK_CELLS = (BRICK_DIM * BRICK_DIM * BRICK_DIM),
+    BRICK_GRID_DIM = (128 / BRICK_DIM), // Bricks along each axis
+};
+
+typedef struct {
+    u8* data; // Brick contents, packed together in no particular order
+    u16* keys; // Key of each brick in [data]
+    u32 count;
+    u32 capacity; // Number of bricks [data] has room for
+    u32 brick_size; // Size of each brick in bytes
+
+    // Open addressing hash table from key to brick index + 1 (0 means empty)
+    u16* table;
+    u8 table_bits; // The table has (1 << table_bits) slots
+}brick_map;
+
+// Create a map where each brick takes up [brick_size] bytes. Nothing is
+// allocated until the first brick is added.
+brick_map brick_map_create(u32 brick_size);
+
+// Free everything in a map
+void brick_map_destroy(brick_map* map);
+
+// Key of the brick holding a cell. Coordinates must be in [0, 128).
+u16 brick_key(u8 x, u8 y, u8 z);
+
+// Position of a brick's lowest corner, in cells
+void brick_key_decode(u16 key, u8 out[3]);
+
+// Index of a cell inside its brick, with Z changing fastest
+u16 brick_cell_idx(u8 x, u8 y, u8 z);
+
+// Find a brick. Returns NULL if there's no brick with this key.
+void* brick_map_get(const brick_map* map, u16 key);
+
+// Find a brick, adding a zeroed one if it doesn't exist yet. Returns NULL if
+// the allocation failed.
+// Adding a brick can move every other brick, so pointers from earlier calls
+// are invalid afterwards.
+void* brick_map_get_or_add(brick_map* map, u16 key);
+
+// Remove a brick if it exists. Like list_remove(), the last brick is moved
+// into the hole.
+void brick_map_remove(brick_map* map, u16 key);
+
+// Remove every brick, but keep the memory around to reuse
+void brick_map_clear(brick_map* map);
+
+// Get a brick by its index in [0, count), for going through every brick
+void* brick_map_get_idx(const brick_map* map, u32 idx);
+
+#endif // BRICK_MAP_H
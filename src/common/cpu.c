@@ -0,0 +1,90 @@
+#include "int.h"
+#include "platform.h"
+#include "cpu.h"
+
+#if defined(PLATFORM_WINDOWS)
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define CPU_X86 1
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && defined(__linux__)
+    #include <sys/auxv.h>
+    #include <asm/hwcap.h>
+#endif
+
+static cpu_features features = {0};
+
+#ifdef CPU_X86
+static void cpu_detect_x86() {
+    u32 leaf1[4] = {0};
+    u32 leaf7[4] = {0};
+#ifdef _MSC_VER
+    __cpuid((int*)leaf1, 1);
+    __cpuidex((int*)leaf7, 7, 0);
+    // The OS also has to save the upper halves of the vector registers
+    const bool osxsave = leaf1[2] & (1 << 27);
+    const u64 xcr0 = osxsave ? _xgetbv(0) : 0;
+    const bool os_ymm = (xcr0 & 0x6) == 0x6;
+    const bool os_zmm = (xcr0 & 0xE6) == 0xE6;
+    features.avx2 = os_ymm && (leaf7[1] & (1 << 5));
+    features.avx512 = os_zmm && (leaf7[1] & (1 << 16)) && (leaf7[1] & (1 << 30));
+#else
+    if (!__get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3])) {
+        return;
+    }
+    __get_cpuid_count(7, 0, &leaf7[0], &leaf7[1], &leaf7[2], &leaf7[3]);
+    // These check that the OS saves the wider registers too
+    __builtin_cpu_init();
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    const bool ssse3 = leaf1[2] & (1 << 9);
+    const bool sse41 = leaf1[2] & (1 << 19);
+    const bool sha = leaf7[1] & (1 << 29);
+    features.sha_ni = ssse3 && sse41 && sha;
+}
+#endif
+
+static void cpu_detect() {
+#if defined(CPU_X86)
+    cpu_detect_x86();
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #if defined(PLATFORM_WINDOWS)
+    features.armv8_sha1 = IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
+    #elif defined(__linux__)
+    features.armv8_sha1 = (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+    #else
+    // Every Apple Silicon chip has the crypto extensions
+    features.armv8_sha1 = true;
+    #endif
+#endif
+}
+
+#if defined(PLATFORM_WINDOWS)
+static BOOL CALLBACK cpu_detect_once(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+    (void)once;
+    (void)param;
+    (void)ctx;
+    cpu_detect();
+    return TRUE;
+}
+#endif
+
+const cpu_features* cpu_get_features() {
+#if defined(PLATFORM_WINDOWS)
+    static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+    InitOnceExecuteOnce(&once, cpu_detect_once, NULL, NULL);
+#else
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, cpu_detect);
+#endif
+    return &features;
+}
@@ -0,0 +1,18 @@
+#ifndef CPU_H
+#define CPU_H
+#include <stdbool.h>
+
+// Instruction set extensions the SIMD code paths can use. Features that don't
+// exist on the architecture we were built for are always false.
+typedef struct {
+    bool sha_ni;     // x86 SHA extensions, along with the SSSE3 & SSE4.1 they need
+    bool avx2;       // Including OS support for the YMM registers
+    bool avx512;     // AVX-512 F & BW, including OS support for the ZMM registers
+    bool armv8_sha1; // ARMv8 SHA1 instructions
+}cpu_features;
+
+// Features of the CPU we're running on. They're detected the first time this
+// is called, and it's safe to call from any number of threads at once.
+const cpu_features* cpu_get_features();
+
+#endif // CPU_H
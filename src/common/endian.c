@@ -0,0 +1,177 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "endian.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define ENDIAN_HAVE_SSSE3 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define ENDIAN_TARGET_SSSE3
+    #else
+        #define ENDIAN_TARGET_SSSE3 __attribute__((target("ssse3")))
+    #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    // NEON is always there on 64-bit ARM
+    #define ENDIAN_HAVE_NEON 1
+    #include <arm_neon.h>
+#endif
+
+enum {
+    // The shuffle pattern repeats every lcm(stride, 16) bytes. Structures that
+    // don't line up within this many bytes are just done one at a time.
+    ENDIAN_MAX_PERIOD = 256,
+    ENDIAN_VEC_SIZE = 16,
+};
+
+static void endian_swap_scalar(const endian_schema* schema, u8* data, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        u8* base = data + (u64)i * schema->stride;
+        for (u32 f = 0; f < schema->field_count; f++) {
+            const endian_field* field = &schema->fields[f];
+            const u32 step = field->step ? field->step : field->size;
+            u8* p = base + field->offset;
+            for (u32 e = 0; e < field->count; e++, p += step) {
+                // Fields aren't always aligned (STFS is packed), so these go
+                // through memcpy(). It still compiles to a load + bswap.
+                switch (field->size) {
+                case 2: {
+                    u16 v;
+                    memcpy(&v, p, sizeof(v));
+                    v = bswap16(v);
+                    memcpy(p, &v, sizeof(v));
+                    break;
+                }
+                case 4: {
+                    u32 v;
+                    memcpy(&v, p, sizeof(v));
+                    v = bswap32(v);
+                    memcpy(p, &v, sizeof(v));
+                    break;
+                }
+                case 8: {
+                    u64 v;
+                    memcpy(&v, p, sizeof(v));
+                    v = bswap64(v);
+                    memcpy(p, &v, sizeof(v));
+                    break;
+                }
+                default:
+                    // Odd sizes like 24-bit ints
+                    for (u32 lo = 0, hi = field->size - 1; lo < hi; lo++, hi--) {
+                        const u8 tmp = p[lo];
+                        p[lo] = p[hi];
+                        p[hi] = tmp;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+#if defined(ENDIAN_HAVE_SSSE3) || defined(ENDIAN_HAVE_NEON)
+static u32 endian_gcd(u32 a, u32 b) {
+    while (b != 0) {
+        const u32 tmp = a % b;
+        a = b;
+        b = tmp;
+    }
+    return a;
+}
+
+// Turn the schema into byte shuffle masks covering one period of the pattern.
+// Returns the period length, or 0 if some field straddles two vectors (a
+// shuffle can only move bytes around inside one register).
+static u32 endian_build_masks(const endian_schema* schema, u8 masks[ENDIAN_MAX_PERIOD]) {
+    const u32 stride = schema->stride;
+    const u32 period = stride / endian_gcd(stride, ENDIAN_VEC_SIZE) * ENDIAN_VEC_SIZE;
+    if (stride == 0 || period > ENDIAN_MAX_PERIOD) {
+        return 0;
+    }
+
+    for (u32 i = 0; i < period; i++) {
+        masks[i] = i % ENDIAN_VEC_SIZE;
+    }
+
+    for (u32 base = 0; base < period; base += stride) {
+        for (u32 f = 0; f < schema->field_count; f++) {
+            const endian_field* field = &schema->fields[f];
+            const u32 step = field->step ? field->step : field->size;
+            for (u32 e = 0; e < field->count; e++) {
+                const u32 start = base + field->offset + (e * step);
+                const u32 end = start + field->size - 1;
+                if (start / ENDIAN_VEC_SIZE != end / ENDIAN_VEC_SIZE) {
+                    return 0;
+                }
+                for (u32 b = 0; b < field->size; b++) {
+                    masks[start + b] = (end - b) % ENDIAN_VEC_SIZE;
+                }
+            }
+        }
+    }
+
+    return period;
+}
+#endif
+
+#ifdef ENDIAN_HAVE_SSSE3
+static bool endian_cpu_has_ssse3() {
+#ifdef _MSC_VER
+    int leaf1[4] = {0};
+    __cpuid(leaf1, 1);
+    return leaf1[2] & (1 << 9);
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+ENDIAN_TARGET_SSSE3
+static void endian_shuffle_periods(const u8* masks, u32 period, u8* data, u64 size) {
+    for (u64 pos = 0; pos < size; pos += period) {
+        for (u32 i = 0; i < period; i += ENDIAN_VEC_SIZE) {
+            const __m128i mask = _mm_loadu_si128((const __m128i*)&masks[i]);
+            __m128i* p = (__m128i*)&data[pos + i];
+            _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), mask));
+        }
+    }
+}
+#elif defined(ENDIAN_HAVE_NEON)
+static void endian_shuffle_periods(const u8* masks, u32 period, u8* data, u64 size) {
+    for (u64 pos = 0; pos < size; pos += period) {
+        for (u32 i = 0; i < period; i += ENDIAN_VEC_SIZE) {
+            const uint8x16_t mask = vld1q_u8(&masks[i]);
+            u8* p = &data[pos + i];
+            vst1q_u8(p, vqtbl1q_u8(vld1q_u8(p), mask));
+        }
+    }
+}
+#endif
+
+void endian_swap_array(const endian_schema* schema, void* data, u32 count) {
+    u8* bytes = data;
+#if defined(ENDIAN_HAVE_SSSE3) || defined(ENDIAN_HAVE_NEON)
+    // Building the masks costs about as much as swapping one period, so only
+    // bother when there's a decent amount of data.
+    const u64 size = (u64)count * schema->stride;
+    bool simd_ok = size >= ENDIAN_MAX_PERIOD * 2;
+#ifdef ENDIAN_HAVE_SSSE3
+    simd_ok = simd_ok && endian_cpu_has_ssse3();
+#endif
+    if (simd_ok) {
+        u8 masks[ENDIAN_MAX_PERIOD];
+        const u32 period = endian_build_masks(schema, masks);
+        if (period != 0) {
+            const u64 simd_size = size - (size % period);
+            endian_shuffle_periods(masks, period, bytes, simd_size);
+
+            // Whatever didn't fill a whole period is done the slow way
+            const u32 done = (u32)(simd_size / schema->stride);
+            bytes += simd_size;
+            count -= done;
+        }
+    }
+#endif
+    endian_swap_scalar(schema, bytes, count);
+}
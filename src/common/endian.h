@@ -1,6 +1,7 @@
 #ifndef ENDIAN_H
 #define ENDIAN_H
 #include <stdbool.h>
+#include <stddef.h>
 #include <memory.h>
 #include "int.h"
 
@@ -51,4 +52,104 @@ do {                                  \
     memcpy(&(val), ((u8*)&v) + 1, 3); \
 } while(0)
 
+// These read a value of a known endian-ness straight out of a buffer,
+// regardless of what endian we're running on. This lets us leave data in its
+// original form (like a memory-mapped file) and only byteswap what we
+// actually read. Compilers recognize the shift pattern and turn it into a
+// plain load (+ bswap if needed).
+static inline u16 read_be16(const void* addr) {
+    const u8* b = addr;
+    return (u16)((b[0] << 8) | b[1]);
+}
+
+static inline u16 read_le16(const void* addr) {
+    const u8* b = addr;
+    return (u16)((b[1] << 8) | b[0]);
+}
+
+static inline u32 read_be24(const void* addr) {
+    const u8* b = addr;
+    return ((u32)b[0] << 16) | ((u32)b[1] << 8) | b[2];
+}
+
+static inline u32 read_le24(const void* addr) {
+    const u8* b = addr;
+    return ((u32)b[2] << 16) | ((u32)b[1] << 8) | b[0];
+}
+
+static inline u32 read_be32(const void* addr) {
+    const u8* b = addr;
+    return ((u32)b[0] << 24) | ((u32)b[1] << 16) | ((u32)b[2] << 8) | b[3];
+}
+
+static inline u64 read_be64(const void* addr) {
+    const u8* b = addr;
+    return ((u64)read_be32(b) << 32) | read_be32(b + 4);
+}
+
+// The opposite of the read_*() functions above, for patching values in place.
+static inline void write_be24(void* addr, u32 val) {
+    u8* b = addr;
+    b[0] = (val >> 16) & 0xFF;
+    b[1] = (val >> 8) & 0xFF;
+    b[2] = val & 0xFF;
+}
+
+static inline void write_le24(void* addr, u32 val) {
+    u8* b = addr;
+    b[0] = val & 0xFF;
+    b[1] = (val >> 8) & 0xFF;
+    b[2] = (val >> 16) & 0xFF;
+}
+
+static inline void write_be32(void* addr, u32 val) {
+    u8* b = addr;
+    b[0] = (val >> 24) & 0xFF;
+    b[1] = (val >> 16) & 0xFF;
+    b[2] = (val >> 8) & 0xFF;
+    b[3] = val & 0xFF;
+}
+
+// Byte-swap helpers that compile to a single instruction on every compiler we
+// care about. ENDIAN_FLIP() is fine for one-off values, these are for loops.
+#if defined(_MSC_VER)
+#include <stdlib.h>
+static inline u16 bswap16(u16 x) { return _byteswap_ushort(x); }
+static inline u32 bswap32(u32 x) { return _byteswap_ulong(x); }
+static inline u64 bswap64(u64 x) { return _byteswap_uint64(x); }
+#else
+static inline u16 bswap16(u16 x) { return __builtin_bswap16(x); }
+static inline u32 bswap32(u32 x) { return __builtin_bswap32(x); }
+static inline u64 bswap64(u64 x) { return __builtin_bswap64(x); }
+#endif
+
+// One field (or array of fields) in a structure that needs to be byteswapped.
+// Lists of these describe a whole structure, so we can swap it in one pass
+// instead of writing out an ENDIAN_FLIP() for every member.
+typedef struct {
+    u16 offset; // Offset of the first element from the start of the structure
+    u8 size; // Bytes per element (24-bit fields are fine)
+    u8 count; // Number of elements
+    u16 step; // Bytes from one element to the next, 0 if they're packed together
+}endian_field;
+
+// Describe a member of type T. Arrays are split into |elem_size| elements.
+#define ENDIAN_FIELD(T, member, elem_size) \
+    { offsetof(T, member), (elem_size), sizeof(((T*)0)->member) / (elem_size), 0 }
+
+typedef struct {
+    u32 stride; // sizeof() the structure
+    u32 field_count;
+    const endian_field* fields;
+}endian_schema;
+
+#define ENDIAN_SCHEMA(T, fields) { sizeof(T), ARRAY_SIZE(fields), fields }
+
+// Unconditionally byteswap every field in the schema, for |count| structures
+// laid out back to back. Large arrays of small structures (like vehicle parts)
+// are done with SIMD byte shuffles built from the schema.
+// Check is_little_endian() yourself, this doesn't know which endian the data
+// is in.
+void endian_swap_array(const endian_schema* schema, void* data, u32 count);
+
 #endif // ENDIAN_H
@@ -12,6 +12,16 @@
     #define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
 #endif
 
+#include "platform.h"
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#include <direct.h>
+#elif defined(PLATFORM_POSIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#endif
+
 #include "logging.h"
 #include "file.h"
 
@@ -44,23 +54,133 @@ u32 file_size(const char* path) {
     return st.st_size;
 }
 
+bool dir_create(const char* path) {
+    if (path_is_dir(path)) {
+        return true;
+    }
+#ifdef PLATFORM_WINDOWS
+    return _mkdir(path) == 0;
+#else
+    return mkdir(path, 0755) == 0;
+#endif
+}
+
+bool dir_walk(const char* dir, dir_walk_fn fn, void* ctx) {
+    char path[4096] = {0};
+#ifdef PLATFORM_WINDOWS
+    snprintf(path, sizeof(path), "%s\\*", dir);
+    WIN32_FIND_DATAA entry = {0};
+    HANDLE find = FindFirstFileA(path, &entry);
+    if (find == INVALID_HANDLE_VALUE) {
+        LOG_MSG(error, "Couldn't open directory %s\n", dir);
+        return false;
+    }
+    do {
+        const char* name = entry.cFileName;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s\\%s", dir, name);
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            dir_walk(path, fn, ctx);
+        }
+        else {
+            fn(path, ctx);
+        }
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#elif defined(PLATFORM_POSIX)
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        LOG_MSG(error, "Couldn't open directory %s\n", dir);
+        return false;
+    }
+    struct dirent* entry = NULL;
+    while ((entry = readdir(d)) != NULL) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        // d_type isn't filled in on every filesystem, stat() always works
+        if (path_is_dir(path)) {
+            dir_walk(path, fn, ctx);
+        }
+        else if (path_is_file(path)) {
+            fn(path, ctx);
+        }
+    }
+    closedir(d);
+#else
+    LOG_MSG(error, "Directory listing isn't supported on this platform\n");
+    return false;
+#endif
+    return true;
+}
+
 u8* file_load(const char* path) {
-    if (!file_exists(path)) {
+    return file_load_sized(path, NULL);
+}
+
+u8* file_load_sized(const char* path, u64* size) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
         LOG_MSG(error, "File \"%s\" doesn't exist.\n", path);
         return NULL;
     }
-    const u32 size = file_size(path);
+    // Get the size from the open file instead of stat()-ing the path again
+    fseek(f, 0, SEEK_END);
+    const long filesize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (filesize < 0) {
+        fclose(f);
+        return NULL;
+    }
+
     // 1 extra byte for a bit of wiggle room
     // (prevents some out of bounds reads while looping over file contents)
-    u8* buffer = calloc(1, size + 1);
+    u8* buffer = calloc(1, filesize + 1);
     if (buffer == NULL) {
+        fclose(f);
+        return NULL;
+    }
+    const size_t read = fread(buffer, 1, filesize, f);
+    fclose(f);
+    if (read != (size_t)filesize) {
+        LOG_MSG(error, "Only read 0x%X of 0x%X bytes from %s\n", (u32)read, (u32)filesize, path);
+        free(buffer);
         return NULL;
     }
 
-    file_load_existing(path, buffer, size);
+    if (size != NULL) {
+        *size = filesize;
+    }
     return buffer;
 }
 
+u32 file_load_head(const char* path, u8* buf, u32 size, u64* file_size) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        LOG_MSG(error, "File \"%s\" doesn't exist.\n", path);
+        return 0;
+    }
+    if (file_size != NULL) {
+        // Get the size from the open file, as 64 bits so huge files can't
+        // wrap around to look small
+#ifdef PLATFORM_WINDOWS
+        struct _stat64 st = {0};
+        const bool ok = (_fstat64(_fileno(f), &st) == 0);
+#else
+        struct stat st = {0};
+        const bool ok = (fstat(fileno(f), &st) == 0);
+#endif
+        *file_size = ok ? (u64)st.st_size : 0;
+    }
+    const size_t read = fread(buf, 1, size, f);
+    fclose(f);
+    return (u32)read;
+}
+
 bool file_load_existing(const char* path, u8* buf, u32 size) {
     if (buf == NULL) {
         LOG_MSG(error, "Caller gave a NULL buffer. Check your allocations!\n");
@@ -87,3 +207,83 @@ bool file_load_existing(const char* path, u8* buf, u32 size) {
     return true;
 }
 
+
+mapped_file file_map(const char* path) {
+    mapped_file out = {0};
+#ifdef PLATFORM_WINDOWS
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) {
+        LOG_MSG(error, "Failed to open %s\n", path);
+        return out;
+    }
+    LARGE_INTEGER size = {0};
+    if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+        CloseHandle(f);
+        return out;
+    }
+    HANDLE mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(f);
+    if (mapping == NULL) {
+        LOG_MSG(error, "Failed to map %s\n", path);
+        return out;
+    }
+    // The view keeps the mapping alive, so we don't need to hold onto either
+    // of the handles.
+    out.data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (out.data != NULL) {
+        out.size = size.QuadPart;
+    }
+#elif defined(PLATFORM_POSIX)
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        LOG_MSG(error, "Failed to open %s\n", path);
+        return out;
+    }
+    struct stat st = {0};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return out;
+    }
+    // The mapping stays valid after we close the file descriptor
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG_MSG(error, "Failed to map %s\n", path);
+        return out;
+    }
+    out.data = data;
+    out.size = st.st_size;
+#else
+    // No mapping API we know of, just read the whole thing.
+    out.data = file_load_sized(path, &out.size);
+    out.is_copy = true;
+#endif
+    return out;
+}
+
+mapped_file file_wrap(const u8* data, u64 size) {
+    return (mapped_file) {
+        .data = data,
+        .size = size,
+        .is_borrowed = true,
+    };
+}
+
+void file_unmap(mapped_file* m) {
+    if (m->data == NULL || m->is_borrowed) {
+        *m = (mapped_file){0};
+        return;
+    }
+    if (m->is_copy) {
+        free((void*)m->data);
+    }
+    else {
+#ifdef PLATFORM_WINDOWS
+        UnmapViewOfFile(m->data);
+#elif defined(PLATFORM_POSIX)
+        munmap((void*)m->data, m->size);
+#endif
+    }
+    *m = (mapped_file){0};
+}
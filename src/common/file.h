@@ -10,17 +10,66 @@ bool path_is_dir(const char* path);
 
 u32 file_size(const char* path);
 
+// Create a directory (not its parents). Also succeeds if it already exists.
+bool dir_create(const char* path);
+
+// Called by dir_walk() with the full path of each file
+typedef void (*dir_walk_fn)(const char* path, void* ctx);
+
+// Call fn() for every regular file in a directory and all its subdirectories.
+// Order is whatever the OS gives us. Returns false if the directory couldn't
+// be opened.
+bool dir_walk(const char* dir, dir_walk_fn fn, void* ctx);
+
 /// Read an entire file into a buffer. Caller must free the resource.
 /// \param path Filepath
 /// \return Pointer to buffer, or NULL on failure.
 u8* file_load(const char* path);
 
+/// Read an entire file into a buffer with a single open & read. Caller must
+/// free the resource.
+/// \param path Filepath
+/// \param size Receives the size of the file (not including the extra zero
+/// byte added to the end). Can be NULL.
+/// \return Pointer to buffer, or NULL on failure.
+u8* file_load_sized(const char* path, u64* size);
+
+/// Read just the start of a file, to check what it is before loading it all.
+/// \param path Filepath
+/// \param buf Buffer to read into
+/// \param size Number of bytes to read, less are read if the file is smaller
+/// \param file_size Receives the size of the whole file. Can be NULL.
+/// \return Number of bytes read, 0 on failure.
+u32 file_load_head(const char* path, u8* buf, u32 size, u64* file_size);
+
 /// Read an entire file into an existing buffer.
 /// \param path Filepath
 /// \param buf Buffer to read file into
 /// \param size Size of buffer
 bool file_load_existing(const char* path, u8* buf, u32 size);
 
+// A read-only view of an entire file. Where the OS supports it, this is a
+// memory mapping, so pages are only read from disk when they're touched.
+typedef struct {
+    const u8* data; // NULL on failure
+    u64 size;
+    bool is_copy; // We fell back to reading the file into a heap buffer
+    bool is_borrowed; // Memory owned by someone else, see file_wrap()
+}mapped_file;
+
+/// Map an entire file into memory, read-only. Call file_unmap() when done.
+/// \param path Filepath
+/// \return Mapping of the file. The data pointer is NULL on failure.
+mapped_file file_map(const char* path);
+
+/// Treat a buffer that's already in memory like a mapped file, so code written
+/// for file_map() can use it too. file_unmap() won't free it, so it has to
+/// stay alive until then.
+mapped_file file_wrap(const u8* data, u64 size);
+
+/// Release a mapping made with file_map() or file_wrap().
+void file_unmap(mapped_file* m);
+
 static inline u32 magic(char a, char b, char c, char d) {
     return a | (b << 8) | (c << 16) | (d << 24);
 }
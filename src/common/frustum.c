@@ -0,0 +1,111 @@
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    // SSE2 is always there on x86-64
+    #define FRUSTUM_HAVE_SSE 1
+    #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    // NEON is always there on 64-bit ARM
+    #define FRUSTUM_HAVE_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#include "frustum.h"
+
+frustum frustum_from_matrix(const float m[16]) {
+    // Each plane is the last row of the matrix plus or minus one of the others
+    // (Gribb & Hartmann). Rows are strided because the matrix is column-major.
+    frustum f = {0};
+    for (u8 i = 0; i < 6; i++) {
+        const u8 row = i / 2;
+        const float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        for (u8 col = 0; col < 4; col++) {
+            f.planes[i][col] = m[(col * 4) + 3] + (sign * m[(col * 4) + row]);
+        }
+
+        // Normalize so plane distances are in the same units as the radius
+        const float len = sqrtf((f.planes[i][0] * f.planes[i][0]) + (f.planes[i][1] * f.planes[i][1]) + (f.planes[i][2] * f.planes[i][2]));
+        if (len > 0.0f) {
+            for (u8 col = 0; col < 4; col++) {
+                f.planes[i][col] /= len;
+            }
+        }
+    }
+    return f;
+}
+
+bool frustum_test_sphere(const frustum* f, float x, float y, float z, float radius) {
+    for (u8 i = 0; i < 6; i++) {
+        const float* p = f->planes[i];
+        if ((p[0] * x) + (p[1] * y) + (p[2] * z) + p[3] < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef FRUSTUM_HAVE_SSE
+// Returns how many spheres were handled, the rest are left for the scalar code
+static u32 frustum_cull_sse(const frustum* f, const float* x, const float* y, const float* z, const float* radius, u32 count, u8* visible) {
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 vx = _mm_loadu_ps(&x[i]);
+        const __m128 vy = _mm_loadu_ps(&y[i]);
+        const __m128 vz = _mm_loadu_ps(&z[i]);
+        const __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (u8 p = 0; p < 6; p++) {
+            const float* plane = f->planes[p];
+            // Same order as frustum_test_sphere(), so both round the same way
+            __m128 dist = _mm_mul_ps(vx, _mm_set1_ps(plane[0]));
+            dist = _mm_add_ps(dist, _mm_mul_ps(vy, _mm_set1_ps(plane[1])));
+            dist = _mm_add_ps(dist, _mm_mul_ps(vz, _mm_set1_ps(plane[2])));
+            dist = _mm_add_ps(dist, _mm_set1_ps(plane[3]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, neg_r));
+        }
+        const int bits = _mm_movemask_ps(inside);
+        for (u8 lane = 0; lane < 4; lane++) {
+            visible[i + lane] = (bits >> lane) & 1;
+        }
+    }
+    return i;
+}
+#elif defined(FRUSTUM_HAVE_NEON)
+static u32 frustum_cull_neon(const frustum* f, const float* x, const float* y, const float* z, const float* radius, u32 count, u8* visible) {
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t vx = vld1q_f32(&x[i]);
+        const float32x4_t vy = vld1q_f32(&y[i]);
+        const float32x4_t vz = vld1q_f32(&z[i]);
+        const float32x4_t neg_r = vnegq_f32(vld1q_f32(&radius[i]));
+        uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+        for (u8 p = 0; p < 6; p++) {
+            const float* plane = f->planes[p];
+            // Separate multiplies & adds, like the SSE path. vmlaq can turn
+            // into a fused multiply-add, which rounds differently.
+            float32x4_t dist = vmulq_n_f32(vx, plane[0]);
+            dist = vaddq_f32(dist, vmulq_n_f32(vy, plane[1]));
+            dist = vaddq_f32(dist, vmulq_n_f32(vz, plane[2]));
+            dist = vaddq_f32(dist, vdupq_n_f32(plane[3]));
+            inside = vandq_u32(inside, vcgeq_f32(dist, neg_r));
+        }
+        visible[i + 0] = vgetq_lane_u32(inside, 0) & 1;
+        visible[i + 1] = vgetq_lane_u32(inside, 1) & 1;
+        visible[i + 2] = vgetq_lane_u32(inside, 2) & 1;
+        visible[i + 3] = vgetq_lane_u32(inside, 3) & 1;
+    }
+    return i;
+}
+#endif
+
+void frustum_cull_spheres(const frustum* f, const float* x, const float* y, const float* z, const float* radius, u32 count, u8* visible) {
+    u32 i = 0;
+#ifdef FRUSTUM_HAVE_SSE
+    i = frustum_cull_sse(f, x, y, z, radius, count, visible);
+#elif defined(FRUSTUM_HAVE_NEON)
+    i = frustum_cull_neon(f, x, y, z, radius, count, visible);
+#endif
+    for (; i < count; i++) {
+        visible[i] = frustum_test_sphere(f, x[i], y[i], z[i], radius[i]);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+#include <stdbool.h>
+
+#include "int.h"
+
+// View frustum culling for bounding spheres. Spheres are passed as separate
+// arrays for each component, so 4 of them can be tested at once with SIMD.
+
+typedef struct {
+    // Each plane is (a, b, c, d), where ax + by + cz + d is the distance from
+    // the plane. Normals point into the frustum.
+    float planes[6][4];
+}frustum;
+
+// Get the frustum of a column-major projection * view matrix, like the ones
+// cglm makes. Planes are in the space the matrix transforms from.
+frustum frustum_from_matrix(const float m[16]);
+
+// Whether any part of a sphere is inside the frustum. Spheres near the corners
+// can pass without actually being inside, but nothing inside ever fails.
+bool frustum_test_sphere(const frustum* f, float x, float y, float z, float radius);
+
+// Test [count] spheres at once, writing 1 to [visible] for every sphere that
+// passes frustum_test_sphere() and 0 for the rest.
+void frustum_cull_spheres(const frustum* f, const float* x, const float* y, const float* z, const float* radius, u32 count, u8* visible);
+
+#endif // FRUSTUM_H
@@ -2,6 +2,10 @@
 #include <stdio.h>
 #include <stddef.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include "int.h"
 
 // Get a value from a bitmask like it's an array
@@ -16,9 +20,20 @@ u8 mask_get(u8* mask, u8 idx) {
 void mask_set(u8* mask, u8 idx, u8 val) {
     u8* addr = mask + (idx / 8);
     val &= 1; // Keep only 1 bit
-    val <<= (idx % 8); // Adjust value for sub-byte index
+    const u8 bit = idx % 8; // Sub-byte index
+
+    // Clear the old bit before setting it, so a value of 0 actually clears it
+    *addr = (*addr & ~(1 << bit)) | (val << bit);
+}
 
-    *addr |= val;
+u8 bit_scan_forward(u64 val) {
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward64(&idx, val);
+    return idx;
+#else
+    return __builtin_ctzll(val);
+#endif
 }
 
 
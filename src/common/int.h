@@ -33,6 +33,9 @@ u8 mask_get(u8* mask, u8 idx);
 // Set a value in a bitmask like it's an array
 void mask_set(u8* mask, u8 idx, u8 val);
 
+// Index of the lowest set bit. [val] can't be 0.
+u8 bit_scan_forward(u64 val);
+
 s32 s24_to_s32(u8* addr);
 
 // Raise a number to a power (val^pow)
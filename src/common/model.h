@@ -1,12 +1,28 @@
 #ifndef MODEL_H
 #define MODEL_H
+#include <assert.h>
+
 #include "vector.h"
+#include "file.h"
+
+enum {
+    // Vertex positions are fixed point, in steps of 1/VERTEX_POS_SCALE. That
+    // gives a range of +-64, and part models all fit in +-3.
+    // The shaders divide by this, so change them too if it changes.
+    VERTEX_POS_SCALE = 512,
+};
 
-// A vertex with only posiiton and color
+// Convert a position to fixed point. Usable in static initializers, but it
+// truncates, so stick to values that are exact (like the primitives).
+#define VERTEX_POS(x) ((s16)((x) * VERTEX_POS_SCALE))
+
+// A vertex with only position and color, packed down to 12 bytes
 typedef struct {
-    vec3 position;
-    vec4 color;
+    vec3s16 position; // Fixed point, see VERTEX_POS_SCALE
+    s16 pad; // Keeps the color 4-byte aligned
+    rgba8 color;
 }vertex;
+static_assert(sizeof(vertex) == 12, "vertex size is wrong!");
 
 typedef struct {
     const void* vertices;
@@ -22,8 +38,51 @@ typedef struct {
 void model_upload(model* m);
 u32 model_size(const model m);
 
-// Load OBJ data into a model struct.
-// Assumes vertex colors are stored as RGB values on each vertex.
-model obj_load(u8* txt);
+// Set up attributes 0 (position) & 1 (color) of the bound VAO to read
+// vertices from the buffer bound to GL_ARRAY_BUFFER
+void model_vertex_layout();
+
+// Load NUL-terminated OBJ data into a model struct. Only vertex positions,
+// vertex colors (stored as RGB values after the position) and faces are used.
+// Faces with more than 3 corners are split into triangles, and the result goes
+// through model_optimize(). Returns an empty model if the data is broken or
+// too big for 16-bit indices.
+model obj_load(const u8* txt);
+
+// obj_load() without model_optimize(), so vertices & triangles stay in the
+// order they're in the file
+model obj_load_raw(const u8* txt);
+
+// Reorder triangles so each vertex is used again while it's still in the GPU's
+// post-transform cache (Tom Forsyth's "Linear-Speed Vertex Cache
+// Optimisation"), then renumber the vertices in the order they're first used
+// so they're fetched front to back. Only the order changes, every triangle
+// keeps its corners and winding.
+void model_optimize(vertex* vertices, u16* indices, u16 vert_count, u16 idx_count);
+
+// Binary mesh format, so part models can be loaded without parsing any text.
+// It's the header, then the vertex array, then the index array, exactly as
+// they are in memory. Meshes are only ever written and read on little-endian
+// machines, anything else fails the magic check and falls back to the OBJ.
+enum {
+    MESH_MAGIC = MAGIC('G', 'M', 'S', 'H'),
+    MESH_VERSION = 2, // Bump this when the layout of a vertex changes
+};
+
+typedef struct {
+    u32 magic;
+    u16 version;
+    u16 vertex_size; // sizeof(vertex) when the mesh was written
+    u16 vert_count;
+    u16 idx_count;
+}mesh_header;
+
+// Load a mesh that was made by mesh_save(). The vertex & index data are
+// copied out, so the input can be freed right away. Returns an empty model if
+// the data isn't a mesh or is from a different version.
+model mesh_load(const u8* data, u64 size);
+
+// Pack a model into the mesh format. Caller must free the output.
+u8* mesh_save(const model m, u64* size_out);
 
 #endif // MODEL_H
@@ -0,0 +1,539 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/logging.h>
+#include <common/file.h>
+#include <common/list.h>
+#include "model.h"
+
+// Loading models from files. Nothing in here touches OpenGL, so build tools
+// and tests can use it without a context.
+
+// OBJ parsing. The whole file is read in a single pass, growing the vertex &
+// index arrays as it goes, and the input is never written to.
+
+// Spaces & tabs between values. Carriage returns count too, so files with
+// Windows line endings work.
+static const char* obj_skip_space(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+static const char* obj_next_line(const char* p) {
+    while (*p != '\n' && *p != 0x00) {
+        p++;
+    }
+    return (*p == '\n') ? p + 1 : p;
+}
+
+static bool obj_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Parse a decimal float like "-1.25e3". Returns a pointer to the character
+// after the number, or NULL if there wasn't one.
+static const char* obj_parse_float(const char* p, float* out) {
+    // Every power of 10 that a double can hold exactly. Scaling by one of these
+    // only rounds once, so anything with a normal number of digits comes out
+    // the same as strtof().
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    const bool negative = (*p == '-');
+    if (*p == '-' || *p == '+') {
+        p++;
+    }
+
+    // Digits past what fits in the mantissa are dropped, they're way below
+    // float precision anyway.
+    u64 mantissa = 0;
+    s32 exponent = 0;
+    bool any_digits = false;
+    for (; obj_is_digit(*p); p++) {
+        if (mantissa < 100000000000000000ULL) {
+            mantissa = (mantissa * 10) + (*p - '0');
+        }
+        else {
+            exponent++;
+        }
+        any_digits = true;
+    }
+    if (*p == '.') {
+        for (p++; obj_is_digit(*p); p++) {
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = (mantissa * 10) + (*p - '0');
+                exponent--;
+            }
+            any_digits = true;
+        }
+    }
+    if (!any_digits) {
+        return NULL;
+    }
+    if (*p == 'e' || *p == 'E') {
+        const char* e = p + 1;
+        const bool exp_negative = (*e == '-');
+        if (*e == '-' || *e == '+') {
+            e++;
+        }
+        if (obj_is_digit(*e)) {
+            s32 exp_val = 0;
+            for (; obj_is_digit(*e); e++) {
+                if (exp_val < 1000) {
+                    exp_val = (exp_val * 10) + (*e - '0');
+                }
+            }
+            exponent += exp_negative ? -exp_val : exp_val;
+            p = e;
+        }
+    }
+
+    double val = (double)mantissa;
+    for (; exponent < -22; exponent += 22) {
+        val /= pow10[22];
+    }
+    for (; exponent > 22; exponent -= 22) {
+        val *= pow10[22];
+    }
+    val = (exponent < 0) ? val / pow10[-exponent] : val * pow10[exponent];
+    *out = (float)(negative ? -val : val);
+    return p;
+}
+
+// Parse a decimal int. Returns a pointer to the character after it, or NULL
+// if there wasn't one.
+static const char* obj_parse_int(const char* p, s32* out) {
+    const bool negative = (*p == '-');
+    if (*p == '-' || *p == '+') {
+        p++;
+    }
+    if (!obj_is_digit(*p)) {
+        return NULL;
+    }
+    s32 val = 0;
+    for (; obj_is_digit(*p); p++) {
+        // Anything this big is out of range anyway, just don't overflow
+        if (val < 0x10000000) {
+            val = (val * 10) + (*p - '0');
+        }
+    }
+    *out = negative ? -val : val;
+    return p;
+}
+
+// Position in the fixed point format vertices use. Anything out of range is
+// clamped, which would only happen with a model that isn't a part.
+static s16 obj_pack_position(float val) {
+    const float fixed = roundf(val * VERTEX_POS_SCALE);
+    return (s16)CLAMP(-INT16_MAX, fixed, INT16_MAX);
+}
+
+static u8 obj_pack_color(float val) {
+    return (u8)roundf(CLAMP(0.0f, val, 1.0f) * 0xFF);
+}
+
+// Read a "v x y z [r g b]" line. Vertices without a color are white.
+static const char* obj_parse_vertex(const char* p, vertex* v) {
+    float vals[7] = {0};
+    u32 count = 0;
+    for (p = obj_skip_space(p); count < ARRAY_SIZE(vals); p = obj_skip_space(p)) {
+        const char* end = obj_parse_float(p, &vals[count]);
+        if (end == NULL) {
+            break;
+        }
+        count++;
+        p = end;
+    }
+    if (count < 3) {
+        return NULL;
+    }
+    // 4 values is a position with a W, which we don't care about
+    const bool has_color = (count >= 6);
+    *v = (vertex){0};
+    for (u8 i = 0; i < 3; i++) {
+        v->position.raw[i] = obj_pack_position(vals[i]);
+    }
+    v->color = (rgba8) {
+        .r = has_color ? obj_pack_color(vals[3]) : 0xFF,
+        .g = has_color ? obj_pack_color(vals[4]) : 0xFF,
+        .b = has_color ? obj_pack_color(vals[5]) : 0xFF,
+        .a = 0xFF,
+    };
+    return p;
+}
+
+// Read one corner of a face ("v", "v/vt", "v//vn" or "v/vt/vn") and turn it
+// into a 0-based vertex index. Negative indices count back from the newest
+// vertex. Texture coordinates & normals are skipped.
+static const char* obj_parse_corner(const char* p, u32 vert_count, s32* idx) {
+    p = obj_parse_int(p, idx);
+    if (p == NULL) {
+        return NULL;
+    }
+    *idx = (*idx < 0) ? (s32)vert_count + *idx : *idx - 1;
+    for (u8 i = 0; i < 2 && *p == '/'; i++) {
+        s32 skipped = 0;
+        const char* end = obj_parse_int(p + 1, &skipped);
+        p = (end == NULL) ? p + 1 : end;
+    }
+    return p;
+}
+
+// Check whether a line is a [cmd] followed by its arguments
+static bool obj_is_command(const char* p, char cmd) {
+    return p[0] == cmd && (p[1] == ' ' || p[1] == '\t');
+}
+
+// Read a "f a b c ..." line. Faces can have any number of corners, so they're
+// split into a fan of triangles around the first one.
+static bool obj_parse_face(const char* p, u32 vert_count, list* indices) {
+    s32 first = 0;
+    s32 prev = 0;
+    u32 corners = 0;
+    for (p = obj_skip_space(p); *p != '\n' && *p != '#' && *p != 0x00; p = obj_skip_space(p)) {
+        s32 idx = 0;
+        p = obj_parse_corner(p, vert_count, &idx);
+        if (p == NULL || idx < 0 || idx >= UINT16_MAX) {
+            LOG_MSG(error, "Face %d has a bad vertex index\n", indices->end_idx / 3);
+            return false;
+        }
+        if (corners >= 2) {
+            if (indices->end_idx + 3 > UINT16_MAX) {
+                LOG_MSG(error, "Model has more than %d indices\n", UINT16_MAX);
+                return false;
+            }
+            const u16 tri[3] = {(u16)first, (u16)prev, (u16)idx};
+            for (u8 i = 0; i < 3; i++) {
+                list_add(indices, &tri[i]);
+            }
+        }
+        if (corners == 0) {
+            first = idx;
+        }
+        prev = idx;
+        corners++;
+    }
+    return true;
+}
+
+static bool obj_parse(const char* txt, list* vertices, list* indices) {
+    for (const char* line = txt; *line != 0x00; line = obj_next_line(line)) {
+        const char* p = obj_skip_space(line);
+        if (obj_is_command(p, 'v')) {
+            vertex v = {0};
+            if (obj_parse_vertex(p + 1, &v) == NULL) {
+                LOG_MSG(error, "Vertex %d has fewer than 3 coordinates\n", vertices->end_idx);
+                return false;
+            }
+            if (vertices->end_idx >= UINT16_MAX) {
+                LOG_MSG(error, "Model has more than %d vertices\n", UINT16_MAX);
+                return false;
+            }
+            list_add(vertices, &v);
+        }
+        else if (obj_is_command(p, 'f')) {
+            if (!obj_parse_face(p + 1, vertices->end_idx, indices)) {
+                return false;
+            }
+        }
+        // Anything else (comments, normals, texture coordinates, groups...)
+        // doesn't matter to us.
+    }
+
+    // Faces can technically point at vertices further down the file, so the
+    // indices can only be checked once we have all of them.
+    const u16* idx = (const u16*)indices->data;
+    for (u32 i = 0; i < indices->end_idx; i++) {
+        if (idx[i] >= vertices->end_idx) {
+            LOG_MSG(error, "Index %d points at vertex %d, but there are only %d\n", i, idx[i], vertices->end_idx);
+            return false;
+        }
+    }
+    return true;
+}
+
+model obj_load_raw(const u8* txt) {
+    list vertices = list_create(sizeof(vertex) * 0x100, sizeof(vertex));
+    list indices = list_create(sizeof(u16) * 0x400, sizeof(u16));
+    if (vertices.data == 0 || indices.data == 0) {
+        LOG_MSG(error, "Buffer alloc failure!\n");
+    }
+    else if (obj_parse((const char*)txt, &vertices, &indices)) {
+        return (model) {
+            .vertices = (const void*)vertices.data,
+            .indices = (const u16*)indices.data,
+            .vert_count = vertices.end_idx,
+            .idx_count = indices.end_idx,
+        };
+    }
+    free((void*)vertices.data);
+    free((void*)indices.data);
+    return (model){0};
+}
+
+model obj_load(const u8* txt) {
+    const model m = obj_load_raw(txt);
+    if (m.vertices != NULL) {
+        // The arrays were just allocated by us, they're only const in the model
+        model_optimize((vertex*)m.vertices, (u16*)m.indices, m.vert_count, m.idx_count);
+    }
+    return m;
+}
+
+// Vertex cache optimization
+
+enum {
+    // Number of vertices the optimizer assumes fit in the post-transform
+    // cache. Real GPUs vary, but the order doesn't get much worse on smaller
+    // caches.
+    VCACHE_SIZE = 32,
+};
+
+typedef struct {
+    u32 first_tri; // Start of this vertex's triangles in the adjacency list
+    u32 tri_count; // Triangles using this vertex that haven't been drawn yet
+    s32 cache_pos; // -1 if it isn't in the cache
+    float score;
+}vcache_vertex;
+
+static float vcache_vertex_score(s32 cache_pos, u32 tri_count) {
+    if (tri_count == 0) {
+        // Nothing left to draw with this vertex
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cache_pos >= 0 && cache_pos < 3) {
+        // Used by the triangle we just drew. These all get the same score, so
+        // there's no bias toward any particular corner.
+        score = 0.75f;
+    }
+    else if (cache_pos >= 3) {
+        score = powf(1.0f - ((float)(cache_pos - 3) / (VCACHE_SIZE - 3)), 1.5f);
+    }
+    // Boost vertices with only a few triangles left, so they get finished off
+    // instead of leaving lone triangles for the end.
+    return score + (2.0f / sqrtf((float)tri_count));
+}
+
+static float vcache_tri_score(const vcache_vertex* verts, const u16* tri) {
+    return verts[tri[0]].score + verts[tri[1]].score + verts[tri[2]].score;
+}
+
+// Draw the triangles greedily, always picking the one whose vertices score
+// highest. Writes the new order to [out].
+static void vcache_order_triangles(const u16* indices, u16 vert_count, u32 tri_count, vcache_vertex* verts, u32* adjacency, bool* drawn, u16* out) {
+    // Sort triangles by vertex, so each vertex can see the triangles using it
+    for (u32 i = 0; i < tri_count * 3; i++) {
+        verts[indices[i]].tri_count++;
+    }
+    u32 offset = 0;
+    for (u32 i = 0; i < vert_count; i++) {
+        verts[i].first_tri = offset;
+        offset += verts[i].tri_count;
+        verts[i].tri_count = 0;
+        verts[i].cache_pos = -1;
+    }
+    for (u32 i = 0; i < tri_count * 3; i++) {
+        vcache_vertex* v = &verts[indices[i]];
+        adjacency[v->first_tri + v->tri_count++] = i / 3;
+    }
+    for (u32 i = 0; i < vert_count; i++) {
+        verts[i].score = vcache_vertex_score(-1, verts[i].tri_count);
+    }
+
+    u16 cache[VCACHE_SIZE + 3] = {0};
+    u32 cache_count = 0;
+    u32 best = UINT32_MAX;
+    u32 restart = 0;
+    for (u32 drawn_count = 0; drawn_count < tri_count; drawn_count++) {
+        // Nothing in the cache has triangles left, so start over from the
+        // next triangle in the original order. Searching for the best one
+        // instead would be quadratic on models made of lots of separate
+        // pieces.
+        if (best == UINT32_MAX) {
+            while (drawn[restart]) {
+                restart++;
+            }
+            best = restart;
+        }
+
+        const u16* tri = &indices[best * 3];
+        memcpy(&out[drawn_count * 3], tri, sizeof(u16) * 3);
+        drawn[best] = true;
+
+        // The triangle's corners go to the front of the cache, and everything
+        // else gets pushed back
+        u16 new_cache[VCACHE_SIZE + 3] = {0};
+        u32 new_count = 0;
+        for (u8 c = 0; c < 3; c++) {
+            vcache_vertex* v = &verts[tri[c]];
+            u32* tris = &adjacency[v->first_tri];
+            for (u32 i = 0; i < v->tri_count; i++) {
+                if (tris[i] == best) {
+                    tris[i] = tris[--v->tri_count];
+                    break;
+                }
+            }
+            // -2 marks vertices that are already in the new cache, since
+            // degenerate triangles can have the same vertex twice
+            if (v->cache_pos != -2) {
+                new_cache[new_count++] = tri[c];
+                v->cache_pos = -2;
+            }
+        }
+        for (u32 i = 0; i < cache_count; i++) {
+            if (verts[cache[i]].cache_pos != -2) {
+                new_cache[new_count++] = cache[i];
+            }
+        }
+
+        // Rescore everything that moved, including what just fell out of the
+        // cache, and find the best triangle that uses any of it
+        for (u32 i = 0; i < new_count; i++) {
+            vcache_vertex* v = &verts[new_cache[i]];
+            v->cache_pos = (i < VCACHE_SIZE) ? (s32)i : -1;
+            v->score = vcache_vertex_score(v->cache_pos, v->tri_count);
+        }
+        best = UINT32_MAX;
+        float best_score = -INFINITY;
+        for (u32 i = 0; i < new_count; i++) {
+            const vcache_vertex* v = &verts[new_cache[i]];
+            for (u32 j = 0; j < v->tri_count; j++) {
+                const u32 t = adjacency[v->first_tri + j];
+                const float score = vcache_tri_score(verts, &indices[t * 3]);
+                if (score > best_score) {
+                    best = t;
+                    best_score = score;
+                }
+            }
+        }
+        cache_count = MIN(new_count, (u32)VCACHE_SIZE);
+        memcpy(cache, new_cache, cache_count * sizeof(u16));
+    }
+}
+
+// Number the vertices in the order they're first used by [order], writing the
+// new indices back to [indices]. Any vertices that aren't used go on the end.
+static void vcache_renumber_vertices(vertex* vertices, u16* indices, const u16* order, u16 vert_count, u32 idx_count, u16* remap, vertex* sorted) {
+    memset(remap, 0xFF, vert_count * sizeof(*remap));
+    u16 next = 0;
+    for (u32 i = 0; i < idx_count; i++) {
+        if (remap[order[i]] == UINT16_MAX) {
+            sorted[next] = vertices[order[i]];
+            remap[order[i]] = next++;
+        }
+        indices[i] = remap[order[i]];
+    }
+    for (u32 i = 0; i < vert_count; i++) {
+        if (remap[i] == UINT16_MAX) {
+            sorted[next++] = vertices[i];
+        }
+    }
+    memcpy(vertices, sorted, vert_count * sizeof(*sorted));
+}
+
+void model_optimize(vertex* vertices, u16* indices, u16 vert_count, u16 idx_count) {
+    const u32 tri_count = idx_count / 3;
+    if (tri_count == 0) {
+        return;
+    }
+    vcache_vertex* verts = calloc(vert_count, sizeof(*verts));
+    u32* adjacency = calloc(tri_count * 3, sizeof(*adjacency));
+    bool* drawn = calloc(tri_count, sizeof(*drawn));
+    u16* order = calloc(tri_count * 3, sizeof(*order));
+    u16* remap = calloc(vert_count, sizeof(*remap));
+    vertex* sorted = calloc(vert_count, sizeof(*sorted));
+    if (verts == NULL || adjacency == NULL || drawn == NULL || order == NULL || remap == NULL || sorted == NULL) {
+        // The model still works as it is, it's just slower to draw
+        LOG_MSG(error, "Failed to allocate buffers for %d triangles\n", tri_count);
+    }
+    else {
+        vcache_order_triangles(indices, vert_count, tri_count, verts, adjacency, drawn, order);
+        vcache_renumber_vertices(vertices, indices, order, vert_count, tri_count * 3, remap, sorted);
+    }
+
+    free(verts);
+    free(adjacency);
+    free(drawn);
+    free(order);
+    free(remap);
+    free(sorted);
+}
+
+model mesh_load(const u8* data, u64 size) {
+    mesh_header head = {0};
+    if (size < sizeof(head)) {
+        LOG_MSG(error, "0x%X bytes is too small for a mesh\n", (u32)size);
+        return (model){0};
+    }
+    memcpy(&head, data, sizeof(head));
+    if (head.magic != MESH_MAGIC || head.version != MESH_VERSION || head.vertex_size != sizeof(vertex)) {
+        LOG_MSG(error, "Mesh is from a different version (magic 0x%X, version %d, %d byte vertices)\n", head.magic, head.version, head.vertex_size);
+        return (model){0};
+    }
+    const u64 vert_bytes = (u64)head.vert_count * sizeof(vertex);
+    const u64 idx_bytes = (u64)head.idx_count * sizeof(u16);
+    if (size < sizeof(head) + vert_bytes + idx_bytes) {
+        LOG_MSG(error, "Mesh with %d vertices & %d indices is cut off at 0x%X bytes\n", head.vert_count, head.idx_count, (u32)size);
+        return (model){0};
+    }
+
+    vertex* vertices = malloc(vert_bytes);
+    u16* indices = malloc(idx_bytes);
+    if (vertices == NULL || indices == NULL) {
+        LOG_MSG(error, "Buffer alloc failure!\n");
+        free(vertices);
+        free(indices);
+        return (model){0};
+    }
+    memcpy(vertices, data + sizeof(head), vert_bytes);
+    memcpy(indices, data + sizeof(head) + vert_bytes, idx_bytes);
+
+    // A bad index would read past the end of the vertex buffer on the GPU
+    for (u32 i = 0; i < head.idx_count; i++) {
+        if (indices[i] >= head.vert_count) {
+            LOG_MSG(error, "Index %d points at vertex %d, but there are only %d\n", i, indices[i], head.vert_count);
+            free(vertices);
+            free(indices);
+            return (model){0};
+        }
+    }
+
+    return (model) {
+        .vertices = vertices,
+        .indices = indices,
+        .vert_count = head.vert_count,
+        .idx_count = head.idx_count,
+    };
+}
+
+u8* mesh_save(const model m, u64* size_out) {
+    const mesh_header head = {
+        .magic = MESH_MAGIC,
+        .version = MESH_VERSION,
+        .vertex_size = sizeof(vertex),
+        .vert_count = m.vert_count,
+        .idx_count = m.idx_count,
+    };
+    const u64 vert_bytes = (u64)m.vert_count * sizeof(vertex);
+    const u64 idx_bytes = (u64)m.idx_count * sizeof(u16);
+    const u64 size = sizeof(head) + vert_bytes + idx_bytes;
+    u8* out = malloc(size);
+    if (out == NULL) {
+        LOG_MSG(error, "Failed to allocate 0x%X bytes for a mesh\n", (u32)size);
+        return NULL;
+    }
+    memcpy(out, &head, sizeof(head));
+    memcpy(out + sizeof(head), m.vertices, vert_bytes);
+    memcpy(out + sizeof(head) + vert_bytes, m.indices, idx_bytes);
+
+    if (size_out != NULL) {
+        *size_out = size;
+    }
+    return out;
+}
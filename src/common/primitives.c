@@ -2,20 +2,20 @@
 
 const vertex quad_vertices[] = {
     {
-        .position = {QUAD_SIZE, -1.5f, QUAD_SIZE},
-        .color = {1.0f, 1.0f, 1.0f, 1.0f}
+        .position = {{VERTEX_POS(QUAD_SIZE), VERTEX_POS(-1.5f), VERTEX_POS(QUAD_SIZE)}},
+        .color = {0xFF, 0xFF, 0xFF, 0xFF}
     },
     {
-        .position = {QUAD_SIZE, -1.5f, -QUAD_SIZE},
-        .color = {1.0f, 1.0f, 1.0f, 1.0f}
+        .position = {{VERTEX_POS(QUAD_SIZE), VERTEX_POS(-1.5f), VERTEX_POS(-QUAD_SIZE)}},
+        .color = {0xFF, 0xFF, 0xFF, 0xFF}
     },
     {
-        .position = {-QUAD_SIZE, -1.5f, -QUAD_SIZE},
-        .color = {1.0f, 1.0f, 1.0f, 1.0f}
+        .position = {{VERTEX_POS(-QUAD_SIZE), VERTEX_POS(-1.5f), VERTEX_POS(-QUAD_SIZE)}},
+        .color = {0xFF, 0xFF, 0xFF, 0xFF}
     },
     {
-        .position = {-QUAD_SIZE,  -1.5f, QUAD_SIZE},
-        .color = {1.0f, 1.0f, 1.0f, 1.0f}
+        .position = {{VERTEX_POS(-QUAD_SIZE), VERTEX_POS(-1.5f), VERTEX_POS(QUAD_SIZE)}},
+        .color = {0xFF, 0xFF, 0xFF, 0xFF}
     }
 };
 
@@ -26,38 +26,38 @@ model quad = {
     .indices = quad_indices,
 };
 
-#define CUBE_COLOR {1.0f, 1.0f, 1.0f, 1.0f}
+#define CUBE_COLOR {0xFF, 0xFF, 0xFF, 0xFF}
 const vertex cube_vertices[] = {
     {
-        .position = {CUBE_SIZE, CUBE_SIZE, CUBE_SIZE},
+        .position = {{VERTEX_POS(CUBE_SIZE), VERTEX_POS(CUBE_SIZE), VERTEX_POS(CUBE_SIZE)}},
         .color = CUBE_COLOR
     },
     {
-        .position = {CUBE_SIZE, -CUBE_SIZE, CUBE_SIZE},
+        .position = {{VERTEX_POS(CUBE_SIZE), VERTEX_POS(-CUBE_SIZE), VERTEX_POS(CUBE_SIZE)}},
         .color = CUBE_COLOR
     },
     {
-        .position = {-CUBE_SIZE, -CUBE_SIZE, CUBE_SIZE},
+        .position = {{VERTEX_POS(-CUBE_SIZE), VERTEX_POS(-CUBE_SIZE), VERTEX_POS(CUBE_SIZE)}},
         .color = CUBE_COLOR
     },
     {
-        .position = {-CUBE_SIZE,  CUBE_SIZE, CUBE_SIZE},
+        .position = {{VERTEX_POS(-CUBE_SIZE), VERTEX_POS(CUBE_SIZE), VERTEX_POS(CUBE_SIZE)}},
         .color = CUBE_COLOR
     },
     {
-        .position = {CUBE_SIZE, CUBE_SIZE, -CUBE_SIZE},
+        .position = {{VERTEX_POS(CUBE_SIZE), VERTEX_POS(CUBE_SIZE), VERTEX_POS(-CUBE_SIZE)}},
         .color = CUBE_COLOR
     },
     {
-        .position = {CUBE_SIZE, -CUBE_SIZE, -CUBE_SIZE},
+        .position = {{VERTEX_POS(CUBE_SIZE), VERTEX_POS(-CUBE_SIZE), VERTEX_POS(-CUBE_SIZE)}},
         .color = CUBE_COLOR
     },
     {
-        .position = {-CUBE_SIZE, -CUBE_SIZE, -CUBE_SIZE},
+        .position = {{VERTEX_POS(-CUBE_SIZE), VERTEX_POS(-CUBE_SIZE), VERTEX_POS(-CUBE_SIZE)}},
         .color = CUBE_COLOR
     },
     {
-        .position = {-CUBE_SIZE,  CUBE_SIZE, -CUBE_SIZE},
+        .position = {{VERTEX_POS(-CUBE_SIZE), VERTEX_POS(CUBE_SIZE), VERTEX_POS(-CUBE_SIZE)}},
         .color = CUBE_COLOR
     }
 };
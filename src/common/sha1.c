@@ -1,37 +1,43 @@
 // Modified from the sha1.c in RFC 3171.
 // SHA-1 produces a 20-byte message digest for any byte stream.
 //
-// The context-based API has been replaced with a simple API taking a buffer to
-// hash, since the context isn't useful for our use case.
+// The RFC's error codes are gone, and the compression function can be swapped
+// out for one using the CPU's SHA instructions. Verifying STFS packages is
+// almost entirely SHA1 work, so this matters a lot for big batches.
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "cpu.h"
 #include "endian.h"
 #include "sha1.h"
 
-#define SHA1CircularShift(bits,word) (((word) << (bits)) | ((word) >> (32-(bits))))
-
-typedef struct SHA1Context {
-    u32 intermediate_hash[SHA1_HASH_SIZE / 4]; /* Message Digest  */
-    u64 length;
-
-    u8 msg_block_idx;
-    u8 msg_block[64]; // 512-bit message block
-
-    bool computed;  // Is the digest computed?
-    bool corrupted; // Is the message digest corrupted?
-}SHA1Context;
+#if defined(__x86_64__) || defined(_M_X64)
+    #define SHA1_HAVE_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #define SHA1_TARGET_SHA_NI
+        #define SHA1_TARGET_AVX2
+        #define SHA1_TARGET_AVX512
+    #else
+        #define SHA1_TARGET_SHA_NI __attribute__((target("sha,sse4.1,ssse3")))
+        #define SHA1_TARGET_AVX2 __attribute__((target("avx2")))
+        #define SHA1_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+    #endif
+#endif
+
+// The ARM intrinsics need the crypto extensions enabled at compile time
+// (e.g. -march=armv8-a+crypto). Apple's compilers do this by default.
+#if (defined(__aarch64__) || defined(_M_ARM64)) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2) || defined(_MSC_VER))
+    #define SHA1_HAVE_ARMV8 1
+    #include <arm_neon.h>
+#endif
 
-enum {
-    shaSuccess = 0,
-    shaNull,         // Null pointer parameter
-    shaInputTooLong,
-    shaStateError    // You called Input after Result
-};
+#define SHA1CircularShift(bits,word) (((word) << (bits)) | ((word) >> (32-(bits))))
 
-void SHA1PadMessage(SHA1Context *);
-void SHA1ProcessMessageBlock(SHA1Context *);
+// Process |count| 64-byte blocks
+typedef void (*sha1_compress_fn)(u32 state[5], const u8* data, u64 count);
 
 bool SHA1_equal(sha1_digest x, sha1_digest y) {
     return (memcmp(&x, &y, sizeof(x)) == 0);
@@ -48,199 +54,579 @@ void SHA1_print(sha1_digest x) {
     }
 }
 
-SHA1Context SHA1_Init() {
-    return (SHA1Context) {
-        .intermediate_hash = {
-            0x67452301,
-            0xEFCDAB89,
-            0x98BADCFE,
-            0x10325476,
-            0xC3D2E1F0,
-        }
+// Process the next 512 bits of the message, straight from the RFC
+static void SHA1_compress_scalar(u32 state[5], const u8* data, u64 count) {
+    const uint32_t K[] = { // Constants defined in SHA-1
+            0x5A827999,
+            0x6ED9EBA1,
+            0x8F1BBCDC,
+            0xCA62C1D6
     };
-}
+    for (; count > 0; count--, data += SHA1_BLOCK_SIZE) {
+        u32 W[80];         // Word sequence
+        u32 A, B, C, D, E; // Word buffers
 
-// Writes the 160-bit digest into the digest array provided by the caller.
-int SHA1Result(SHA1Context* context, sha1_digest* digest) {
-    if (!context || !digest) {
-        return shaNull;
-    }
+        // Initialize the first 16 words in the array W
+        for(u8 t = 0; t < 16; t++) {
+            W[t] = read_be32(&data[t * 4]);
+        }
 
-    if (context->corrupted) {
-        return shaStateError;
-    }
+        for(u8 t = 16; t < 80; t++) {
+            W[t] = SHA1CircularShift(1,W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16]);
+        }
+
+        A = state[0];
+        B = state[1];
+        C = state[2];
+        D = state[3];
+        E = state[4];
+
+        for(u8 t = 0; t < 20; t++) {
+            u32 temp =  SHA1CircularShift(5,A) +
+                    ((B & C) | ((~B) & D)) + E + W[t] + K[0];
+            E = D;
+            D = C;
+            C = SHA1CircularShift(30,B);
+
+            B = A;
+            A = temp;
+        }
 
-    if (!context->computed) {
-        SHA1PadMessage(context);
-        // Message may be sensitive, clear it out
-        memset(context->msg_block, 0x00, sizeof(context->msg_block));
-        context->length = 0; // and clear length
-        context->computed = true;
+        for(u8 t = 20; t < 40; t++) {
+            u32 temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + W[t] + K[1];
+            E = D;
+            D = C;
+            C = SHA1CircularShift(30,B);
+            B = A;
+            A = temp;
+        }
+
+        for(u8 t = 40; t < 60; t++) {
+            u32 temp = SHA1CircularShift(5,A) +
+                   ((B & C) | (B & D) | (C & D)) + E + W[t] + K[2];
+            E = D;
+            D = C;
+            C = SHA1CircularShift(30,B);
+            B = A;
+            A = temp;
+        }
+
+        for(u8 t = 60; t < 80; t++) {
+            u32 temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + W[t] + K[3];
+            E = D;
+            D = C;
+            C = SHA1CircularShift(30,B);
+            B = A;
+            A = temp;
+        }
+
+        state[0] += A;
+        state[1] += B;
+        state[2] += C;
+        state[3] += D;
+        state[4] += E;
     }
+}
 
-    for(u32 i = 0; i < SHA1_HASH_SIZE; ++i) {
-        digest->bytes[i] = context->intermediate_hash[i >> 2]
-                >> 8 * ( 3 - ( i & 0x03 ) );
+#ifdef SHA1_HAVE_X86
+// One group of 4 rounds using Intel's SHA extensions, based on Intel's white
+// paper. See https://www.intel.com/content/www/us/en/developer/articles/technical/intel-sha-extensions.html
+// The message schedule for group k+1, k+2 and k+3 is computed alongside the
+// rounds for group k. |k| must be a literal so the round function is an
+// immediate value.
+#define SHA1_NI_GROUP(k)                                                      \
+do {                                                                          \
+    if ((k) == 0) {                                                           \
+        e[0] = _mm_add_epi32(e[0], msg[0]);                                   \
+    } else {                                                                  \
+        e[(k) & 1] = _mm_sha1nexte_epu32(e[(k) & 1], msg[(k) % 4]);           \
+    }                                                                         \
+    e[((k) + 1) & 1] = abcd;                                                  \
+    if ((k) >= 3 && (k) <= 18) {                                              \
+        msg[((k) + 1) % 4] = _mm_sha1msg2_epu32(msg[((k) + 1) % 4], msg[(k) % 4]); \
+    }                                                                         \
+    abcd = _mm_sha1rnds4_epu32(abcd, e[(k) & 1], (k) / 5);                    \
+    if ((k) >= 1 && (k) <= 16) {                                              \
+        msg[((k) + 3) % 4] = _mm_sha1msg1_epu32(msg[((k) + 3) % 4], msg[(k) % 4]); \
+    }                                                                         \
+    if ((k) >= 2 && (k) <= 17) {                                              \
+        msg[((k) + 2) % 4] = _mm_xor_si128(msg[((k) + 2) % 4], msg[(k) % 4]); \
+    }                                                                         \
+} while(0)
+
+SHA1_TARGET_SHA_NI
+static void SHA1_compress_sha_ni(u32 state[5], const u8* data, u64 count) {
+    // Reverses the bytes of each 32-bit word
+    const __m128i bswap_mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+
+    // The instructions want A in the highest lane, so the state is reversed
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+    __m128i e[2] = {_mm_set_epi32(state[4], 0, 0, 0)};
+    __m128i msg[4];
+
+    for (; count > 0; count--, data += SHA1_BLOCK_SIZE) {
+        const __m128i abcd_save = abcd;
+        const __m128i e_save = e[0];
+        for (u32 i = 0; i < 4; i++) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), bswap_mask);
+        }
+
+        SHA1_NI_GROUP(0);  SHA1_NI_GROUP(1);  SHA1_NI_GROUP(2);  SHA1_NI_GROUP(3);
+        SHA1_NI_GROUP(4);  SHA1_NI_GROUP(5);  SHA1_NI_GROUP(6);  SHA1_NI_GROUP(7);
+        SHA1_NI_GROUP(8);  SHA1_NI_GROUP(9);  SHA1_NI_GROUP(10); SHA1_NI_GROUP(11);
+        SHA1_NI_GROUP(12); SHA1_NI_GROUP(13); SHA1_NI_GROUP(14); SHA1_NI_GROUP(15);
+        SHA1_NI_GROUP(16); SHA1_NI_GROUP(17); SHA1_NI_GROUP(18); SHA1_NI_GROUP(19);
+
+        e[0] = _mm_sha1nexte_epu32(e[0], e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
     }
 
-    return shaSuccess;
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = _mm_extract_epi32(e[0], 3);
 }
+#endif // SHA1_HAVE_X86
+
+#ifdef SHA1_HAVE_ARMV8
+// One group of 4 rounds using the ARMv8 SHA1 instructions. |tmp| holds the
+// message words + round constant for the next 2 groups, and the schedule for
+// later groups is computed alongside.
+#define SHA1_ARM_GROUP(k)                                                     \
+do {                                                                          \
+    e[((k) + 1) & 1] = vsha1h_u32(vgetq_lane_u32(abcd, 0));                   \
+    if ((k) / 5 == 0) {                                                       \
+        abcd = vsha1cq_u32(abcd, e[(k) & 1], tmp[(k) & 1]);                   \
+    } else if ((k) / 5 == 2) {                                                \
+        abcd = vsha1mq_u32(abcd, e[(k) & 1], tmp[(k) & 1]);                   \
+    } else {                                                                  \
+        abcd = vsha1pq_u32(abcd, e[(k) & 1], tmp[(k) & 1]);                   \
+    }                                                                         \
+    if ((k) <= 17) {                                                          \
+        tmp[(k) & 1] = vaddq_u32(msg[((k) + 2) % 4], vdupq_n_u32(K[((k) + 2) / 5])); \
+    }                                                                         \
+    if ((k) >= 1 && (k) <= 16) {                                              \
+        msg[((k) + 3) % 4] = vsha1su1q_u32(msg[((k) + 3) % 4], msg[((k) + 2) % 4]); \
+    }                                                                         \
+    if ((k) <= 15) {                                                          \
+        msg[(k) % 4] = vsha1su0q_u32(msg[(k) % 4], msg[((k) + 1) % 4], msg[((k) + 2) % 4]); \
+    }                                                                         \
+} while(0)
+
+static void SHA1_compress_armv8(u32 state[5], const u8* data, u64 count) {
+    const u32 K[] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+    uint32x4_t abcd = vld1q_u32(state);
+    u32 e[2] = {state[4]};
+    uint32x4_t msg[4];
+    uint32x4_t tmp[2];
+
+    for (; count > 0; count--, data += SHA1_BLOCK_SIZE) {
+        const uint32x4_t abcd_save = abcd;
+        const u32 e_save = e[0];
+        for (u32 i = 0; i < 4; i++) {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+        }
+        tmp[0] = vaddq_u32(msg[0], vdupq_n_u32(K[0]));
+        tmp[1] = vaddq_u32(msg[1], vdupq_n_u32(K[0]));
+
+        SHA1_ARM_GROUP(0);  SHA1_ARM_GROUP(1);  SHA1_ARM_GROUP(2);  SHA1_ARM_GROUP(3);
+        SHA1_ARM_GROUP(4);  SHA1_ARM_GROUP(5);  SHA1_ARM_GROUP(6);  SHA1_ARM_GROUP(7);
+        SHA1_ARM_GROUP(8);  SHA1_ARM_GROUP(9);  SHA1_ARM_GROUP(10); SHA1_ARM_GROUP(11);
+        SHA1_ARM_GROUP(12); SHA1_ARM_GROUP(13); SHA1_ARM_GROUP(14); SHA1_ARM_GROUP(15);
+        SHA1_ARM_GROUP(16); SHA1_ARM_GROUP(17); SHA1_ARM_GROUP(18); SHA1_ARM_GROUP(19);
 
-// Adds an array of bytes as the next portion of the message.
-int SHA1Input(SHA1Context* context, const u8* message_array, u32 length) {
-    if (!length) {
-        return shaSuccess;
+        e[0] += e_save;
+        abcd = vaddq_u32(abcd, abcd_save);
     }
 
-    if (!context || !message_array) {
-        return shaNull;
+    vst1q_u32(state, abcd);
+    state[4] = e[0];
+}
+#endif // SHA1_HAVE_ARMV8
+
+static bool SHA1_backend_supported(sha1_backend backend) {
+    switch (backend) {
+    case SHA1_BACKEND_SCALAR:
+        return true;
+#ifdef SHA1_HAVE_X86
+    case SHA1_BACKEND_SHA_NI:
+        return cpu_get_features()->sha_ni;
+#endif
+#ifdef SHA1_HAVE_ARMV8
+    case SHA1_BACKEND_ARMV8:
+        return cpu_get_features()->armv8_sha1;
+#endif
+    default:
+        return false;
     }
+}
+
+static const sha1_compress_fn SHA1_compress_fns[SHA1_BACKEND_COUNT] = {
+    [SHA1_BACKEND_SCALAR] = SHA1_compress_scalar,
+#ifdef SHA1_HAVE_X86
+    [SHA1_BACKEND_SHA_NI] = SHA1_compress_sha_ni,
+#endif
+#ifdef SHA1_HAVE_ARMV8
+    [SHA1_BACKEND_ARMV8] = SHA1_compress_armv8,
+#endif
+};
+
+// The fastest backend this CPU supports. cpu_get_features() only detects the
+// CPU once (thread-safe), so this is cheap and any thread can call it.
+static sha1_backend SHA1_best_backend() {
+    sha1_backend best = SHA1_BACKEND_SCALAR;
+    for (sha1_backend b = SHA1_BACKEND_SCALAR + 1; b < SHA1_BACKEND_COUNT; b++) {
+        if (SHA1_backend_supported(b)) {
+            best = b;
+        }
+    }
+    return best;
+}
+
+// Only written by SHA1_set_backend(). SHA1_BACKEND_COUNT means no override.
+static sha1_backend SHA1_forced = SHA1_BACKEND_COUNT;
+
+sha1_backend SHA1_get_backend() {
+    return (SHA1_forced != SHA1_BACKEND_COUNT) ? SHA1_forced : SHA1_best_backend();
+}
+
+static sha1_compress_fn SHA1_compress() {
+    return SHA1_compress_fns[SHA1_get_backend()];
+}
 
-    if (context->computed) {
-        context->corrupted = true;
-        return shaStateError;
+bool SHA1_set_backend(sha1_backend backend) {
+    if (backend >= SHA1_BACKEND_COUNT || !SHA1_backend_supported(backend)) {
+        return false;
     }
+    SHA1_forced = backend;
+    return true;
+}
 
-    if (context->corrupted) {
-        return context->corrupted;
+const char* SHA1_backend_name(sha1_backend backend) {
+    switch (backend) {
+    case SHA1_BACKEND_SCALAR: return "scalar";
+    case SHA1_BACKEND_SHA_NI: return "SHA-NI";
+    case SHA1_BACKEND_ARMV8:  return "ARMv8";
+    default:                  return "unknown";
     }
-    while(length-- && !context->corrupted) {
-        context->msg_block[context->msg_block_idx++] = *message_array;
+}
 
-        if (context->length >= UINT64_MAX - 8) {
-            context->corrupted = true;
+void SHA1_init(sha1_ctx* ctx) {
+    *ctx = (sha1_ctx) {
+        .state = {
+            0x67452301,
+            0xEFCDAB89,
+            0x98BADCFE,
+            0x10325476,
+            0xC3D2E1F0,
         }
-        context->length += 8;
+    };
+}
 
-        if (context->msg_block_idx == 64) {
-            SHA1ProcessMessageBlock(context);
+void SHA1_update(sha1_ctx* ctx, const void* data, u64 len) {
+    const sha1_compress_fn compress = SHA1_compress();
+    const u8* bytes = data;
+    ctx->length += len;
+
+    // Finish off a partial block from last time
+    if (ctx->block_len > 0) {
+        const u32 n = MIN(len, (u64)(SHA1_BLOCK_SIZE - ctx->block_len));
+        memcpy(ctx->block + ctx->block_len, bytes, n);
+        ctx->block_len += n;
+        bytes += n;
+        len -= n;
+        if (ctx->block_len < SHA1_BLOCK_SIZE) {
+            return;
         }
+        compress(ctx->state, ctx->block, 1);
+        ctx->block_len = 0;
+    }
 
-        message_array++;
+    // Whole blocks are hashed straight from the input, without copying
+    const u64 blocks = len / SHA1_BLOCK_SIZE;
+    if (blocks > 0) {
+        compress(ctx->state, bytes, blocks);
+        bytes += blocks * SHA1_BLOCK_SIZE;
+        len -= blocks * SHA1_BLOCK_SIZE;
     }
 
-    return shaSuccess;
+    memcpy(ctx->block, bytes, len);
+    ctx->block_len = len;
 }
 
-// Process the next 512 bits of the message in msg_block
-void SHA1ProcessMessageBlock(SHA1Context *context) {
-    const uint32_t K[] = { // Constants defined in SHA-1
-            0x5A827999,
-            0x6ED9EBA1,
-            0x8F1BBCDC,
-            0xCA62C1D6
-    };
-    u32 W[80];         // Word sequence
-    u32 A, B, C, D, E; // Word buffers
-
-    // Initialize the first 16 words in the array W
-    for(u8 t = 0; t < 16; t++) {
-        W[t] = context->msg_block[t * 4] << 24;
-        W[t] |= context->msg_block[t * 4 + 1] << 16;
-        W[t] |= context->msg_block[t * 4 + 2] << 8;
-        W[t] |= context->msg_block[t * 4 + 3];
+// Pads the message to 512 bits in accordance with the standard. The last 8
+// bytes store the original message's length in bits.
+sha1_digest SHA1_final(sha1_ctx* ctx) {
+    const sha1_compress_fn compress = SHA1_compress();
+    const u64 bit_len = ctx->length * 8;
+
+    ctx->block[ctx->block_len++] = 0x80;
+    // If there's no room for the length, pad out this block and start another
+    if (ctx->block_len > SHA1_BLOCK_SIZE - 8) {
+        memset(ctx->block + ctx->block_len, 0, SHA1_BLOCK_SIZE - ctx->block_len);
+        compress(ctx->state, ctx->block, 1);
+        ctx->block_len = 0;
+    }
+    memset(ctx->block + ctx->block_len, 0, SHA1_BLOCK_SIZE - 8 - ctx->block_len);
+    for (u32 i = 0; i < 8; i++) {
+        ctx->block[SHA1_BLOCK_SIZE - 1 - i] = (bit_len >> (i * 8)) & 0xFF;
     }
+    compress(ctx->state, ctx->block, 1);
 
-    for(u8 t = 16; t < 80; t++) {
-        W[t] = SHA1CircularShift(1,W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16]);
+    sha1_digest out = {0};
+    for (u32 i = 0; i < SHA1_HASH_SIZE; i++) {
+        out.bytes[i] = ctx->state[i >> 2] >> 8 * (3 - (i & 0x03));
     }
 
-    A = context->intermediate_hash[0];
-    B = context->intermediate_hash[1];
-    C = context->intermediate_hash[2];
-    D = context->intermediate_hash[3];
-    E = context->intermediate_hash[4];
+    // Message may be sensitive, clear it out
+    memset(ctx, 0, sizeof(*ctx));
+    return out;
+}
+
+sha1_digest SHA1_buf(const u8* buf, u64 len) {
+    sha1_ctx ctx;
+    SHA1_init(&ctx);
+    SHA1_update(&ctx, buf, len);
+    return SHA1_final(&ctx);
+}
+
+// == Multi-buffer hashing ==
+// Hashes of different buffers don't depend on each other, so we can run one
+// message per SIMD lane. Each lane does plain scalar-style SHA1 math, but 8
+// (AVX2) or 16 (AVX-512) at a time.
 
-    // TODO: Look into SIMD acceleration on newer CPUs. See https://www.intel.com/content/www/us/en/developer/articles/technical/intel-sha-extensions.html
-    for(u8 t = 0; t < 20; t++) {
-        u32 temp =  SHA1CircularShift(5,A) +
-                ((B & C) | ((~B) & D)) + E + W[t] + K[0];
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
+enum {
+    SHA1_MAX_LANES = 16,
+};
 
-        B = A;
-        A = temp;
+// State is stored lane-major: state[word][lane]
+typedef void (*sha1_compress_many_fn)(u32 state[5][SHA1_MAX_LANES], const u8* const* lanes, u64 count);
+
+// The 80 rounds for one block, shared between vector widths. Expects the
+// first 16 words of the block in w[] (already in host order) and V_ADD,
+// V_XOR, V_AND, V_OR, V_ROTL and V_SET1 to be defined for the vector type.
+#define SHA1_MB_ROUNDS(T)                                                     \
+do {                                                                          \
+    T a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];                       \
+    for (u32 t = 0; t < 80; t++) {                                            \
+        if (t >= 16) {                                                        \
+            const T x = V_XOR(V_XOR(w[(t - 3) & 15], w[(t - 8) & 15]),        \
+                              V_XOR(w[(t - 14) & 15], w[t & 15]));            \
+            w[t & 15] = V_ROTL(x, 1);                                         \
+        }                                                                     \
+        T f;                                                                  \
+        if (t < 20) {                                                         \
+            f = V_XOR(d, V_AND(b, V_XOR(c, d)));                              \
+        } else if (t >= 40 && t < 60) {                                       \
+            f = V_OR(V_AND(b, c), V_AND(d, V_OR(b, c)));                      \
+        } else {                                                              \
+            f = V_XOR(V_XOR(b, c), d);                                        \
+        }                                                                     \
+        const T temp = V_ADD(V_ADD(V_ROTL(a, 5), f),                          \
+                             V_ADD(V_ADD(e, w[t & 15]), V_SET1(K[t / 20])));  \
+        e = d;                                                                \
+        d = c;                                                                \
+        c = V_ROTL(b, 30);                                                    \
+        b = a;                                                                \
+        a = temp;                                                             \
+    }                                                                         \
+    s[0] = V_ADD(s[0], a);                                                    \
+    s[1] = V_ADD(s[1], b);                                                    \
+    s[2] = V_ADD(s[2], c);                                                    \
+    s[3] = V_ADD(s[3], d);                                                    \
+    s[4] = V_ADD(s[4], e);                                                    \
+} while(0)
+
+static const u32 SHA1_mb_K[] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+
+#ifdef SHA1_HAVE_X86
+#define V_ADD(x, y) _mm256_add_epi32(x, y)
+#define V_XOR(x, y) _mm256_xor_si256(x, y)
+#define V_AND(x, y) _mm256_and_si256(x, y)
+#define V_OR(x, y) _mm256_or_si256(x, y)
+#define V_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define V_SET1(x) _mm256_set1_epi32(x)
+
+SHA1_TARGET_AVX2
+static void SHA1_compress_many_avx2(u32 state[5][SHA1_MAX_LANES], const u8* const* lanes, u64 count) {
+    const u32* K = SHA1_mb_K;
+    const __m256i bswap_mask = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3
+    );
+    __m256i s[5];
+    for (u32 i = 0; i < 5; i++) {
+        s[i] = _mm256_loadu_si256((const __m256i*)state[i]);
     }
 
-    for(u8 t = 20; t < 40; t++) {
-        u32 temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + W[t] + K[1];
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
+    for (u64 blk = 0; blk < count; blk++) {
+        // Load 8 words from each lane, then transpose so w[i] has word i of
+        // every lane.
+        __m256i w[16];
+        for (u32 half = 0; half < 2; half++) {
+            __m256i r[8];
+            for (u32 l = 0; l < 8; l++) {
+                const u8* src = lanes[l] + (blk * SHA1_BLOCK_SIZE) + (half * 32);
+                r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)src), bswap_mask);
+            }
+            __m256i t[8], u[8];
+            for (u32 l = 0; l < 8; l += 2) {
+                t[l] = _mm256_unpacklo_epi32(r[l], r[l + 1]);
+                t[l + 1] = _mm256_unpackhi_epi32(r[l], r[l + 1]);
+            }
+            for (u32 l = 0; l < 8; l += 4) {
+                u[l] = _mm256_unpacklo_epi64(t[l], t[l + 2]);
+                u[l + 1] = _mm256_unpackhi_epi64(t[l], t[l + 2]);
+                u[l + 2] = _mm256_unpacklo_epi64(t[l + 1], t[l + 3]);
+                u[l + 3] = _mm256_unpackhi_epi64(t[l + 1], t[l + 3]);
+            }
+            __m256i* out = &w[half * 8];
+            for (u32 i = 0; i < 4; i++) {
+                out[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+                out[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+            }
+        }
+
+        SHA1_MB_ROUNDS(__m256i);
     }
 
-    for(u8 t = 40; t < 60; t++) {
-        u32 temp = SHA1CircularShift(5,A) +
-               ((B & C) | (B & D) | (C & D)) + E + W[t] + K[2];
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
+    for (u32 i = 0; i < 5; i++) {
+        _mm256_storeu_si256((__m256i*)state[i], s[i]);
     }
+}
 
-    for(u8 t = 60; t < 80; t++) {
-        u32 temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + W[t] + K[3];
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ROTL
+#undef V_SET1
+
+#define V_ADD(x, y) _mm512_add_epi32(x, y)
+#define V_XOR(x, y) _mm512_xor_si512(x, y)
+#define V_AND(x, y) _mm512_and_si512(x, y)
+#define V_OR(x, y) _mm512_or_si512(x, y)
+#define V_ROTL(x, n) _mm512_rol_epi32(x, n)
+#define V_SET1(x) _mm512_set1_epi32(x)
+
+SHA1_TARGET_AVX512
+static void SHA1_compress_many_avx512(u32 state[5][SHA1_MAX_LANES], const u8* const* lanes, u64 count) {
+    const u32* K = SHA1_mb_K;
+    const __m512i bswap_mask = _mm512_set4_epi32(0x0C0D0E0F, 0x08090A0B, 0x04050607, 0x00010203);
+    // Gathers take a 64-bit address per lane (base of 0), so lanes don't
+    // need to be anywhere near each other.
+    const __m512i lo_addrs = _mm512_loadu_si512(&lanes[0]);
+    const __m512i hi_addrs = _mm512_loadu_si512(&lanes[8]);
+    __m512i s[5];
+    for (u32 i = 0; i < 5; i++) {
+        s[i] = _mm512_loadu_si512(state[i]);
     }
 
-    context->intermediate_hash[0] += A;
-    context->intermediate_hash[1] += B;
-    context->intermediate_hash[2] += C;
-    context->intermediate_hash[3] += D;
-    context->intermediate_hash[4] += E;
+    for (u64 blk = 0; blk < count; blk++) {
+        __m512i w[16];
+        for (u32 i = 0; i < 16; i++) {
+            const __m512i off = _mm512_set1_epi64((blk * SHA1_BLOCK_SIZE) + (i * 4));
+            const __m256i lo = _mm512_i64gather_epi32(_mm512_add_epi64(lo_addrs, off), NULL, 1);
+            const __m256i hi = _mm512_i64gather_epi32(_mm512_add_epi64(hi_addrs, off), NULL, 1);
+            const __m512i words = _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+            w[i] = _mm512_shuffle_epi8(words, bswap_mask);
+        }
 
-    context->msg_block_idx = 0;
+        SHA1_MB_ROUNDS(__m512i);
+    }
+
+    for (u32 i = 0; i < 5; i++) {
+        _mm512_storeu_si512(state[i], s[i]);
+    }
 }
 
-// Pads the message to 512 bits in accordance with the standard. The last 8
-// bytes store the original message's length. It will also call the
-// ProcessMessageBlock() function provided appropriately. When it returns, you
-// can assume the message digest has been computed.
-void SHA1PadMessage(SHA1Context *context) {
-    // Check to see if the current message block is too small to hold the
-    // initial padding bits and length. If so, we will pad the block, process
-    // it, and then continue padding into a second block.
-    if (context->msg_block_idx > 55) {
-        context->msg_block[context->msg_block_idx++] = 0x80;
-        while(context->msg_block_idx < 64) {
-            context->msg_block[context->msg_block_idx++] = 0;
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ROTL
+#undef V_SET1
+#endif // SHA1_HAVE_X86
+
+// Hash exactly |width| equal-length buffers with a multi-buffer backend
+static void SHA1_many_simd(const u8* const* bufs, u32 width, u64 len, sha1_digest* out, sha1_compress_many_fn compress) {
+    static const u32 init[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    u32 state[5][SHA1_MAX_LANES];
+    for (u32 i = 0; i < 5; i++) {
+        for (u32 l = 0; l < SHA1_MAX_LANES; l++) {
+            state[i][l] = init[i];
         }
+    }
 
-        SHA1ProcessMessageBlock(context);
-
-        while(context->msg_block_idx < 56) {
-            context->msg_block[context->msg_block_idx++] = 0;
+    const u64 full_blocks = len / SHA1_BLOCK_SIZE;
+    compress(state, bufs, full_blocks);
+
+    // Every buffer is the same length, so they all get the same padding
+    const u32 rem = len % SHA1_BLOCK_SIZE;
+    const u32 tail_blocks = (rem + 9 > SHA1_BLOCK_SIZE) ? 2 : 1;
+    const u64 bit_len = len * 8;
+    u8 tails[SHA1_MAX_LANES][SHA1_BLOCK_SIZE * 2];
+    const u8* tail_ptrs[SHA1_MAX_LANES];
+    for (u32 l = 0; l < width; l++) {
+        u8* tail = tails[l];
+        memset(tail, 0, sizeof(tails[l]));
+        memcpy(tail, bufs[l] + (full_blocks * SHA1_BLOCK_SIZE), rem);
+        tail[rem] = 0x80;
+        for (u32 i = 0; i < 8; i++) {
+            tail[(tail_blocks * SHA1_BLOCK_SIZE) - 1 - i] = (bit_len >> (i * 8)) & 0xFF;
         }
+        tail_ptrs[l] = tail;
     }
-    else {
-        context->msg_block[context->msg_block_idx++] = 0x80;
-        while(context->msg_block_idx < 56) {
-            context->msg_block[context->msg_block_idx++] = 0;
+    compress(state, tail_ptrs, tail_blocks);
+
+    for (u32 l = 0; l < width; l++) {
+        for (u32 i = 0; i < SHA1_HASH_SIZE; i++) {
+            out[l].bytes[i] = state[i >> 2][l] >> 8 * (3 - (i & 0x03));
         }
     }
+}
 
-    // Store the message length in the last 8 bytes
-    ENDIAN_FLIP(u64, context->length);
-    u64* len = (u64*)&context->msg_block[56];
-    *len = context->length;
-    ENDIAN_FLIP(u64, context->length);
-
-    SHA1ProcessMessageBlock(context);
+// Widest multi-buffer backend the CPU supports. A width of 1 means there's
+// nothing better than hashing one buffer at a time.
+static u32 SHA1_many_width(sha1_compress_many_fn* compress) {
+#ifdef SHA1_HAVE_X86
+    const cpu_features* cpu = cpu_get_features();
+    if (cpu->avx512) {
+        *compress = SHA1_compress_many_avx512;
+        return 16;
+    } else if (cpu->avx2) {
+        *compress = SHA1_compress_many_avx2;
+        return 8;
+    }
+    *compress = NULL;
+    return 1;
+#else
+    *compress = NULL;
+    return 1;
+#endif
 }
 
-sha1_digest SHA1_buf(u8* buf, u64 len) {
-    SHA1Context ctx = SHA1_Init();
-    sha1_digest out = {0};
-    SHA1Input(&ctx, buf, len);
-    SHA1Result(&ctx, &out);
+void SHA1_buf_many(const u8* const* bufs, u32 count, u64 len, sha1_digest* out) {
+    sha1_compress_many_fn compress = NULL;
+    const u32 width = SHA1_many_width(&compress);
 
-    return out;
+    u32 i = 0;
+    for (; width > 1 && count - i >= width; i += width) {
+        SHA1_many_simd(&bufs[i], width, len, &out[i], compress);
+    }
+
+    // If we have enough left over, it's still worth filling the empty lanes
+    // with copies of the last buffer.
+    if (width > 1 && count - i >= width / 2) {
+        const u8* lanes[SHA1_MAX_LANES];
+        sha1_digest digests[SHA1_MAX_LANES];
+        for (u32 l = 0; l < width; l++) {
+            lanes[l] = bufs[MIN(i + l, count - 1)];
+        }
+        SHA1_many_simd(lanes, width, len, digests, compress);
+        memcpy(&out[i], digests, (count - i) * sizeof(*out));
+        i = count;
+    }
+
+    for (; i < count; i++) {
+        out[i] = SHA1_buf(bufs[i], len);
+    }
 }
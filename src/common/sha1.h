@@ -6,14 +6,50 @@
 
 enum {
     SHA1_HASH_SIZE = 20,
+    SHA1_BLOCK_SIZE = 64,
 };
 
 typedef struct {
     u8 bytes[SHA1_HASH_SIZE];
 }sha1_digest;
 
+// State for hashing data that arrives in pieces. Use SHA1_init(), then
+// SHA1_update() as many times as you need, then SHA1_final().
+typedef struct {
+    u32 state[SHA1_HASH_SIZE / 4];
+    u64 length; // Total bytes hashed so far
+    u8 block[SHA1_BLOCK_SIZE]; // Partial block waiting for more data
+    u32 block_len;
+}sha1_ctx;
+
+// Implementations of the SHA1 compression function. The fastest one the CPU
+// supports is picked automatically.
+typedef enum {
+    SHA1_BACKEND_SCALAR, // Portable C, works everywhere
+    SHA1_BACKEND_SHA_NI, // x86 SHA extensions
+    SHA1_BACKEND_ARMV8,  // ARMv8 cryptography extensions
+    SHA1_BACKEND_COUNT,
+}sha1_backend;
+
+void SHA1_init(sha1_ctx* ctx);
+void SHA1_update(sha1_ctx* ctx, const void* data, u64 len);
+sha1_digest SHA1_final(sha1_ctx* ctx);
+
 // Calculate SHA1 hash of a buffer
-sha1_digest SHA1_buf(u8* buf, u64 len);
+sha1_digest SHA1_buf(const u8* buf, u64 len);
+
+// Hash |count| buffers that are all |len| bytes long, like STFS blocks. The
+// buffers are hashed in parallel SIMD lanes where the CPU supports it.
+void SHA1_buf_many(const u8* const* bufs, u32 count, u64 len, sha1_digest* out);
+
+// The backend in use
+sha1_backend SHA1_get_backend();
+
+// Force a specific backend. Returns false (and changes nothing) if this CPU or
+// build doesn't support it. Don't call this while other threads are hashing.
+bool SHA1_set_backend(sha1_backend backend);
+
+const char* SHA1_backend_name(sha1_backend backend);
 
 // SHA1 comparison
 bool SHA1_equal(sha1_digest x, sha1_digest y);
@@ -0,0 +1,213 @@
+#include <stdlib.h>
+
+#include "platform.h"
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+#include "thread.h"
+
+// Thin wrappers so the pool logic below doesn't care about the platform
+#ifdef PLATFORM_WINDOWS
+typedef HANDLE thread_handle;
+typedef SRWLOCK thread_mutex;
+typedef CONDITION_VARIABLE thread_cond;
+
+static void mutex_init(thread_mutex* m) { InitializeSRWLock(m); }
+static void mutex_destroy(thread_mutex* m) { (void)m; }
+static void mutex_lock(thread_mutex* m) { AcquireSRWLockExclusive(m); }
+static void mutex_unlock(thread_mutex* m) { ReleaseSRWLockExclusive(m); }
+static void cond_init(thread_cond* c) { InitializeConditionVariable(c); }
+static void cond_destroy(thread_cond* c) { (void)c; }
+static void cond_wait(thread_cond* c, thread_mutex* m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+static void cond_broadcast(thread_cond* c) { WakeAllConditionVariable(c); }
+#else
+typedef pthread_t thread_handle;
+typedef pthread_mutex_t thread_mutex;
+typedef pthread_cond_t thread_cond;
+
+static void mutex_init(thread_mutex* m) { pthread_mutex_init(m, NULL); }
+static void mutex_destroy(thread_mutex* m) { pthread_mutex_destroy(m); }
+static void mutex_lock(thread_mutex* m) { pthread_mutex_lock(m); }
+static void mutex_unlock(thread_mutex* m) { pthread_mutex_unlock(m); }
+static void cond_init(thread_cond* c) { pthread_cond_init(c, NULL); }
+static void cond_destroy(thread_cond* c) { pthread_cond_destroy(c); }
+static void cond_wait(thread_cond* c, thread_mutex* m) { pthread_cond_wait(c, m); }
+static void cond_broadcast(thread_cond* c) { pthread_cond_broadcast(c); }
+#endif
+
+struct thread_pool {
+    thread_handle* threads;
+    u32 thread_count; // Worker threads, not counting the caller
+
+    thread_mutex lock;
+    thread_cond work_ready; // Signalled when a new batch starts or we quit
+    thread_cond work_done; // Signalled when the last worker finishes a batch
+
+    // Everything below is protected by |lock|
+    thread_job_fn fn;
+    void* ctx;
+    u32 job_count;
+    u32 next_job;
+    u32 busy; // Workers that haven't finished the current batch
+    u32 generation; // Incremented for every batch, so workers don't run one twice
+    bool quit;
+};
+
+u32 thread_cpu_count() {
+#ifdef PLATFORM_WINDOWS
+    SYSTEM_INFO info = {0};
+    GetSystemInfo(&info);
+    return MAX(info.dwNumberOfProcessors, 1);
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (u32)count : 1;
+#endif
+}
+
+// Grab jobs until there are none left in the current batch
+static void thread_pool_work(thread_pool* pool) {
+    while (true) {
+        mutex_lock(&pool->lock);
+        const u32 job = pool->next_job;
+        const bool have_job = job < pool->job_count;
+        if (have_job) {
+            pool->next_job++;
+        }
+        thread_job_fn fn = pool->fn;
+        void* ctx = pool->ctx;
+        mutex_unlock(&pool->lock);
+
+        if (!have_job) {
+            return;
+        }
+        fn(ctx, job);
+    }
+}
+
+#ifdef PLATFORM_WINDOWS
+static DWORD WINAPI thread_pool_worker(void* arg) {
+#else
+static void* thread_pool_worker(void* arg) {
+#endif
+    thread_pool* pool = arg;
+    u32 seen = 0;
+    mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->quit && pool->generation == seen) {
+            cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->quit) {
+            break;
+        }
+        seen = pool->generation;
+        mutex_unlock(&pool->lock);
+
+        thread_pool_work(pool);
+
+        mutex_lock(&pool->lock);
+        pool->busy--;
+        if (pool->busy == 0) {
+            cond_broadcast(&pool->work_done);
+        }
+    }
+    mutex_unlock(&pool->lock);
+    return 0;
+}
+
+thread_pool* thread_pool_create(u32 thread_count) {
+    if (thread_count == 0) {
+        thread_count = thread_cpu_count();
+    }
+    thread_pool* pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    // The thread calling thread_pool_run() works too, so we need 1 less
+    pool->threads = calloc(MAX(thread_count - 1, 1), sizeof(*pool->threads));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    mutex_init(&pool->lock);
+    cond_init(&pool->work_ready);
+    cond_init(&pool->work_done);
+
+    for (u32 i = 0; i < thread_count - 1; i++) {
+#ifdef PLATFORM_WINDOWS
+        pool->threads[i] = CreateThread(NULL, 0, thread_pool_worker, pool, 0, NULL);
+        const bool ok = pool->threads[i] != NULL;
+#else
+        const bool ok = pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool) == 0;
+#endif
+        if (!ok) {
+            LOG_MSG(warning, "Only started %d of %d threads\n", i, thread_count - 1);
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    return pool;
+}
+
+void thread_pool_run(thread_pool* pool, u32 job_count, thread_job_fn fn, void* ctx) {
+    if (pool == NULL || pool->thread_count == 0 || job_count <= 1) {
+        for (u32 i = 0; i < job_count; i++) {
+            fn(ctx, i);
+        }
+        return;
+    }
+
+    mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->job_count = job_count;
+    pool->next_job = 0;
+    pool->busy = pool->thread_count;
+    pool->generation++;
+    cond_broadcast(&pool->work_ready);
+    mutex_unlock(&pool->lock);
+
+    thread_pool_work(pool);
+
+    mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+        cond_wait(&pool->work_done, &pool->lock);
+    }
+    mutex_unlock(&pool->lock);
+}
+
+u32 thread_pool_size(const thread_pool* pool) {
+    if (pool == NULL) {
+        return 1;
+    }
+    return pool->thread_count + 1;
+}
+
+void thread_pool_destroy(thread_pool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+    mutex_lock(&pool->lock);
+    pool->quit = true;
+    cond_broadcast(&pool->work_ready);
+    mutex_unlock(&pool->lock);
+
+    for (u32 i = 0; i < pool->thread_count; i++) {
+#ifdef PLATFORM_WINDOWS
+        WaitForSingleObject(pool->threads[i], INFINITE);
+        CloseHandle(pool->threads[i]);
+#else
+        pthread_join(pool->threads[i], NULL);
+#endif
+    }
+    cond_destroy(&pool->work_ready);
+    cond_destroy(&pool->work_done);
+    mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
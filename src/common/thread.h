@@ -0,0 +1,32 @@
+#ifndef THREAD_H
+#define THREAD_H
+#include <stdbool.h>
+
+#include "int.h"
+
+// A fixed set of worker threads for splitting up CPU-heavy work like hashing.
+// The threads sleep between jobs, so keeping one around is cheap.
+typedef struct thread_pool thread_pool;
+
+// Called once for every job index. Jobs may run in any order, on any thread.
+typedef void (*thread_job_fn)(void* ctx, u32 job);
+
+// Number of logical CPUs, or 1 if we can't tell
+u32 thread_cpu_count();
+
+// Start a pool. A thread_count of 0 means one thread per CPU. Returns NULL on
+// failure.
+thread_pool* thread_pool_create(u32 thread_count);
+
+// Run fn(ctx, job) for every job in [0, job_count), and wait for them all to
+// finish. The calling thread helps out. A NULL pool runs every job on the
+// calling thread. Don't call this from inside a job on the same pool.
+void thread_pool_run(thread_pool* pool, u32 job_count, thread_job_fn fn, void* ctx);
+
+// Number of threads working on jobs, including the caller of thread_pool_run()
+u32 thread_pool_size(const thread_pool* pool);
+
+// Stop and free a pool. NULL is allowed.
+void thread_pool_destroy(thread_pool* pool);
+
+#endif // THREAD_H
@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <memory.h>
 
@@ -125,80 +126,95 @@ s8 move_y_rising_edge(editor_state editor) {
 
 
 
-// This doesn't enforce what the bound VAO is... make sure to only call it with
-// the cube VAO bound.
-void render_vehicle_bitmask(editor_state* editor, vehicle_bitmask* mask) {
-    vec3s center = vehicle_find_center(editor, SEARCH_ALL);
+static voxel_batch voxel_batch_create() {
+    voxel_batch batch = {0};
+    glGenVertexArrays(1, &batch.vao);
+    glGenBuffers(1, &batch.vbuf);
 
-    // Highest XYZ coords in the vehicle. We add 1 to include the highest
-    // index, then 4 to avoid cutting off large parts with up to 4 cells radius
-    vec3s max = glms_vec3_adds(glms_vec3_scale(center, PART_POS_SCALE), 5.0f);
+    glBindVertexArray(batch.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.vbuf);
+    glVertexAttribPointer(0, sizeof(vec3) / sizeof(float), GL_FLOAT, GL_FALSE, sizeof(vec3), NULL);
+    glEnableVertexAttribArray(0);
 
-    // Tranformation matrices
-    mat4 pv = {0};
-    camera_proj_view(editor->cam, pv);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return batch;
+}
 
-    // Disable backface culling, it doesn't make sense for a wireframe
-    GLboolean culling_was_enabled = false;
-    glGetBooleanv(GL_CULL_FACE, &culling_was_enabled);
-    glDisable(GL_CULL_FACE);
-    // Loop over the bitmask & render everything within the vehicle bounds
-    for (u16 i = 0; i < VEH_MAX_DIM && i < max.x; i++) {
-        for (u16 j = 0; j < VEH_MAX_DIM && j < max.y; j++) {
-            for (u16 k = 0; k < VEH_MAX_DIM && k < max.z; k++) {
-                // Skip the next bits if they're all 0
-                // Keeping this size small lets us "jump into action" faster when
-                // a big empty space is encountered, even though a 64-bit compare
-                // would be much more efficient.
-                // TODO: Optimize this later? Maybe some sketchy __builtin_clz() stuff?
-                u8 bits = 0;
-                const u8 bit_size = sizeof(bits) * 8;
-                const bool in_arr_bounds = (j < VEH_MAX_DIM - bit_size && i < VEH_MAX_DIM - bit_size);
-                // We only need to run every (bit_size) iterations
-                if (k % bit_size == 0 && in_arr_bounds) {
-                    // When (bits) is a u8, this can just be an assignment
-                    memcpy(&bits, &(*mask)[i][j][k / 8], sizeof(bits));
-                    if (bits == 0) {
-                        k += bit_size - 1;
-                        continue;
-                    }
-                }
+static void voxel_batch_destroy(voxel_batch* batch) {
+    glDeleteVertexArrays(1, &batch->vao);
+    glDeleteBuffers(1, &batch->vbuf);
+}
 
+// Rebuild the mask's wireframe and upload it
+static void voxel_batch_update(voxel_batch* batch, const vehicle_bitmask* mask) {
+    list vertices = list_create(sizeof(vec3s) * 256, sizeof(vec3s));
+    if (vertices.data == 0) {
+        return;
+    }
+    vehiclemask_build_wireframe(mask, &vertices);
+
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vbuf);
+    if (vertices.end_idx > batch->capacity) {
+        // Leave some room so dragging a selection around doesn't reallocate
+        // every time it gets a bit bigger
+        batch->capacity = vertices.end_idx * 2;
+        glBufferData(GL_ARRAY_BUFFER, batch->capacity * sizeof(vec3s), NULL, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.end_idx * sizeof(vec3s), (void*)vertices.data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-                const vec3s8 cell = {i, j, k};
-                const bool part_present = vehiclemask_get_3d(mask, cell);
-                if (!part_present) {
-                    continue;
-                }
-                vec3 pos = {i, j, k}; // lol can't reuse the vec3s8
-
-                // Move to the same position as the part rendering
-                pos[0] -= center.x;
-                pos[2] -= center.z;
-                glm_vec3_scale(pos, PART_POS_SCALE, pos);
-
-                mat4 pvm = {0};
-                mat4 model = {0};
-                glm_mat4_identity(model);
-
-                glm_translate(model, pos);
-                // Scale up by an imperceptible amount to avoid Z-fighting
-                glm_scale_uni(model, 1.0001f);
-                glm_mat4_mul(pv, model, pvm); // Compute pvm
-
-                // TODO: The iteration seems to cause a heavy CPU bottleneck,
-                // but it's probably still worth doing a single instanced
-                // draw call instead of this.
-                glUniformMatrix4fv(editor->u_pvm, 1, GL_FALSE, (const float*)&pvm);
-                glDrawElements(GL_TRIANGLES, cube.idx_count, GL_UNSIGNED_SHORT, NULL);
-            }
-        }
+    batch->vert_count = vertices.end_idx;
+    batch->generation = mask->generation;
+    free((void*)vertices.data);
+}
+
+void render_vehicle_bitmask(const vehicle_bitmask* mask, voxel_batch* batch) {
+    if (batch->generation != mask->generation) {
+        voxel_batch_update(batch, mask);
+    }
+    if (batch->vert_count == 0) {
+        return;
     }
+    glBindVertexArray(batch->vao);
+    glDrawArrays(GL_LINES, 0, batch->vert_count);
+}
+
+void editor_upload_camera(editor_state* editor) {
+    // Finding the center means going through every part, so only do it when
+    // something changed
+    if (editor->center_generation != editor->parts_generation) {
+        editor->vehicle_center = vehicle_find_center(editor, SEARCH_ALL);
+        editor->center_generation = editor->parts_generation;
+    }
+
+    mat4 pv = {0};
+    camera_proj_view(editor->cam, pv);
+    // Parts are drawn around the center on the X/Z plane, but stay on the floor
+    const vec3s center = editor->vehicle_center;
+    glm_translate(pv, (vec3){-center.x * PART_POS_SCALE, 0.0f, -center.z * PART_POS_SCALE});
 
-    // Re-enable backface culling if needed
-    if (culling_was_enabled == GL_TRUE) {
-        glEnable(GL_CULL_FACE);
+    // In every mode but orbit, the target & camera are swapped
+    vec3s eye = (editor->cam.mode == CAMERA_ORBIT) ? editor->cam.pos : editor->cam.target;
+    eye.x += center.x * PART_POS_SCALE;
+    eye.z += center.z * PART_POS_SCALE;
+
+    // Most frames the camera sits still, and there's nothing to do
+    if (memcmp(pv, editor->camera_pv, sizeof(pv)) == 0 && memcmp(&eye, &editor->camera_eye, sizeof(eye)) == 0) {
+        return;
     }
+    glm_mat4_copy(pv, editor->camera_pv);
+    editor->camera_eye = eye;
+    editor->camera_generation++;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, editor->camera_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(pv), pv);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Connect a shader's "camera" block to the camera uniform buffer
+static void shader_bind_camera(gl_obj shader) {
+    glUniformBlockBinding(shader, glGetUniformBlockIndex(shader, "camera"), CAMERA_BLOCK_BINDING);
 }
 
 void update_edit_mode(editor_state* editor) {
@@ -235,12 +251,7 @@ void update_edit_mode(editor_state* editor) {
 
     if (rotation) {
         if (forward_diff != 0 || side_diff != 0 || roll_diff != 0) {
-            bool needed_adjust = vehicle_rotate_selection(editor, forward_diff, side_diff, roll_diff);
-            // Update vacancy if the rest of the vehicle moved
-            if (needed_adjust) {
-                update_vacancymask(editor);
-            }
-            update_selectionmask(editor);
+            vehicle_rotate_selection(editor, forward_diff, side_diff, roll_diff);
 
             // Check for overlaps and block the placement if needed
             if (vehicle_selection_overlap(editor)) {
@@ -271,37 +282,20 @@ void update_edit_mode(editor_state* editor) {
             .z = editor->sel_box.z - sel_box_prev.z,
         };
 
-        // Move all selected parts
-        bool needed_adjust = false;
-        part_iterator iter = part_iterator_setup(*editor, SEARCH_SELECTED);
-        while (!iter.done) {
-            part_entry* p = part_iterator_next(&iter);
-            vec3s16 adjustment = {0};
-            needed_adjust |= vehicle_move_part(editor, *p, diff, &adjustment);
-            // Move the selection box to the part's new location, if it moved out
-            // of bounds and forced the vehicle to be adjusted.
-            editor->sel_box.x -= adjustment.x;
-            editor->sel_box.y -= adjustment.y;
-            editor->sel_box.z -= adjustment.z;
-
-            // Check for overlaps and block the placement if needed
-            if (vehicle_selection_overlap(editor)) {
-                editor->sel_mode = SEL_BAD;
-            }
-            else {
-                editor->sel_mode = SEL_ACTIVE;
-            }
+        // Move all selected parts. If they moved out of bounds and forced the
+        // vehicle to be adjusted, move the selection box with them.
+        vec3s16 adjustment = {0};
+        vehicle_move_selection(editor, diff, &adjustment);
+        editor->sel_box.x -= adjustment.x;
+        editor->sel_box.y -= adjustment.y;
+        editor->sel_box.z -= adjustment.z;
+
+        // Check for overlaps and block the placement if needed
+        if (vehicle_selection_overlap(editor)) {
+            editor->sel_mode = SEL_BAD;
         }
-
-        // When moving selection, we only need to update the selection mask
-        // TODO: Make a separate function for moving selection that uses
-        // bitshifts/memcpy() to shift the grid. Need to do testing to see if
-        // that's actually any faster.
-        update_selectionmask(editor);
-
-        // If rest of the vehicle was moved, we need to update the other grid
-        if (needed_adjust) {
-            update_vacancymask(editor);
+        else {
+            editor->sel_mode = SEL_ACTIVE;
         }
     }
 
@@ -315,18 +309,10 @@ void update_edit_mode(editor_state* editor) {
     if (editor->sel_mode != SEL_BAD && !rotation) {
         if (editor->sel_mode == SEL_NONE) {
             if (unselect_button_pressed) {
-                list_add(&editor->unselected_parts, (void*)p);
-                list_remove_val(&editor->selected_parts, (void*)p);
-                update_selectionmask(editor);
-                update_vacancymask(editor);
+                vehicle_unselect_part(editor, p);
             }
             else if (delete_button_pressed) {
-                // Try to delete it from both lists
-                list_remove_val(&editor->selected_parts, (void*)p);
-                list_remove_val(&editor->unselected_parts, (void*)p);
-                update_selectionmask(editor);
-                update_vacancymask(editor);
-                editor->v.part_count--;
+                vehicle_delete_part(editor, p);
             }
         }
         if (select_button_pressed) {
@@ -334,10 +320,7 @@ void update_edit_mode(editor_state* editor) {
             if (editor->sel_mode == SEL_ACTIVE) {
                 // User pressed the button while moving parts, which means
                 // we should put them down.
-                list_merge(&editor->unselected_parts, editor->selected_parts);
-                list_clear(&editor->selected_parts);
-                update_selectionmask(editor); // This will boil down to just clearing the grid
-                update_vacancymask(editor); // Need to add those parts to vacancy grid
+                vehicle_place_selection(editor);
                 editor->sel_mode = SEL_NONE; // Now you can start moving the parts
             } else if (p->id != 0) {
                 if (cell_is_selected(editor, p->pos)) {
@@ -355,10 +338,7 @@ void update_edit_mode(editor_state* editor) {
                     };
                 } else {
                     // Select the part
-                    list_add(&editor->selected_parts, (void*)p);
-                    list_remove_val(&editor->unselected_parts, (void*)p);
-                    update_selectionmask(editor);
-                    update_vacancymask(editor);
+                    vehicle_select_part(editor, p);
                     editor->sel_mode = SEL_NONE;
                 }
             }
@@ -431,6 +411,9 @@ bool editor_update_with_input(editor_state* editor, GLFWwindow* window) {
         editor->vsync = !editor->vsync;
         set_vsync(editor->vsync);
     }
+    if (input.l && !editor->prev_input.l) {
+        editor->part_lod = !editor->part_lod;
+    }
     if (input.control && input.s && !editor->prev_input.s) {
         editor_save_to_file(*editor, "vehicle.bin");
     }
@@ -480,17 +463,16 @@ bool editor_update_with_input(editor_state* editor, GLFWwindow* window) {
 editor_state editor_init(const char* vehicle_path, GLFWwindow* window) {
     const double time_start = glfwGetTime();
     editor_state editor = {
-        .vacancy_mask = calloc(1, sizeof(vehicle_bitmask)),
-        .selected_mask = calloc(1, sizeof(vehicle_bitmask)),
+        .vacancy_mask = vehiclemask_create(),
+        .selected_mask = vehiclemask_create(),
+        .vacancy_grid = part_grid_create(),
+        .selected_grid = part_grid_create(),
+        .parts_generation = 1,
+        .camera_generation = 1,
         .cam = camera_default(),
         .window = window,
         .init_result = false, // Default to failure, this will only be set to success if all checks pass
     };
-    if (editor.vacancy_mask == NULL || editor.selected_mask == NULL) {
-        LOG_MSG(error, "Failed to alloc a vehicle bitmask\n");
-        return editor;
-    }
-
     vehicle* v = vehicle_load(vehicle_path);
     if (v == NULL) {
         LOG_MSG(error, "Failed to load vehicle from \"%s\"", vehicle_path);
@@ -514,8 +496,7 @@ editor_state editor_init(const char* vehicle_path, GLFWwindow* window) {
     free(v);
 
     // Initialize part grids
-    update_vacancymask(&editor);
-    update_selectionmask(&editor);
+    update_part_grids(&editor);
 
     u8* vert = physfs_load_file("/src/editor/shader/vcolor.vert");
     u8* frag = physfs_load_file("/src/editor/shader/vcolor.frag");
@@ -535,8 +516,51 @@ editor_state editor_init(const char* vehicle_path, GLFWwindow* window) {
     editor.u_pvm = glGetUniformLocation(editor.vcolor_shader, "pvm");
     editor.u_paint = glGetUniformLocation(editor.vcolor_shader, "paint");
 
+    vert = physfs_load_file("/src/editor/shader/part.vert");
+    frag = physfs_load_file("/src/editor/shader/vcolor.frag");
+    if (vert == NULL || frag == NULL) {
+        LOG_MSG(error, "Failed to load one or both of the part shader files\n");
+        return editor;
+    }
+    editor.part_shader = program_compile_src((char*)vert, (char*)frag);
+    free(vert);
+    free(frag);
+    if (!shader_link_check(editor.part_shader)) {
+        LOG_MSG(error, "Shader linker error\n");
+        return editor;
+    }
+    shader_bind_camera(editor.part_shader);
+
+    vert = physfs_load_file("/src/editor/shader/voxel.vert");
+    frag = physfs_load_file("/src/editor/shader/vcolor.frag");
+    if (vert == NULL || frag == NULL) {
+        LOG_MSG(error, "Failed to load one or both of the voxel shader files\n");
+        return editor;
+    }
+    editor.voxel_shader = program_compile_src((char*)vert, (char*)frag);
+    free(vert);
+    free(frag);
+    if (!shader_link_check(editor.voxel_shader)) {
+        LOG_MSG(error, "Shader linker error\n");
+        return editor;
+    }
+    shader_bind_camera(editor.voxel_shader);
+    editor.u_voxel_paint = glGetUniformLocation(editor.voxel_shader, "paint");
+    // Cell spacing never changes, so it only has to be set once
+    glUseProgram(editor.voxel_shader);
+    glUniform1f(glGetUniformLocation(editor.voxel_shader, "cell_scale"), PART_POS_SCALE);
+    glUseProgram(0);
+
+    glGenBuffers(1, &editor.camera_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, editor.camera_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(mat4), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, editor.camera_ubo);
+
     model_upload(&quad);
     model_upload(&cube);
+    editor.vacancy_voxels = voxel_batch_create();
+    editor.selected_voxels = voxel_batch_create();
 
     editor.init_result = true;
     const double time_end = glfwGetTime();
@@ -549,6 +573,11 @@ editor_state editor_init(const char* vehicle_path, GLFWwindow* window) {
 
 void editor_teardown(editor_state* editor) {
     glDeleteProgram(editor->vcolor_shader);
+    glDeleteProgram(editor->part_shader);
+    glDeleteProgram(editor->voxel_shader);
+    glDeleteBuffers(1, &editor->camera_ubo);
+    voxel_batch_destroy(&editor->vacancy_voxels);
+    voxel_batch_destroy(&editor->selected_voxels);
     glDeleteVertexArrays(1, &quad.vao);
     glDeleteBuffers(1, &quad.vbuf);
     glDeleteBuffers(1, &quad.ibuf);
@@ -558,7 +587,9 @@ void editor_teardown(editor_state* editor) {
     glDeleteBuffers(1, &cube.ibuf);
     free((void*)editor->selected_parts.data);
     free((void*)editor->unselected_parts.data);
-    free(editor->vacancy_mask);
-    free(editor->selected_mask);
+    vehiclemask_destroy(&editor->vacancy_mask);
+    vehiclemask_destroy(&editor->selected_mask);
+    part_grid_destroy(&editor->vacancy_grid);
+    part_grid_destroy(&editor->selected_grid);
 }
 
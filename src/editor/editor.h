@@ -7,6 +7,7 @@
 #include <common/input.h>
 #include <common/model.h>
 #include <common/list.h>
+#include <common/brick_map.h>
 
 #include <vehicle.h>
 #include "camera.h"
@@ -27,17 +28,61 @@ typedef enum {
 
 enum {
     PART_POS_SCALE = 2, // Coordinate multiplier for rendering (can add spacing in the part grid)
-    VEH_MASK_BYTE_WIDTH = (VEH_MAX_DIM / 8),
 
     // Render this many part search results at a time
     PARTSEARCH_MENUSIZE = 10,
+
+    // Uniform buffer binding for the "camera" block in shaders that have one
+    CAMERA_BLOCK_BINDING = 0,
 };
 
 // Used to store a compact 3D grid of parts at 1 bit per cell.
 // The editor uses 2 of these, one for storing which cells are occupied and one
 // for storing which cells are selected.
-typedef u8 vehicle_bitmask[VEH_MAX_DIM][VEH_MAX_DIM][VEH_MASK_BYTE_WIDTH];
-static_assert(sizeof(vehicle_bitmask) == 0x40000, "vehicle_bitmask size is wrong!");
+// Only the 8x8x8 bricks with something in them are stored. Each brick is 8
+// 64-bit words, one per X slice, with Z changing fastest inside each word.
+typedef struct {
+    brick_map bricks;
+    // Box around every cell that might be set. Setting a cell grows it, but
+    // clearing one doesn't shrink it. If min > max, the mask is empty.
+    vec3s8 min;
+    vec3s8 max;
+    // Goes up every time a cell changes, so anything built from the mask
+    // knows when it's out of date. Never 0.
+    u32 generation;
+}vehicle_bitmask;
+
+typedef struct {
+    u64 slices[BRICK_DIM];
+}vehicle_bitmask_brick;
+static_assert(sizeof(vehicle_bitmask_brick) * 8 == BRICK_CELLS, "vehicle_bitmask_brick size is wrong!");
+
+// Index into one of the editor's part lists, plus 1. 0 means no part.
+typedef u16 part_handle;
+
+// Used to find the part occupying a cell without searching the part lists.
+// Like the bitmasks, there's one for selected parts and one for the rest, and
+// each stores handles into its own list. Bricks are part_grid_bricks.
+typedef brick_map part_grid;
+
+// Parts in one list can overlap (loaded vehicles can have them), so each cell
+// also counts how many parts cover it. A cell with parts in it but a handle of
+// 0 lost the part it pointed to, and part_by_pos() looks for another one.
+typedef struct {
+    part_handle cells[BRICK_CELLS];
+    u16 counts[BRICK_CELLS]; // Number of parts covering each cell
+    u16 used; // Number of cells with any parts, so empty bricks can be freed
+}part_grid_brick;
+
+// GPU copy of a bitmask's wireframe (see vehiclemask_build_wireframe()), so it
+// only has to be rebuilt when the mask changes.
+typedef struct {
+    gl_obj vao;
+    gl_obj vbuf; // Pairs of vec3 making up each line
+    u32 vert_count; // Number of vertices in the buffer
+    u32 capacity; // Number of vertices the buffer has room for
+    u32 generation; // Mask generation the buffer was built from, 0 if never
+}voxel_batch;
 
 // Current state of the vehicle editor & GUI in general
 typedef struct {
@@ -47,9 +92,18 @@ typedef struct {
     list unselected_parts;
     camera cam;
     // Bitmask for whether a space is occupied by a part, at 1 bit per cell.
-    vehicle_bitmask* vacancy_mask;
+    vehicle_bitmask vacancy_mask;
     // Bitmask for whether a cell is selected
-    vehicle_bitmask* selected_mask;
+    vehicle_bitmask selected_mask;
+    // Which part is in each cell, for the unselected & selected lists
+    part_grid vacancy_grid;
+    part_grid selected_grid;
+    // What's currently on the GPU for each bitmask
+    voxel_batch vacancy_voxels;
+    voxel_batch selected_voxels;
+    // Goes up every time a part is added, removed, moved, rotated, selected or
+    // unselected, so the renderer knows when to rebuild. Never 0.
+    u32 parts_generation;
 
     // Editor state data
     vec3s16 sel_box; // Selection box position
@@ -74,6 +128,7 @@ typedef struct {
     double delta_time; // Measured in seconds
     input_internal prev_input; // Input from last frame
     bool vsync;
+    bool part_lod; // Draw far away parts as boxes, toggled with L
     bool init_result; // Only used during init to communicate failure
     // TODO: Can't we just pass the window pointer to the UI init function?
     GLFWwindow* window; // Used to register keyboard callbacks
@@ -83,6 +138,23 @@ typedef struct {
     // Uniforms for the shader
     gl_obj u_pvm; // PVM matrix uniform
     gl_obj u_paint; // Vertex color multiplier
+    // Uniform buffer for the "camera" block, which holds the PV matrix with the
+    // vehicle's center moved to the origin. Uploaded once per frame by
+    // editor_upload_camera().
+    gl_obj camera_ubo;
+    mat4 camera_pv; // What's in the camera block this frame
+    vec3s camera_eye; // Viewer position, in the same space
+    // Goes up every time camera_pv or camera_eye change, so anything that
+    // depends on the view knows when to redo it. Never 0.
+    u32 camera_generation;
+    vec3s vehicle_center; // Center of every part, in cells
+    u32 center_generation; // parts_generation the center was found at
+    // Same as the vertex color shader, but the model matrix and paint color
+    // come from per-instance attributes so a model is drawn once for all parts
+    gl_obj part_shader;
+    // Shader for bitmask wireframes, which are in cell coordinates
+    gl_obj voxel_shader;
+    gl_obj u_voxel_paint; // Line color
 }editor_state;
 
 // TODO: Move input code out of common/ and move these functions into there
@@ -135,7 +207,13 @@ s8 move_x_rising_edge(editor_state editor);
 s8 move_y_rising_edge(editor_state editor);
 
 
-void render_vehicle_bitmask(editor_state* editor, vehicle_bitmask* mask);
+// Draw the outline of a bitmask's cells with the voxel shader. The batch keeps
+// the wireframe on the GPU, and it's only rebuilt when the mask changes.
+void render_vehicle_bitmask(const vehicle_bitmask* mask, voxel_batch* batch);
+
+// Update the camera uniform buffer for this frame. Call this once before
+// drawing anything that uses it.
+void editor_upload_camera(editor_state* editor);
 
 // Update our state according to new user input.
 bool editor_update_with_input(editor_state* editor, GLFWwindow* window);
@@ -4,16 +4,14 @@
 #include "render_debug.h"
 
 void debug_render(editor_state* editor) {
-    // Bind our shader & buffers
-    glUseProgram(editor->vcolor_shader);
-    glBindVertexArray(cube.vao);
-    // Draw in wireframe mode
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    // Bind our shader. Each bitmask has its own VAO, which is already made
+    // of lines.
+    glUseProgram(editor->voxel_shader);
 
     vec4s color = {.b = 1.0f, .a = 1.0f};
-    glUniform4fv(editor->u_paint, 1, (const float*)&color);
+    glUniform4fv(editor->u_voxel_paint, 1, (const float*)&color);
 
-    render_vehicle_bitmask(editor, editor->vacancy_mask);
+    render_vehicle_bitmask(&editor->vacancy_mask, &editor->vacancy_voxels);
 
     // Draw green/red boxes around all selected parts as appropriate
     // Set selection box color
@@ -23,12 +21,11 @@ void debug_render(editor_state* editor) {
         color.g = 1.0f;
     }
     color.b = 0.0f;
-    glUniform4fv(editor->u_paint, 1, (const float*)&color);
-    render_vehicle_bitmask(editor, editor->selected_mask);
+    glUniform4fv(editor->u_voxel_paint, 1, (const float*)&color);
+    render_vehicle_bitmask(&editor->selected_mask, &editor->selected_voxels);
 
 
     // Reset state
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
@@ -1,4 +1,6 @@
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <glad/glad.h>
 #include <cglm/cglm.h>
@@ -6,6 +8,7 @@
 #include <common/logging.h>
 #include <common/primitives.h>
 #include <common/file.h>
+#include <common/frustum.h>
 #include <physfs_bundling.h>
 
 #include "camera.h"
@@ -13,39 +16,60 @@
 #include "editor.h"
 #include "render_garage.h"
 
-model get_or_load_model(garage_state* state, part_id id) {
+// Find the slot holding a part's model, loading it if needed
+static u32 model_slot(garage_state* state, part_id id) {
     for (u8 i = 0; i < ARRAY_SIZE(state->models); i++) {
         part_model* cur = &state->models[i];
         if (cur->id == id) {
-            return cur->model;
+            return i;
         }
         // We hit an empty space without finding our model. We'll try to load it
         else if (cur->model.vertices == NULL || cur->model.indices == NULL) {
             cur->id = id;
-            // Path is on the stack, so we don't need to free it
-            const char* obj_path = part_get_obj_path(id).str;
-            u8* obj_data = physfs_load_file(obj_path);
-            if (obj_data != NULL) {
-                cur->model = obj_load(obj_data);
+            // Paths are on the stack, so we don't need to free them
+            const obj_path mesh_file = part_get_mesh_path(id);
+            const obj_path obj_file = part_get_obj_path(id);
+            const char* loaded_path = mesh_file.str;
+
+            // Try the mesh baked at build time first, it's just a copy
+            if (physfs_exists(mesh_file.str)) {
+                u64 size = 0;
+                u8* mesh_data = physfs_load_file_sized(mesh_file.str, &size);
+                if (mesh_data != NULL) {
+                    cur->model = mesh_load(mesh_data, size);
+                }
+                free(mesh_data);
+            }
+            // Fall back to the OBJ, for models added without rebuilding
+            if (cur->model.vertices == NULL || cur->model.indices == NULL) {
+                loaded_path = obj_file.str;
+                u8* obj_data = physfs_load_file(obj_file.str);
+                if (obj_data != NULL) {
+                    cur->model = obj_load(obj_data);
+                }
+                free(obj_data);
             }
-            free(obj_data);
 
             if (cur->model.vertices == NULL || cur->model.indices == NULL) {
-                LOG_MSG(error, "Failed to load \"%s\" (0x%X)\n\n", part_get_info(id).name, id);
+                LOG_MSG(error, "Failed to load \"%s\" (0x%X)\n\n", part_get_info(id)->name, id);
 
                 // It's not here and we couldn't load it. Fall back to the cube
                 cur->model = cube;
-                return cube;
+                return i;
             }
             model_upload(&cur->model);
 
-            LOG_MSG(info, "Loaded \"%s\" from \"%s\" in %.2fKiB\n\n", part_get_info(id).name, obj_path, (float)model_size(cur->model) / 1024.0f);
-            return cur->model;
+            LOG_MSG(info, "Loaded \"%s\" from \"%s\" in %.2fKiB\n\n", part_get_info(id)->name, loaded_path, (float)model_size(cur->model) / 1024.0f);
+            return i;
         }
     }
 
-    // Couldn't find it & we're out of space to add it... return placeholder cube
-    return state->models[0].model;
+    // Couldn't find it & we're out of space to add it... use the placeholder cube
+    return 0;
+}
+
+model get_or_load_model(garage_state* state, part_id id) {
+    return state->models[model_slot(state, id)].model;
 }
 
 garage_state garage_init(editor_state* editor) {
@@ -54,6 +78,8 @@ garage_state garage_init(editor_state* editor) {
 
     // ID 0 will just render a cube
     state.models[0] = (part_model){.id = 0, .model = cube};
+    state.proxy = (part_model){.id = 0, .model = cube};
+    glGenBuffers(1, &state.instance_buf);
 
     part_iterator iter = part_iterator_setup(*editor, SEARCH_ALL);
     while (!iter.done) {
@@ -70,6 +96,292 @@ garage_state garage_init(editor_state* editor) {
     return state;
 }
 
+// Point a model's instance attributes at its range of the instance buffer,
+// creating the VAO the first time
+static void part_model_bind_instances(const garage_state* state, part_model* pm) {
+    if (pm->instance_vao == 0) {
+        glGenVertexArrays(1, &pm->instance_vao);
+        glBindVertexArray(pm->instance_vao);
+
+        // Same layout as model_upload()
+        glBindBuffer(GL_ARRAY_BUFFER, pm->model.vbuf);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pm->model.ibuf);
+        model_vertex_layout();
+    }
+    glBindVertexArray(pm->instance_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, state->instance_buf);
+
+    // The matrix is passed as 4 vec4 attributes, one per column
+    const uintptr_t base = (uintptr_t)pm->instance_start * sizeof(part_instance);
+    for (u8 i = 0; i < 4; i++) {
+        glVertexAttribPointer(2 + i, sizeof(vec4) / sizeof(float), GL_FLOAT, GL_FALSE, sizeof(part_instance), (void*)(base + offsetof(part_instance, model) + (i * sizeof(vec4))));
+        glEnableVertexAttribArray(2 + i);
+        glVertexAttribDivisor(2 + i, 1);
+    }
+    glVertexAttribPointer(6, sizeof(vec4) / sizeof(float), GL_FLOAT, GL_FALSE, sizeof(part_instance), (void*)(base + offsetof(part_instance, paint)));
+    glEnableVertexAttribArray(6);
+    glVertexAttribDivisor(6, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Instances are relative to the vehicle's corner. The camera block moves the
+// center to the origin, so moving some parts doesn't change any others.
+static part_instance part_instance_create(const part_entry* p, bool selected, bool custom_model) {
+    const vec3s pos = vec3_from_vec3s8(p->pos, PART_POS_SCALE);
+
+    // Apply translation & rotation from part data
+    mat4 model = {0};
+    glm_mat4_identity(model);
+    glm_translate(model, (float*)&pos);
+    glm_rotate_x(model, p->rot[0], model);
+    glm_rotate_y(model, p->rot[1], model);
+    glm_rotate_z(model, p->rot[2], model);
+
+    part_instance instance = {0};
+    // Instances are in a malloc()'d array, which might not be aligned enough
+    // for a mat4
+    memcpy(instance.model, model, sizeof(instance.model));
+
+    vec4s paint_col = vec4_from_rgba8(p->color);
+    if (selected) {
+        paint_col.a /= 3;
+    }
+    // Don't paint parts with custom models
+    if (custom_model) {
+        paint_col = (vec4s){.r = 1.0f, .g = 1.0f, .b = 1.0f, paint_col.a};
+    }
+    memcpy(instance.paint, &paint_col, sizeof(instance.paint));
+    return instance;
+}
+
+// Box around a part's cells, in the same space as its instance. The proxy
+// cube is drawn to fill it, and the bounding sphere goes around it.
+static void part_bounds(const part_entry* p, vec3s* center, vec3s* half) {
+    const part_cells cells = part_get_cells(p->id, part_orientation_from_euler(p->rot));
+    // The origin is always one of the cells
+    s8 min[3] = {0};
+    s8 max[3] = {0};
+    for (u32 c = 0; c < cells.count; c++) {
+        for (u8 axis = 0; axis < 3; axis++) {
+            min[axis] = MIN(min[axis], cells.cells[c].raw[axis]);
+            max[axis] = MAX(max[axis], cells.cells[c].raw[axis]);
+        }
+    }
+    for (u8 axis = 0; axis < 3; axis++) {
+        center->raw[axis] = (p->pos.raw[axis] + ((min[axis] + max[axis]) / 2.0f)) * PART_POS_SCALE;
+        // Each cell's cube reaches CUBE_SIZE past its center
+        half->raw[axis] = ((max[axis] - min[axis]) / 2.0f) * PART_POS_SCALE + CUBE_SIZE;
+    }
+}
+
+static part_instance part_proxy_create(vec3s center, vec3s half, bool selected, rgba8 color) {
+    mat4 model = {0};
+    glm_mat4_identity(model);
+    glm_translate(model, (float*)&center);
+    glm_scale(model, (vec3){half.x / CUBE_SIZE, half.y / CUBE_SIZE, half.z / CUBE_SIZE});
+
+    part_instance instance = {0};
+    memcpy(instance.model, model, sizeof(instance.model));
+    // Always use the paint color, the cube has no colors of its own
+    vec4s paint_col = vec4_from_rgba8(color);
+    if (selected) {
+        paint_col.a /= 3;
+    }
+    memcpy(instance.paint, &paint_col, sizeof(instance.paint));
+    return instance;
+}
+
+// Make sure there's room for [count] parts on the CPU and GPU. Returns false
+// if an allocation failed.
+static bool garage_reserve(garage_state* state, u32 count) {
+    if (count <= state->capacity) {
+        return true;
+    }
+    // Leave room to add parts without reallocating every time
+    const u32 capacity = count * 2;
+    void** arrays[] = {
+        (void**)&state->parts, (void**)&state->proxies, (void**)&state->instances, (void**)&state->scratch,
+        (void**)&state->bounds, (void**)&state->visibility, (void**)&state->in_frustum,
+    };
+    const size_t sizes[] = {
+        sizeof(part_instance), sizeof(part_instance), sizeof(part_instance), sizeof(part_instance),
+        sizeof(float) * 4, sizeof(u8), sizeof(u8),
+    };
+    for (u8 i = 0; i < ARRAY_SIZE(arrays); i++) {
+        void* array = realloc(*arrays[i], capacity * sizes[i]);
+        if (array == NULL) {
+            // We try again every frame, but there's no need to say so every time
+            if (state->failed_capacity != count) {
+                LOG_MSG(error, "Failed to allocate render data for %d parts\n", count);
+                state->failed_capacity = count;
+            }
+            return false;
+        }
+        *arrays[i] = array;
+    }
+    state->capacity = capacity;
+    state->failed_capacity = 0;
+
+    // The old buffer is gone, so everything has to be uploaded again
+    state->instance_count = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, state->instance_buf);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(part_instance), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+// Rebuild every part's instance, proxy and bounding sphere from the editor's
+// parts. Parts are sorted by model so each model's parts are next to each
+// other, and each list keeps its order so an edit only changes a few of them.
+static void garage_build_parts(garage_state* state, editor_state* editor) {
+    const list* lists[2] = {&editor->unselected_parts, &editor->selected_parts};
+    const u32 count = lists[0]->end_idx + lists[1]->end_idx;
+    if (!garage_reserve(state, count)) {
+        return;
+    }
+    u16* slots = malloc(count * sizeof(*slots));
+    if (count > 0 && slots == NULL) {
+        LOG_MSG(error, "Failed to allocate model slots for %d parts\n", count);
+        return;
+    }
+
+    // Count how many parts use each model, then give each model its range
+    for (u32 i = 0; i < ARRAY_SIZE(state->models); i++) {
+        state->models[i].part_count = 0;
+    }
+    u32 part_idx = 0;
+    for (u8 l = 0; l < ARRAY_SIZE(lists); l++) {
+        for (u32 i = 0; i < lists[l]->end_idx; i++) {
+            const part_entry* p = list_get_element(*lists[l], i);
+            slots[part_idx] = model_slot(state, p->id);
+            state->models[slots[part_idx]].part_count++;
+            part_idx++;
+        }
+    }
+    u32 next[ARRAY_SIZE(state->models)];
+    u32 start = 0;
+    for (u32 i = 0; i < ARRAY_SIZE(state->models); i++) {
+        state->models[i].part_start = start;
+        next[i] = start;
+        start += state->models[i].part_count;
+    }
+
+    float* sphere[4] = {state->bounds, state->bounds + state->capacity, state->bounds + (state->capacity * 2), state->bounds + (state->capacity * 3)};
+    part_idx = 0;
+    for (u8 l = 0; l < ARRAY_SIZE(lists); l++) {
+        const bool selected = (lists[l] == &editor->selected_parts);
+        for (u32 i = 0; i < lists[l]->end_idx; i++) {
+            const part_entry* p = list_get_element(*lists[l], i);
+            const part_model* pm = &state->models[slots[part_idx++]];
+            const u32 idx = next[pm - state->models]++;
+            state->parts[idx] = part_instance_create(p, selected, pm->model.vao != cube.vao);
+
+            vec3s center = {0};
+            vec3s half = {0};
+            part_bounds(p, &center, &half);
+            state->proxies[idx] = part_proxy_create(center, half, selected, p->color);
+            sphere[0][idx] = center.x;
+            sphere[1][idx] = center.y;
+            sphere[2][idx] = center.z;
+            sphere[3][idx] = glms_vec3_norm(half);
+        }
+    }
+    free(slots);
+
+    state->part_count = count;
+    state->generation = editor->parts_generation;
+}
+
+// Decide how each part should be drawn from here. Returns true if anything
+// changed since last time.
+static bool garage_cull(garage_state* state, const editor_state* editor) {
+    const frustum f = frustum_from_matrix((const float*)editor->camera_pv);
+    const float* sphere[4] = {state->bounds, state->bounds + state->capacity, state->bounds + (state->capacity * 2), state->bounds + (state->capacity * 3)};
+    frustum_cull_spheres(&f, sphere[0], sphere[1], sphere[2], sphere[3], state->part_count, state->in_frustum);
+
+    const vec3s eye = editor->camera_eye;
+    bool changed = false;
+    for (u32 i = 0; i < state->part_count; i++) {
+        u8 visibility = state->in_frustum[i] ? PART_FULL : PART_HIDDEN;
+        if (visibility == PART_FULL && state->lod_distance > 0) {
+            // Compare against the closest point on the sphere
+            const vec3s diff = {sphere[0][i] - eye.x, sphere[1][i] - eye.y, sphere[2][i] - eye.z};
+            const float reach = state->lod_distance + sphere[3][i];
+            if (glms_vec3_norm2(diff) > reach * reach) {
+                visibility = PART_PROXY;
+            }
+        }
+        changed |= (state->visibility[i] != visibility);
+        state->visibility[i] = visibility;
+    }
+    return changed;
+}
+
+// Give a model its range of the draw list, and point its VAO there if the
+// range moved. Models that aren't drawn keep the start their VAO points at.
+static void part_model_set_range(const garage_state* state, part_model* pm, u32 start, u32 count) {
+    pm->instance_count = count;
+    if (count > 0 && (pm->instance_vao == 0 || pm->instance_start != start)) {
+        pm->instance_start = start;
+        part_model_bind_instances(state, pm);
+    }
+}
+
+// Put every visible part in the instance buffer, grouped by model, then the
+// proxies. Only the range that changed since the last time is uploaded.
+static void garage_build_draw_list(garage_state* state) {
+    u32 count = 0;
+    for (u32 i = 0; i < ARRAY_SIZE(state->models); i++) {
+        part_model* pm = &state->models[i];
+        const u32 start = count;
+        for (u32 j = pm->part_start; j < pm->part_start + pm->part_count; j++) {
+            if (state->visibility[j] == PART_FULL) {
+                state->scratch[count++] = state->parts[j];
+            }
+        }
+        part_model_set_range(state, pm, start, count - start);
+    }
+    const u32 proxy_start = count;
+    for (u32 i = 0; i < state->part_count; i++) {
+        if (state->visibility[i] == PART_PROXY) {
+            state->scratch[count++] = state->proxies[i];
+        }
+    }
+    part_model_set_range(state, &state->proxy, proxy_start, count - proxy_start);
+
+    // Only upload from the first instance that changed to the last one
+    const u32 old_count = state->instance_count;
+    u32 first = 0;
+    while (first < count && first < old_count && memcmp(&state->scratch[first], &state->instances[first], sizeof(part_instance)) == 0) {
+        first++;
+    }
+    u32 end = count;
+    while (end > first && end <= old_count && memcmp(&state->scratch[end - 1], &state->instances[end - 1], sizeof(part_instance)) == 0) {
+        end--;
+    }
+    if (end > first) {
+        glBindBuffer(GL_ARRAY_BUFFER, state->instance_buf);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(part_instance), (end - first) * sizeof(part_instance), &state->scratch[first]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // The new instances are what's on the GPU now
+    part_instance* swap = state->instances;
+    state->instances = state->scratch;
+    state->scratch = swap;
+    state->instance_count = count;
+}
+
+static void part_model_draw(const part_model* pm) {
+    if (pm->instance_count == 0) {
+        return;
+    }
+    glBindVertexArray(pm->instance_vao);
+    glDrawElementsInstanced(GL_TRIANGLES, pm->model.idx_count, GL_UNSIGNED_SHORT, NULL, pm->instance_count);
+}
+
 void garage_render(garage_state* state, editor_state* editor) {
     // We need to bind the shader program before uploading uniforms
     glUseProgram(editor->vcolor_shader);
@@ -96,48 +408,33 @@ void garage_render(garage_state* state, editor_state* editor) {
     glBindVertexArray(quad.vao);
     glDrawElements(GL_TRIANGLES, quad.idx_count, GL_UNSIGNED_SHORT, NULL);
 
-    // Draw all our parts
-    const vec3s center = vehicle_find_center(editor, SEARCH_ALL);
-    part_iterator iter = part_iterator_setup(*editor, SEARCH_ALL);
-    while (!iter.done) {
-        const part_entry* p = part_iterator_next(&iter);
-
-        // Move the part
-        vec3s pos = vec3_from_vec3s8(p->pos, PART_POS_SCALE);
-        pos.x -= (center.x * PART_POS_SCALE);
-        pos.z -= (center.z * PART_POS_SCALE);
-
-        // Upload paint color & draw
-        vec4s paint_col = vec4_from_rgba8(p->color);
-        if (list_contains(editor->selected_parts, (void*)p)) {
-            paint_col.a /= 3;
-        }
-
-        // Load a model for the part, if possible.
-        const model m = get_or_load_model(state, p->id);
-        // Don't paint parts with custom models
-        if (m.vao != cube.vao) {
-            paint_col = (vec4s){.r = 1.0f, .g = 1.0f, .b = 1.0f, paint_col.a};
-        }
-
-        // Bind our part model and render
-        glBindVertexArray(m.vao);
-        mat4 model = {0};
-        mat4 pvm = {0};
-        glm_mat4_identity(model);
-
-        // Apply translation & rotation from part data
-        glm_translate(model, (float*)&pos);
-        glm_rotate_x(model, p->rot[0], model);
-        glm_rotate_y(model, p->rot[1], model);
-        glm_rotate_z(model, p->rot[2], model);
-        glm_mat4_mul(pv, model, pvm); // Compute pvm
-        glUniformMatrix4fv(editor->u_pvm, 1, GL_FALSE, (const float *) &pvm);
-
-        // Upload paint color & draw
-        glUniform4fv(editor->u_paint, 1, (const float *) &paint_col);
-        glDrawElements(GL_TRIANGLES, m.idx_count, GL_UNSIGNED_SHORT, NULL);
+    // Draw all our parts, one draw call per model. The draw list is only
+    // rebuilt when parts change or come in/out of view, and parts are only
+    // culled again when they or the camera moved.
+    bool changed = false;
+    const float lod_distance = editor->part_lod ? GARAGE_LOD_DISTANCE : 0;
+    if (state->lod_distance != lod_distance) {
+        state->lod_distance = lod_distance;
+        state->cull_generation = 0;
     }
+    if (state->generation != editor->parts_generation) {
+        garage_build_parts(state, editor);
+        changed = true;
+    }
+    if (changed || state->cull_generation != editor->camera_generation) {
+        changed |= garage_cull(state, editor);
+        state->cull_generation = editor->camera_generation;
+    }
+    if (changed) {
+        garage_build_draw_list(state);
+    }
+    // The camera comes from the camera block, so there's nothing to upload
+    glUseProgram(editor->part_shader);
+    for (u32 i = 0; i < ARRAY_SIZE(state->models); i++) {
+        part_model_draw(&state->models[i]);
+    }
+    part_model_draw(&state->proxy);
+    glUseProgram(editor->vcolor_shader);
 
     // Go back to the cube
     glBindVertexArray(cube.vao);
@@ -150,6 +447,7 @@ void garage_render(garage_state* state, editor_state* editor) {
     vec4s color = {.a = 1.0f};
 
     // Get cursor position
+    const vec3s center = editor->vehicle_center;
     pos = vec3_from_vec3s16(editor->sel_box, PART_POS_SCALE);
     pos.x -= (center.x * PART_POS_SCALE);
     pos.z -= (center.z * PART_POS_SCALE);
@@ -186,6 +484,9 @@ void garage_destroy(garage_state* state) {
     // Unload all part models
     for (u8 i = 0; i < ARRAY_SIZE(state->models); i++) {
         model* m = &state->models[i].model;
+        // Every slot gets its own instance VAO, even the ones sharing the cube
+        glDeleteVertexArrays(1, &state->models[i].instance_vao);
+        state->models[i].instance_vao = 0;
 
         // This is uninitialized, an unknown part, or a part with no model
         // falling back to the (static) cube model. There's nothing to free.
@@ -203,5 +504,14 @@ void garage_destroy(garage_state* state) {
         model empty = {0};
         *m = empty;
     }
+    glDeleteVertexArrays(1, &state->proxy.instance_vao);
+    glDeleteBuffers(1, &state->instance_buf);
+    free(state->parts);
+    free(state->proxies);
+    free(state->bounds);
+    free(state->visibility);
+    free(state->in_frustum);
+    free(state->instances);
+    free(state->scratch);
 }
 
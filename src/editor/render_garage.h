@@ -6,14 +6,63 @@
 
 // This file renders the garage "floor" and all of the vehicle parts.
 
+// Everything the part shader needs to draw one part
+typedef struct {
+    vec4 model[4]; // Columns of the model matrix
+    vec4 paint;
+}part_instance;
+
+typedef enum {
+    PART_HIDDEN, // Outside the view frustum
+    PART_FULL, // Drawn with its model
+    PART_PROXY, // Far away, drawn as a box
+}part_visibility;
+
+enum {
+    // With LOD turned on, parts further than this from the camera are drawn
+    // as boxes
+    GARAGE_LOD_DISTANCE = 160,
+};
+
 typedef struct {
     part_id id;
     model model;
+    u32 part_start; // Index of this model's first part in garage_state.parts
+    u32 part_count;
+    // The model's buffers plus the instance attributes, 0 until a part using
+    // this model is drawn
+    gl_obj instance_vao;
+    u32 instance_start; // Index of this model's first instance in the buffer
+    u32 instance_count;
 }part_model;
 
 // This is just a way to return an array without the compiler complaining
 typedef struct {
     part_model models[NUM_PARTS + 1];
+    part_model proxy; // The cube, used to draw distant parts as boxes
+
+    // Every part, grouped by model. Rebuilt when the parts change.
+    part_instance* parts;
+    part_instance* proxies; // Box around each part
+    // Bounding sphere of each part, stored as 4 arrays of [capacity] floats
+    // (X, Y, Z, radius) for frustum_cull_spheres()
+    float* bounds;
+    u8* visibility; // part_visibility of each part as of the last cull
+    u8* in_frustum; // Scratch space for culling
+    u32 part_count;
+
+    // The instance buffer holds the visible parts of each model, then the
+    // proxies. A CPU copy is kept so only instances that changed are uploaded.
+    gl_obj instance_buf;
+    part_instance* instances;
+    part_instance* scratch; // Where the next draw list goes before comparing
+    u32 instance_count;
+
+    u32 capacity; // Number of parts every array (and the buffer) has room for
+    u32 failed_capacity; // Part count we last failed to make room for, so it's only logged once
+    float lod_distance; // Parts further than this are drawn as boxes, 0 to disable
+    u32 generation; // Editor parts_generation the parts were built from
+    u32 cull_generation; // Editor camera_generation the parts were culled at, 0 to cull again
 }garage_state;
 
 garage_state garage_init(editor_state* editor);
@@ -74,21 +74,19 @@ void partsearch_update_render(editor_state* editor) {
 
         bool failure = true;
         for (u32 i = 0; i < NUM_PARTS; i++) {
-            const part_info info = partdata[i];
+            const part_info* info = &partdata[i];
             const char* selected_item = editor->partsearch_results[editor->partsearch_selected_item].text;
             if (selected_item == NULL) {
                 break;
             }
-            if (strcmp(info.name, selected_item) == 0) {
+            if (strcmp(info->name, selected_item) == 0) {
                 failure = false;
-                new_part.id = info.id;
+                new_part.id = info->id;
             }
         }
         if (!failure) {
             // Add the part
-            list_add(&editor->selected_parts, &new_part);
-            editor->v.part_count++;
-            update_selectionmask(editor);
+            vehicle_add_part(editor, new_part);
         }
     }
 
@@ -242,8 +240,8 @@ void ui_update_render(editor_state* editor) {
     if (!vec3s16_eq(last_selbox, editor->sel_box)) {
         const vec3s8 pos = {editor->sel_box.x, editor->sel_box.y, editor->sel_box.z};
         const part_entry* part = part_by_pos(editor, pos, SEARCH_ALL);
-        const part_info cur_part = part_get_info(part->id);
-        strncpy(editor->partname_buf, cur_part.name, sizeof(editor->partname_buf));
+        const part_info* cur_part = part_get_info(part->id);
+        strncpy(editor->partname_buf, cur_part->name, sizeof(editor->partname_buf));
         // Update part name & selection box
         text_update_transforms(&editor->part_name);
         last_selbox = editor->sel_box;
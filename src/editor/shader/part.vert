@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 a_pos; // Fixed point, see VERTEX_POS_SCALE
+layout (location = 1) in vec4 a_color;
+// Per-instance attributes. The matrix takes up locations 2 through 5.
+layout (location = 2) in mat4 a_model;
+layout (location = 6) in vec4 a_paint;
+
+out vec4 vert_color;
+
+// Same as VERTEX_POS_SCALE in model.h
+const float VERTEX_POS_SCALE = 512.0;
+
+layout (std140) uniform camera {
+    mat4 pv;
+};
+
+void main() {
+    gl_Position = pv * a_model * vec4(a_pos / VERTEX_POS_SCALE, 1.0);
+    vert_color = a_color * a_paint;
+}
@@ -1,13 +1,16 @@
 #version 330 core
-layout (location = 0) in vec3 a_pos;
+layout (location = 0) in vec3 a_pos; // Fixed point, see VERTEX_POS_SCALE
 layout (location = 1) in vec4 a_color;
 
 out vec4 vert_color;
 
+// Same as VERTEX_POS_SCALE in model.h
+const float VERTEX_POS_SCALE = 512.0;
+
 uniform mat4 pvm;
 uniform vec4 paint;
 
 void main() {
-    gl_Position = pvm * vec4(a_pos, 1.0);
+    gl_Position = pvm * vec4(a_pos / VERTEX_POS_SCALE, 1.0);
     vert_color = a_color * paint;
 }
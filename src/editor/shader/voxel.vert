@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 a_pos; // Cell corner coordinates
+
+out vec4 vert_color;
+
+layout (std140) uniform camera {
+    mat4 pv;
+};
+uniform vec4 paint;
+uniform float cell_scale;
+
+void main() {
+    // Corners are at whole numbers, so cell centers are halfway between them
+    vec3 pos = (a_pos - 0.5) * cell_scale;
+    gl_Position = pv * vec4(pos, 1.0);
+    vert_color = paint;
+}
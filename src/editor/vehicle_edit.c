@@ -1,9 +1,25 @@
+#include <stdlib.h>
 #include <memory.h>
 #include <math.h>
 
+#if defined(__x86_64__) || defined(_M_X64)
+    #define VEHMASK_HAVE_AVX2 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #define VEHMASK_TARGET_AVX2
+    #else
+        #define VEHMASK_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    // NEON is always there on 64-bit ARM
+    #define VEHMASK_HAVE_NEON 1
+    #include <arm_neon.h>
+#endif
+
 #include <common/vector.h>
 #include <common/int.h>
 #include <common/logging.h>
+#include <common/cpu.h>
 
 #include <parts.h>
 #include "vehicle_edit.h"
@@ -11,103 +27,498 @@
 #include "editor.h"
 #include "camera.h"
 
-bool vehiclemask_get_3d(vehicle_bitmask* mask, vec3s8 cell) {
-    u8* mask_addr = (u8*)&(*mask)[cell.x][cell.y]; // Target byte
+static bool vehiclemask_in_bounds(vec3s8 cell) {
+    // Coordinates can't be too high because VEH_MAX_DIM is 1 past INT8_MAX
+    return cell.x >= 0 && cell.y >= 0 && cell.z >= 0;
+}
 
-    // Only try to access mask bits if the address is in bounds.
-    if (mask_addr >= (u8*)mask && mask_addr <= (u8*)mask[1]) {
-        // Get mask value
-        return mask_get(mask_addr, cell.z);
-    }
+vehicle_bitmask vehiclemask_create() {
+    vehicle_bitmask mask = {
+        .bricks = brick_map_create(sizeof(vehicle_bitmask_brick)),
+        .generation = 1,
+    };
+    vehiclemask_clear(&mask);
+    return mask;
+}
+
+void vehiclemask_destroy(vehicle_bitmask* mask) {
+    brick_map_destroy(&mask->bricks);
+}
 
+bool vehiclemask_get_3d(const vehicle_bitmask* mask, vec3s8 cell) {
     // Out of bounds? Zero.
-    return 0;
+    if (!vehiclemask_in_bounds(cell)) {
+        return 0;
+    }
+
+    const vehicle_bitmask_brick* brick = brick_map_get(&mask->bricks, brick_key(cell.x, cell.y, cell.z));
+    if (brick == NULL) {
+        // Nothing in this whole area
+        return 0;
+    }
+    const u16 idx = brick_cell_idx(cell.x, cell.y, cell.z);
+    return (brick->slices[idx / 64] >> (idx % 64)) & 1;
 }
 
 void vehiclemask_set_3d(vehicle_bitmask* mask, vec3s8 cell, u8 val) {
-    u8* mask_addr = (u8*)&(*mask)[cell.x][cell.y]; // Target byte
-    val &= 1; // Only keep the lowest bit of the value.
+    // Only try to set mask bits if the cell is in bounds.
+    if (!vehiclemask_in_bounds(cell)) {
+        return; // Oh well.
+    }
 
-    // Only try to set mask bits if the address is in bounds.
-    if (mask_addr >= (u8*)mask && mask_addr <= (u8*)mask[1]) {
-        // Set mask value
-        mask_set(mask_addr, cell.z, val);
+    const u16 key = brick_key(cell.x, cell.y, cell.z);
+    const u16 idx = brick_cell_idx(cell.x, cell.y, cell.z);
+    const u64 bit = (u64)1 << (idx % 64);
+    if (val & 1) {
+        vehicle_bitmask_brick* brick = brick_map_get_or_add(&mask->bricks, key);
+        if (brick == NULL) {
+            return;
+        }
+        if (brick->slices[idx / 64] & bit) {
+            return;
+        }
+        brick->slices[idx / 64] |= bit;
+        mask->generation++;
+        mask->min = (vec3s8){{MIN(mask->min.x, cell.x), MIN(mask->min.y, cell.y), MIN(mask->min.z, cell.z)}};
+        mask->max = (vec3s8){{MAX(mask->max.x, cell.x), MAX(mask->max.y, cell.y), MAX(mask->max.z, cell.z)}};
+        return;
     }
 
-    // Oh well.
+    vehicle_bitmask_brick* brick = brick_map_get(&mask->bricks, key);
+    if (brick == NULL || !(brick->slices[idx / 64] & bit)) {
+        return;
+    }
+    brick->slices[idx / 64] &= ~bit;
+    mask->generation++;
+    // Free the brick once it's empty
+    u64 remaining = 0;
+    for (u8 i = 0; i < BRICK_DIM; i++) {
+        remaining |= brick->slices[i];
+    }
+    if (remaining == 0) {
+        brick_map_remove(&mask->bricks, key);
+    }
 }
 
-bool cell_is_selected(editor_state* editor, vec3s8 cell) {
-    // Try to find a part from the selected list at this position
-    const part_entry* p = part_by_pos(editor, cell, SEARCH_SELECTED);
+void vehiclemask_clear(vehicle_bitmask* mask) {
+    brick_map_clear(&mask->bricks);
+    mask->generation++;
+    mask->min = (vec3s8){{VEH_MAX_DIM - 1, VEH_MAX_DIM - 1, VEH_MAX_DIM - 1}};
+    mask->max = (vec3s8){0};
+}
 
-    // An id of 0 indicates placeholder, meaning nothing was found
-    const bool found_part = (p->id != 0);
+static bool vehiclemask_words_overlap_scalar(const u64* a, const u64* b, u32 word_count) {
+    u64 acc = 0;
+    for (u32 i = 0; i < word_count; i++) {
+        acc |= a[i] & b[i];
+    }
+    return acc != 0;
+}
 
-    return found_part;
+#ifdef VEHMASK_HAVE_AVX2
+// A whole brick is 2 vectors
+VEHMASK_TARGET_AVX2
+static bool vehiclemask_words_overlap_avx2(const u64* a, const u64* b, u32 word_count) {
+    __m256i acc = _mm256_setzero_si256();
+    u32 i = 0;
+    for (; i + 4 <= word_count; i += 4) {
+        const __m256i va = _mm256_loadu_si256((const __m256i*)&a[i]);
+        const __m256i vb = _mm256_loadu_si256((const __m256i*)&b[i]);
+        acc = _mm256_or_si256(acc, _mm256_and_si256(va, vb));
+    }
+    if (!_mm256_testz_si256(acc, acc)) {
+        return true;
+    }
+    return vehiclemask_words_overlap_scalar(&a[i], &b[i], word_count - i);
 }
+#elif defined(VEHMASK_HAVE_NEON)
+// A whole brick is 4 vectors
+static bool vehiclemask_words_overlap_neon(const u64* a, const u64* b, u32 word_count) {
+    uint64x2_t acc = vdupq_n_u64(0);
+    u32 i = 0;
+    for (; i + 2 <= word_count; i += 2) {
+        acc = vorrq_u64(acc, vandq_u64(vld1q_u64(&a[i]), vld1q_u64(&b[i])));
+    }
+    if ((vgetq_lane_u64(acc, 0) | vgetq_lane_u64(acc, 1)) != 0) {
+        return true;
+    }
+    return vehiclemask_words_overlap_scalar(&a[i], &b[i], word_count - i);
+}
+#endif
 
-bool vehicle_part_conflict(vehicle_bitmask* vacancy, part_entry* p) {
-    bool result = false;
-    part_cell_iterator iter = part_cell_iterator_setup(*p);
-    while (!iter.done) {
-        // Get the final coordinate by adding the rotated point to origin
-        vec3s8 cell = part_cell_iterator_next(&iter);
+bool vehiclemask_overlap(const vehicle_bitmask* a, const vehicle_bitmask* b) {
+    // Nothing outside both boxes can be set in both masks
+    for (u8 axis = 0; axis < 3; axis++) {
+        if (MAX(a->min.raw[axis], b->min.raw[axis]) > MIN(a->max.raw[axis], b->max.raw[axis])) {
+            return false;
+        }
+    }
 
-        bool cell_occupied = vehiclemask_get_3d(vacancy, cell);
-        result |= cell_occupied;
+    bool (*words_overlap)(const u64*, const u64*, u32) = vehiclemask_words_overlap_scalar;
+#ifdef VEHMASK_HAVE_AVX2
+    if (cpu_get_features()->avx2) {
+        words_overlap = vehiclemask_words_overlap_avx2;
+    }
+#elif defined(VEHMASK_HAVE_NEON)
+    words_overlap = vehiclemask_words_overlap_neon;
+#endif
+
+    // Go through the mask with fewer bricks, and only compare bricks that
+    // exist in both.
+    if (a->bricks.count > b->bricks.count) {
+        const vehicle_bitmask* tmp = a;
+        a = b;
+        b = tmp;
+    }
+    for (u32 i = 0; i < a->bricks.count; i++) {
+        const vehicle_bitmask_brick* other = brick_map_get(&b->bricks, a->bricks.keys[i]);
+        if (other == NULL) {
+            continue;
+        }
+        const vehicle_bitmask_brick* brick = brick_map_get_idx(&a->bricks, i);
+        if (words_overlap(brick->slices, other->slices, BRICK_DIM)) {
+            return true;
+        }
+    }
+    return false;
+}
 
+// Find the next set bit, starting from the iterator's current position
+static void vehiclemask_iterator_advance(vehiclemask_iterator* ctx) {
+    while (ctx->bits == 0) {
+        ctx->slice++;
+        if (ctx->slice >= BRICK_DIM) {
+            ctx->slice = 0;
+            ctx->brick_idx++;
+        }
+        if (ctx->brick_idx >= ctx->mask->bricks.count) {
+            ctx->done = true;
+            return;
+        }
+        const vehicle_bitmask_brick* brick = brick_map_get_idx(&ctx->mask->bricks, ctx->brick_idx);
+        ctx->bits = brick->slices[ctx->slice];
     }
-    return result;
 }
 
-bool vehicle_selection_overlap(editor_state* editor) {
-    part_iterator iter = part_iterator_setup(*editor, SEARCH_SELECTED);
+vehiclemask_iterator vehiclemask_iterator_setup(const vehicle_bitmask* mask) {
+    vehiclemask_iterator out = {
+        .mask = mask,
+        .done = (mask->bricks.count == 0),
+    };
+    if (!out.done) {
+        const vehicle_bitmask_brick* brick = brick_map_get_idx(&mask->bricks, 0);
+        out.bits = brick->slices[0];
+        vehiclemask_iterator_advance(&out);
+    }
+    return out;
+}
+
+vec3s8 vehiclemask_iterator_next(vehiclemask_iterator* ctx) {
+    u8 corner[3] = {0};
+    brick_key_decode(ctx->mask->bricks.keys[ctx->brick_idx], corner);
+    const u8 bit = bit_scan_forward(ctx->bits);
+    const vec3s8 cell = {{
+        corner[0] + ctx->slice,
+        corner[1] + (bit / BRICK_DIM),
+        corner[2] + (bit % BRICK_DIM),
+    }};
+
+    // Clear the bit we just returned and move on
+    ctx->bits &= ctx->bits - 1;
+    vehiclemask_iterator_advance(ctx);
+    return cell;
+}
+
+enum {
+    // How far wireframe faces are pushed out from the cells, in cells. Keeps
+    // them from Z-fighting with the parts.
+    WIREFRAME_PUSH = 1,
+    WIREFRAME_PUSH_DIV = 4000,
+};
+
+// Add the outline of one merged face. [lo] and [hi] are opposite corners, in
+// cell corner coordinates.
+static void wireframe_add_rect(list* vertices, u8 axis, s8 dir, const u16 lo[3], const u16 hi[3]) {
+    const u8 u = (axis + 1) % 3;
+    const u8 v = (axis + 2) % 3;
+    vec3s corners[4] = {0};
+    for (u8 i = 0; i < 4; i++) {
+        corners[i].raw[axis] = lo[axis] + (dir * (float)WIREFRAME_PUSH / WIREFRAME_PUSH_DIV);
+        corners[i].raw[u] = (i == 1 || i == 2) ? hi[u] : lo[u];
+        corners[i].raw[v] = (i >= 2) ? hi[v] : lo[v];
+    }
+    for (u8 i = 0; i < 4; i++) {
+        list_add(vertices, &corners[i]);
+        list_add(vertices, &corners[(i + 1) % 4]);
+    }
+}
+
+void vehiclemask_build_wireframe(const vehicle_bitmask* mask, list* vertices) {
+    list_clear(vertices);
+    if (mask->bricks.count == 0) {
+        return;
+    }
+
+    // Copy the mask's box into a dense volume with an empty cell of padding on
+    // every side, so neighbors can be checked without any bounds checks.
+    u16 size[3] = {0};
+    for (u8 axis = 0; axis < 3; axis++) {
+        size[axis] = mask->max.raw[axis] - mask->min.raw[axis] + 3;
+    }
+    u8* cells = calloc((size_t)size[0] * size[1] * size[2], sizeof(u8));
+    u8* faces = calloc((size_t)VEH_MAX_DIM * VEH_MAX_DIM, sizeof(u8));
+    if (cells == NULL || faces == NULL) {
+        LOG_MSG(error, "Failed to allocate for a %dx%dx%d wireframe\n", size[0], size[1], size[2]);
+        free(cells);
+        free(faces);
+        return;
+    }
+    const u32 stride[3] = {size[1] * size[2], size[2], 1};
+    vehiclemask_iterator iter = vehiclemask_iterator_setup(mask);
     while (!iter.done) {
-        part_entry* p = part_iterator_next(&iter);
-        if (vehicle_part_conflict(editor->vacancy_mask, p)) {
-            return true;
+        const vec3s8 cell = vehiclemask_iterator_next(&iter);
+        u32 idx = 0;
+        for (u8 axis = 0; axis < 3; axis++) {
+            idx += (cell.raw[axis] - mask->min.raw[axis] + 1) * stride[axis];
         }
+        cells[idx] = 1;
     }
-    return false;
+
+    // For each direction a face can point, go slice by slice and merge exposed
+    // faces into the biggest rectangles we can find (greedy meshing).
+    for (u8 axis = 0; axis < 3; axis++) {
+        const u8 u = (axis + 1) % 3;
+        const u8 v = (axis + 2) % 3;
+        for (s8 dir = -1; dir <= 1; dir += 2) {
+            for (u16 slice = 1; slice < size[axis] - 1; slice++) {
+                // Find every exposed face in this slice
+                for (u16 a = 0; a < size[u] - 2; a++) {
+                    for (u16 b = 0; b < size[v] - 2; b++) {
+                        const u32 idx = (slice * stride[axis]) + ((a + 1) * stride[u]) + ((b + 1) * stride[v]);
+                        const s32 neighbor = (s32)idx + (dir * (s32)stride[axis]);
+                        faces[(a * VEH_MAX_DIM) + b] = cells[idx] && !cells[neighbor];
+                    }
+                }
+
+                for (u16 a = 0; a < size[u] - 2; a++) {
+                    for (u16 b = 0; b < size[v] - 2; b++) {
+                        if (!faces[(a * VEH_MAX_DIM) + b]) {
+                            continue;
+                        }
+                        // Grow along V as far as possible, then along U for as
+                        // long as every face in the row is there too.
+                        u16 width = 1;
+                        while (b + width < size[v] - 2 && faces[(a * VEH_MAX_DIM) + b + width]) {
+                            width++;
+                        }
+                        u16 height = 1;
+                        bool row_full = true;
+                        while (a + height < size[u] - 2 && row_full) {
+                            for (u16 w = 0; w < width && row_full; w++) {
+                                row_full = faces[((a + height) * VEH_MAX_DIM) + b + w];
+                            }
+                            height += row_full;
+                        }
+                        for (u16 h = 0; h < height; h++) {
+                            memset(&faces[((a + h) * VEH_MAX_DIM) + b], 0, width);
+                        }
+
+                        // Back to cell corner coordinates. A cell's faces are
+                        // on its own corner and the next one.
+                        u16 lo[3] = {0};
+                        u16 hi[3] = {0};
+                        lo[axis] = slice - 1 + mask->min.raw[axis] + (dir > 0);
+                        lo[u] = a + mask->min.raw[u];
+                        lo[v] = b + mask->min.raw[v];
+                        hi[u] = lo[u] + height;
+                        hi[v] = lo[v] + width;
+                        wireframe_add_rect(vertices, axis, dir, lo, hi);
+                    }
+                }
+            }
+        }
+    }
+
+    free(cells);
+    free(faces);
 }
 
-void update_vacancymask(editor_state* editor) {
-    // Clear the selection grid
-    memset(editor->vacancy_mask, 0x00, sizeof(vehicle_bitmask));
+// Cells past the edge wrap around to negative numbers in a vec3s8
+static bool part_grid_in_bounds(vec3s8 cell) {
+    return cell.x >= 0 && cell.y >= 0 && cell.z >= 0;
+}
 
-    part_iterator iter = part_iterator_setup(*editor, SEARCH_UNSELECTED);
-    while (!iter.done) {
-        part_entry* p = part_iterator_next(&iter);
+part_grid part_grid_create() {
+    return brick_map_create(sizeof(part_grid_brick));
+}
 
-        part_cell_iterator cell_iter = part_cell_iterator_setup(*p);
-        while (!cell_iter.done) {
-            // Get the next cell of this part
-            vec3s8 cell = part_cell_iterator_next(&cell_iter);
+void part_grid_destroy(part_grid* grid) {
+    brick_map_destroy(grid);
+}
 
-            vehiclemask_set_3d(editor->vacancy_mask, cell, true);
+// Handle of the part in a cell. The highest handle covering a cell wins, which
+// is the part a full rebuild would write last. If that part was taken out while
+// others still cover the cell, find the next highest one and keep it.
+static part_handle part_grid_get(part_grid* grid, list parts, vec3s8 cell) {
+    if (!part_grid_in_bounds(cell)) {
+        return 0;
+    }
+    part_grid_brick* brick = brick_map_get(grid, brick_key(cell.x, cell.y, cell.z));
+    if (brick == NULL) {
+        return 0;
+    }
+    const u16 idx = brick_cell_idx(cell.x, cell.y, cell.z);
+    if (brick->cells[idx] != 0 || brick->counts[idx] == 0) {
+        return brick->cells[idx];
+    }
+
+    // Only overlapping parts get here, so searching the list is fine
+    for (u32 i = parts.end_idx; i > 0; i--) {
+        part_cell_iterator iter = part_cell_iterator_setup(*(part_entry*)list_get_element(parts, i - 1));
+        while (!iter.done) {
+            if (vec3s8_eq(part_cell_iterator_next(&iter), cell)) {
+                brick->cells[idx] = i;
+                return i;
+            }
         }
     }
+    return 0;
 }
 
-void update_selectionmask(editor_state* editor) {
-    // Clear the selection grid
-    memset(editor->selected_mask, 0x00, sizeof(vehicle_bitmask));
+// Add a part to a cell
+static void part_grid_add(part_grid* grid, vec3s8 cell, part_handle handle) {
+    part_grid_brick* brick = brick_map_get_or_add(grid, brick_key(cell.x, cell.y, cell.z));
+    if (brick == NULL) {
+        return;
+    }
+    const u16 idx = brick_cell_idx(cell.x, cell.y, cell.z);
+    if (brick->counts[idx]++ == 0) {
+        brick->used++;
+        brick->cells[idx] = handle;
+    }
+    else if (brick->cells[idx] != 0) {
+        // If it's 0, part_grid_get() will consider this part too
+        brick->cells[idx] = MAX(brick->cells[idx], handle);
+    }
+}
 
-    part_iterator iter = part_iterator_setup(*editor, SEARCH_SELECTED);
-    while (!iter.done) {
-        part_entry* p = part_iterator_next(&iter);
+// Take a part out of a cell. Returns whether the cell is empty now.
+static bool part_grid_remove(part_grid* grid, vec3s8 cell, part_handle handle) {
+    const u16 key = brick_key(cell.x, cell.y, cell.z);
+    part_grid_brick* brick = brick_map_get(grid, key);
+    const u16 idx = brick_cell_idx(cell.x, cell.y, cell.z);
+    if (brick == NULL || brick->counts[idx] == 0) {
+        return true;
+    }
+    if (brick->cells[idx] == handle) {
+        brick->cells[idx] = 0;
+    }
+    if (--brick->counts[idx] != 0) {
+        return false;
+    }
+    if (--brick->used == 0) {
+        brick_map_remove(grid, key);
+    }
+    return true;
+}
 
-        part_cell_iterator cell_iter = part_cell_iterator_setup(*p);
-        while (!cell_iter.done) {
-            // Get the next cell of this part
-            vec3s8 cell = part_cell_iterator_next(&cell_iter);
+// Change a part's handle in a cell. Only the last handle in a list is ever
+// renamed, so no other part covering the cell can have been higher.
+static void part_grid_rename(part_grid* grid, vec3s8 cell, part_handle from, part_handle to) {
+    part_grid_brick* brick = brick_map_get(grid, brick_key(cell.x, cell.y, cell.z));
+    const u16 idx = brick_cell_idx(cell.x, cell.y, cell.z);
+    if (brick != NULL && brick->cells[idx] == from) {
+        // With a lower handle, it might not win anymore
+        brick->cells[idx] = (brick->counts[idx] == 1) ? to : 0;
+    }
+}
+
+// One of the part lists, along with the grid & bitmask that mirror it. Every
+// change to the grid is also made to the bitmask, so neither ever has to be
+// rebuilt from scratch.
+typedef struct {
+    list* parts;
+    part_grid* grid;
+    vehicle_bitmask* mask;
+    u32* generation; // The editor's parts_generation
+}part_layer;
+
+static part_layer layer_selected(editor_state* editor) {
+    return (part_layer){&editor->selected_parts, &editor->selected_grid, &editor->selected_mask, &editor->parts_generation};
+}
+
+static part_layer layer_unselected(editor_state* editor) {
+    return (part_layer){&editor->unselected_parts, &editor->vacancy_grid, &editor->vacancy_mask, &editor->parts_generation};
+}
 
-            vehiclemask_set_3d(editor->selected_mask, cell, true);
+// Add a part to every one of its cells
+static void part_grid_stamp(part_layer layer, part_entry p, part_handle handle) {
+    // Every change to a part ends with it being written back into a grid
+    (*layer.generation)++;
+    part_cell_iterator iter = part_cell_iterator_setup(p);
+    while (!iter.done) {
+        const vec3s8 cell = part_cell_iterator_next(&iter);
+        if (part_grid_in_bounds(cell)) {
+            part_grid_add(layer.grid, cell, handle);
+            vehiclemask_set_3d(layer.mask, cell, true);
         }
     }
 }
 
+// Replace one handle with another in the cells of a part. Replacing it with 0
+// takes the part out, and cells only leave the mask once no part covers them.
+static void part_grid_replace(part_layer layer, part_entry p, part_handle from, part_handle to) {
+    (*layer.generation)++;
+    part_cell_iterator iter = part_cell_iterator_setup(p);
+    while (!iter.done) {
+        const vec3s8 cell = part_cell_iterator_next(&iter);
+        if (!part_grid_in_bounds(cell)) {
+            continue;
+        }
+        if (to != 0) {
+            part_grid_rename(layer.grid, cell, from, to);
+        }
+        else if (part_grid_remove(layer.grid, cell, from)) {
+            vehiclemask_set_3d(layer.mask, cell, false);
+        }
+    }
+}
+
+static void part_grid_rebuild(part_layer layer) {
+    brick_map_clear(layer.grid);
+    vehiclemask_clear(layer.mask);
+    for (u32 i = 0; i < layer.parts->end_idx; i++) {
+        part_grid_stamp(layer, *(part_entry*)list_get_element(*layer.parts, i), i + 1);
+    }
+}
+
+void update_vacancymask(editor_state* editor) {
+    part_grid_rebuild(layer_unselected(editor));
+}
+
+void update_selectionmask(editor_state* editor) {
+    part_grid_rebuild(layer_selected(editor));
+}
+
+void update_part_grids(editor_state* editor) {
+    update_vacancymask(editor);
+    update_selectionmask(editor);
+}
+
+bool cell_is_selected(editor_state* editor, vec3s8 cell) {
+    // Try to find a part from the selected list at this position
+    const part_entry* p = part_by_pos(editor, cell, SEARCH_SELECTED);
+
+    // An id of 0 indicates placeholder, meaning nothing was found
+    const bool found_part = (p->id != 0);
+
+    return found_part;
+}
+
+bool vehicle_selection_overlap(editor_state* editor) {
+    return vehiclemask_overlap(&editor->selected_mask, &editor->vacancy_mask);
+}
+
 vec3s vehicle_find_center(const editor_state* editor, partsearch_type search_type) {
     vec3s8 max = {0}; // Highest position in the selection
     vec3s8 min = {127, 127, 127}; // Smallest position in the selection
@@ -185,6 +596,10 @@ bool vehicle_rotate_selection(editor_state* editor, s8 forward_diff, s8 side_dif
     part_iterator iter = part_iterator_setup(*editor, SEARCH_SELECTED);
     while (!iter.done) {
         part_entry* p = part_iterator_next(&iter);
+        // The part's cells change with its rotation, so take it out of the
+        // grid first
+        const part_handle handle = (p - (part_entry*)editor->selected_parts.data) + 1;
+        part_grid_replace(layer_selected(editor), *p, handle, 0);
 
         // Get rotation matrix for the part rotation
         mat4 part_rotation = {0};
@@ -193,6 +608,7 @@ bool vehicle_rotate_selection(editor_state* editor, s8 forward_diff, s8 side_dif
         // Combine rotation matrices & update the part rotation
         glm_mat4_mul(rot_matrix, part_rotation, part_rotation);
         glm_euler_angles(part_rotation, p->rot);
+        part_grid_stamp(layer_selected(editor), *p, handle);
 
         vec3 offset = {
             (float)p->pos.x - editor->sel_box.x,
@@ -229,42 +645,32 @@ bool vehicle_rotate_selection(editor_state* editor, s8 forward_diff, s8 side_dif
 
 // Setup an iterator from a part entry. Returns an iteration context.
 part_cell_iterator part_cell_iterator_setup(part_entry p) {
+    // Parts only ever sit at 90 degree angles, so instead of rotating every
+    // cell we look up the part's cells pre-rotated to the right orientation.
+    const u8 orientation = part_orientation_from_euler(p.rot);
     part_cell_iterator out = {
-        .info = part_get_info(p.id),
-        .part = p,
-        .done = false,
+        .cells = part_get_cells(p.id, orientation),
+        .origin = p.pos,
     };
+    out.done = (out.cells.count == 0);
     return out;
 }
 
 // Get the next item and advance.
 vec3s8 part_cell_iterator_next(part_cell_iterator* ctx) {
-    // Get the origin and current relative cell we're working with
-    const vec3s relative_cell = vec3_from_vec3s8(ctx->info.relative_occupation[ctx->cell_idx], 1.0f);
-    const vec3s8 origin = ctx->part.pos;
-
-    // Get quaternion of part rotation
-    // Sorry for the ugly cast, this is just making it treat a vec3 as vec3s because they're the same
-    const versors quaternion = glms_euler_xyz_quat(*(vec3s*)&ctx->part.rot);
-
-    // Rotate the relative point about the part origin
-    const vec3s rotated_point = glms_quat_rotatev(quaternion, relative_cell);
+    const vec3s8 relative_cell = ctx->cells.cells[ctx->cell_idx];
+    const vec3s8 origin = ctx->origin;
 
     // Get the final coordinate by adding the relative rotated point to origin
     const vec3s8 cell = {
-        MAX(origin.x + roundf(rotated_point.x), 0),
-        MAX(origin.y + roundf(rotated_point.y), 0),
-        MAX(origin.z + roundf(rotated_point.z), 0),
+        MAX(origin.x + relative_cell.x, 0),
+        MAX(origin.y + relative_cell.y, 0),
+        MAX(origin.z + relative_cell.z, 0),
     };
 
-    // Array ends with an all-zero entry, so if we just hit that, we're done
-    // TODO: We can also do a bounds check against max volume here
-    ctx->done = glms_vec3_eqv(relative_cell, (vec3s){0});
-
-    // Increment the current position if needed
-    if (!ctx->done) {
-        ctx->cell_idx++;
-    }
+    // The origin is always the last cell
+    ctx->cell_idx++;
+    ctx->done = (ctx->cell_idx >= ctx->cells.count);
 
     return cell;
 }
@@ -331,36 +737,116 @@ part_entry* part_iterator_next(part_iterator* ctx) {
 
 static part_entry empty_part = {0};
 
-part_entry* part_by_pos(editor_state* editor, vec3s8 target, partsearch_type search_hint) {
-    const bool vacancy_result = vehiclemask_get_3d(editor->vacancy_mask, target);
-    const bool selection_result = vehiclemask_get_3d(editor->selected_mask, target);
-    if (!vacancy_result && !selection_result) {
-        // This cell isn't in the selection or vacancy grid, so there's no part here.
-        empty_part = (part_entry){0};
-        return &empty_part;
+// Add a part to the end of a list and its grid
+static void part_list_add(part_layer layer, part_entry p) {
+    const u32 old_count = layer.parts->end_idx;
+    list_add(layer.parts, &p);
+    if (layer.parts->end_idx == old_count) {
+        // list_add() already logged the failure
+        return;
     }
+    part_grid_stamp(layer, p, layer.parts->end_idx);
+}
 
-    // Linearly search for the part
-    part_iterator iter = part_iterator_setup(*editor, search_hint);
-    while (!iter.done) {
-        part_entry* part = part_iterator_next(&iter);
+// Remove a part from a list and its grid. The list fills the hole with its
+// last element, so that's the only handle we have to fix up.
+static part_entry part_list_remove(part_layer layer, u32 idx) {
+    const part_entry p = *(part_entry*)list_get_element(*layer.parts, idx);
+    part_grid_replace(layer, p, idx + 1, 0);
+
+    const u32 last_idx = layer.parts->end_idx - 1;
+    list_remove(layer.parts, idx);
+    if (idx != last_idx) {
+        const part_entry moved = *(part_entry*)list_get_element(*layer.parts, idx);
+        part_grid_replace(layer, moved, last_idx + 1, idx + 1);
+    }
+    return p;
+}
 
-        // A part's max width is 8, so anything further away can't be a match
-        if (abs(part->pos.x - target.x) > 8 || 
-            abs(part->pos.y - target.y) > 8 || 
-            abs(part->pos.z - target.z) > 8) {
-            continue; // The part is too far away, skip it
+// Figure out which list a part is in and where. Most callers have a pointer
+// straight into a list, but fall back to searching by value.
+static bool part_locate(editor_state* editor, const part_entry* p, bool* selected, u32* idx) {
+    const list* lists[2] = {&editor->selected_parts, &editor->unselected_parts};
+    for (u8 i = 0; i < 2; i++) {
+        const list l = *lists[i];
+        const uintptr_t addr = (uintptr_t)p;
+        if (addr >= l.data && addr < l.data + (uintptr_t)l.end_idx * l.element_size) {
+            *selected = (i == 0);
+            *idx = (addr - l.data) / l.element_size;
+            return true;
         }
+    }
+    for (u8 i = 0; i < 2; i++) {
+        const s64 found = list_find(*lists[i], p);
+        if (found != -1) {
+            *selected = (i == 0);
+            *idx = found;
+            return true;
+        }
+    }
+    return false;
+}
 
-        // Loop over every cell this part occupies
-        part_cell_iterator cell_iter = part_cell_iterator_setup(*part);
-        while (!cell_iter.done) {
-            // Get the next coordinate
-            vec3s8 cell = part_cell_iterator_next(&cell_iter);
+void vehicle_select_part(editor_state* editor, const part_entry* p) {
+    bool selected = false;
+    u32 idx = 0;
+    if (p->id == 0 || !part_locate(editor, p, &selected, &idx) || selected) {
+        return;
+    }
+    const part_entry part = part_list_remove(layer_unselected(editor), idx);
+    part_list_add(layer_selected(editor), part);
+}
+
+void vehicle_unselect_part(editor_state* editor, const part_entry* p) {
+    bool selected = false;
+    u32 idx = 0;
+    if (p->id == 0 || !part_locate(editor, p, &selected, &idx) || !selected) {
+        return;
+    }
+    const part_entry part = part_list_remove(layer_selected(editor), idx);
+    part_list_add(layer_unselected(editor), part);
+}
 
-            if (vec3s8_eq(cell, target)) {
-                // Found it!
-                return part;
+void vehicle_delete_part(editor_state* editor, const part_entry* p) {
+    bool selected = false;
+    u32 idx = 0;
+    if (p->id == 0 || !part_locate(editor, p, &selected, &idx)) {
+        return;
+    }
+    part_list_remove(selected ? layer_selected(editor) : layer_unselected(editor), idx);
+    editor->v.part_count--;
+}
+
+void vehicle_add_part(editor_state* editor, part_entry p) {
+    const u32 old_count = editor->selected_parts.end_idx;
+    part_list_add(layer_selected(editor), p);
+    if (editor->selected_parts.end_idx != old_count) {
+        editor->v.part_count++;
+    }
+}
+
+void vehicle_place_selection(editor_state* editor) {
+    for (u32 i = 0; i < editor->selected_parts.end_idx; i++) {
+        const part_entry p = *(part_entry*)list_get_element(editor->selected_parts, i);
+        part_grid_replace(layer_selected(editor), p, i + 1, 0);
+        part_list_add(layer_unselected(editor), p);
+    }
+    list_clear(&editor->selected_parts);
+}
+
+part_entry* part_by_pos(editor_state* editor, vec3s8 target, partsearch_type search_hint) {
+    if (part_grid_in_bounds(target)) {
+        // The selected list gets priority when searching both
+        if (search_hint != SEARCH_UNSELECTED) {
+            const part_handle handle = part_grid_get(&editor->selected_grid, editor->selected_parts, target);
+            if (handle != 0) {
+                return (part_entry*)list_get_element(editor->selected_parts, handle - 1);
+            }
+        }
+        if (search_hint != SEARCH_SELECTED) {
+            const part_handle handle = part_grid_get(&editor->vacancy_grid, editor->unselected_parts, target);
+            if (handle != 0) {
+                return (part_entry*)list_get_element(editor->unselected_parts, handle - 1);
             }
         }
     }
@@ -371,15 +857,14 @@ part_entry* part_by_pos(editor_state* editor, vec3s8 target, partsearch_type sea
 }
 
 bool vehicle_move_part(editor_state* editor, part_entry part, vec3s16 diff, vec3s16* adjust_out) {
-    s64 idx = list_find(editor->selected_parts, &part);
-    if (idx == -1) {
-        // If for some reason we're moving an unselected part, handle that
-        idx = list_find(editor->unselected_parts, &part);
-        if (idx == -1) {
-            return false;
-        }
+    bool selected = false;
+    u32 idx = 0;
+    if (!part_locate(editor, &part, &selected, &idx)) {
+        return false;
     }
-    part_entry* p = (part_entry*) list_get_element(editor->selected_parts, idx);
+    const part_layer layer = selected ? layer_selected(editor) : layer_unselected(editor);
+    part_entry* p = (part_entry*) list_get_element(*layer.parts, idx);
+    part_grid_replace(layer, *p, idx + 1, 0);
 
     bool needed_readjustment = false;
     // We loop over the 3 axes here
@@ -426,8 +911,83 @@ bool vehicle_move_part(editor_state* editor, part_entry part, vec3s16 diff, vec3
         }
     }
 
+    if (needed_readjustment) {
+        // Everything moved, so it's easier to start over
+        update_part_grids(editor);
+    }
+    else {
+        part_grid_stamp(layer, *p, idx + 1);
+    }
+
     // Return bool result on if the part moved out of bounds and had to be adjusted
     return needed_readjustment;
 }
 
 
+
+bool vehicle_move_selection(editor_state* editor, vec3s16 diff, vec3s16* adjust_out) {
+    if (list_empty(editor->selected_parts)) {
+        return false;
+    }
+
+    // Find the box around every selected cell, without any of the clamping
+    // the cell iterator does. If the whole box stays in bounds, every part
+    // moves by the same amount and nothing else in the vehicle is touched.
+    vec3s16 min = {INT16_MAX, INT16_MAX, INT16_MAX};
+    vec3s16 max = {INT16_MIN, INT16_MIN, INT16_MIN};
+    bool uniform = true;
+    for (u32 i = 0; i < editor->selected_parts.end_idx; i++) {
+        const part_entry* p = list_get_element(editor->selected_parts, i);
+        const part_cells cells = part_get_cells(p->id, part_orientation_from_euler(p->rot));
+        for (u32 c = 0; c < cells.count; c++) {
+            for (u8 axis = 0; axis < 3; axis++) {
+                const s16 pos = p->pos.raw[axis] + cells.cells[c].raw[axis];
+                min.raw[axis] = MIN(min.raw[axis], pos);
+                max.raw[axis] = MAX(max.raw[axis], pos);
+            }
+        }
+        for (u8 axis = 0; axis < 3; axis++) {
+            // vehicle_move_part() won't move parts onto the last row
+            uniform &= (p->pos.raw[axis] + diff.raw[axis] < VEH_MAX_DIM - 1);
+        }
+    }
+    for (u8 axis = 0; axis < 3; axis++) {
+        uniform &= (min.raw[axis] >= 0 && max.raw[axis] < VEH_MAX_DIM);
+        uniform &= (min.raw[axis] + diff.raw[axis] >= 0 && max.raw[axis] + diff.raw[axis] < VEH_MAX_DIM);
+    }
+
+    if (!uniform) {
+        // Some part hits an edge, let vehicle_move_part() sort it out one part
+        // at a time.
+        bool needed_adjust = false;
+        part_iterator iter = part_iterator_setup(*editor, SEARCH_SELECTED);
+        while (!iter.done) {
+            part_entry* p = part_iterator_next(&iter);
+            vec3s16 adjustment = {0};
+            needed_adjust |= vehicle_move_part(editor, *p, diff, &adjustment);
+            if (adjust_out != NULL) {
+                for (u8 axis = 0; axis < 3; axis++) {
+                    adjust_out->raw[axis] += adjustment.raw[axis];
+                }
+            }
+        }
+        return needed_adjust;
+    }
+
+    // Take every part out of the grid before putting any back, so parts
+    // moving into each other's old cells don't get erased.
+    const part_layer layer = layer_selected(editor);
+    for (u32 i = 0; i < editor->selected_parts.end_idx; i++) {
+        const part_entry* p = list_get_element(editor->selected_parts, i);
+        part_grid_replace(layer, *p, i + 1, 0);
+    }
+    for (u32 i = 0; i < editor->selected_parts.end_idx; i++) {
+        part_entry* p = list_get_element(editor->selected_parts, i);
+        for (u8 axis = 0; axis < 3; axis++) {
+            p->pos.raw[axis] += diff.raw[axis];
+        }
+        part_grid_stamp(layer, *p, i + 1);
+    }
+
+    return false;
+}
@@ -20,8 +20,8 @@ typedef enum {
 }partsearch_type;
 
 typedef struct {
-    part_info info;
-    part_entry part;
+    part_cells cells; // Already rotated to the part's orientation
+    vec3s8 origin;
     bool done;
     u32 cell_idx;
 }part_cell_iterator;
@@ -34,10 +34,43 @@ typedef struct {
     bool done;
 }part_iterator;
 
+typedef struct {
+    const vehicle_bitmask* mask;
+    u32 brick_idx;
+    u8 slice; // Current word in the brick
+    u64 bits; // Bits in the current word we haven't returned yet
+    bool done;
+}vehiclemask_iterator;
+
+// Create an empty vehicle bitmask. Free it with vehiclemask_destroy().
+vehicle_bitmask vehiclemask_create();
+void vehiclemask_destroy(vehicle_bitmask* mask);
+
 // Safely get & set values from vehicle bitmask (with bounds checking)
-bool vehiclemask_get_3d(vehicle_bitmask* mask, vec3s8 cell);
+bool vehiclemask_get_3d(const vehicle_bitmask* mask, vec3s8 cell);
 void vehiclemask_set_3d(vehicle_bitmask* mask, vec3s8 cell, u8 val);
 
+// Zero the whole mask & reset its bounds
+void vehiclemask_clear(vehicle_bitmask* mask);
+
+// Whether any cell is set in both masks
+bool vehiclemask_overlap(const vehicle_bitmask* a, const vehicle_bitmask* b);
+
+// Go through every set cell in a mask, in no particular order. The mask can't
+// be changed while iterating.
+vehiclemask_iterator vehiclemask_iterator_setup(const vehicle_bitmask* mask);
+vec3s8 vehiclemask_iterator_next(vehiclemask_iterator* ctx);
+
+// Turn a mask into line segments outlining its outside faces, merging faces
+// next to each other into bigger rectangles. Each pair of vec3s in
+// [vertices] is a line, in cell corner coordinates (a cell's center is at
+// +0.5 on every axis). The list is cleared first.
+void vehiclemask_build_wireframe(const vehicle_bitmask* mask, list* vertices);
+
+// Create an empty part grid. Free it with part_grid_destroy().
+part_grid part_grid_create();
+void part_grid_destroy(part_grid* grid);
+
 bool cell_is_selected(editor_state* editor, vec3s8 cell);
 
 // Uses part data to find the centerpoint of a vehicle.
@@ -52,9 +85,13 @@ bool vehicle_rotate_selection(editor_state* editor, s8 forward_diff, s8 side_dif
 // Check if the selected parts overlap with the rest of the vehicle
 bool vehicle_selection_overlap(editor_state* editor);
 
-// Wipe & reconstruct individual 3d grids from scratch
+// Wipe & reconstruct the part grid & bitmask for one list from scratch.
+// Everything that edits the part lists keeps these up to date, so this is only
+// needed after loading or when the whole vehicle moves.
 void update_selectionmask(editor_state* editor);
 void update_vacancymask(editor_state* editor);
+// Both of the above
+void update_part_grids(editor_state* editor);
 
 // Setup an iterator from a part entry. Returns an iteration context.
 // There's no need to free the iteration context.
@@ -72,6 +109,19 @@ part_entry* part_iterator_next(part_iterator* ctx);
 // Returns an all-zero part on failure.
 part_entry* part_by_pos(editor_state* editor, vec3s8 target, partsearch_type search_hint);
 
+// These move parts between the selected & unselected lists, keeping the part
+// grids in sync. |p| can point into either list, parts that aren't in the
+// expected list (or the empty part) are ignored.
+void vehicle_select_part(editor_state* editor, const part_entry* p);
+void vehicle_unselect_part(editor_state* editor, const part_entry* p);
+void vehicle_delete_part(editor_state* editor, const part_entry* p);
+
+// Add a new part to the vehicle. It starts out selected.
+void vehicle_add_part(editor_state* editor, part_entry p);
+
+// Put down the selection, moving every selected part to the unselected list
+void vehicle_place_selection(editor_state* editor);
+
 // Move a part by a 3D vector. If the new position is out of bounds (< 0), that
 // position will be the new zero and the other parts are adjusted accordingly.
 // If the vehicle was adjusted, writes to an output vector to indicate the
@@ -79,5 +129,11 @@ part_entry* part_by_pos(editor_state* editor, vec3s8 target, partsearch_type sea
 // Returns a boolean indicating if the vehicle had to be adjusted.
 bool vehicle_move_part(editor_state* editor, part_entry part, vec3s16 diff, vec3s16* adjust_out);
 
+// Move every selected part by a 3D vector. Works like vehicle_move_part() on
+// each part, but when nothing is near the edges the parts are moved in place
+// without searching the lists for each one.
+// The adjustment vector is added to [adjust_out] if it's not NULL.
+bool vehicle_move_selection(editor_state* editor, vec3s16 diff, vec3s16* adjust_out);
+
 #endif // VEHICLE_EDIT_H
 
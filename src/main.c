@@ -19,12 +19,22 @@
 #include "vehicle.h"
 #include "parts.h"
 #include "physfs_bundling.h"
+#include "scan.h"
 
 int main(int argc, char** argv) {
     enable_win_ansi(); // Enable color & extra terminal features on Windows
+    if (!parts_init()) {
+        LOG_MSG(error, "Failed to build part tables\n");
+        return 1;
+    }
+    if (argc == 3 && strcmp(argv[1], "scan") == 0) {
+        // Headless mode, we never open a window for this
+        return scan_vehicles(argv[2], 0) ? 0 : 1;
+    }
     if (argc != 2) {
         LOG_MSG(error, "No input files.\n");
         LOG_MSG(info, "Usage: garage [vehicle file]\n");
+        LOG_MSG(info, "       garage scan [folder]\n");
         return 1;
     }
     if (strcmp(argv[1], "--dump-assets") == 0) {
@@ -89,6 +99,7 @@ int main(int argc, char** argv) {
 
         // Render
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        editor_upload_camera(&editor);
         garage_render(&garage, &editor);
         debug_render(&editor);
         ui_update_render(&editor);
@@ -133,7 +144,7 @@ int main(int argc, char** argv) {
     while (!iter.done) {
         i++;
         part_entry* p = part_iterator_next(&iter);
-        LOG_MSG(info, "Part %d: 0x%x [%s] ", i, p->id, part_get_info(p->id).name);
+        LOG_MSG(info, "Part %d: 0x%x [%s] ", i, p->id, part_get_info(p->id)->name);
         printf("@ (%d, %d, %d) ", p->pos.x, p->pos.y, p->pos.z);
         printf("painted #%x%x%x", p->color.r, p->color.g, p->color.b);
         printf(", modifier 0x%02hx\n", p->modifier);
@@ -1,18 +1,30 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 #include <common/endian.h>
+#include <common/logging.h>
 
 #include "parts.h"
 
-obj_path part_get_obj_path(u32 id) {
+static obj_path part_get_path(u32 id, const char* extension) {
     obj_path out = {0};
 
     ENDIAN_FLIP(u32, id);
-    snprintf(out.str, sizeof(out.str), "bin/%08X.obj", id);
+    snprintf(out.str, sizeof(out.str), "bin/%08X%s", id, extension);
 
     return out;
 }
 
+obj_path part_get_obj_path(u32 id) {
+    return part_get_path(id, ".obj");
+}
+
+obj_path part_get_mesh_path(u32 id) {
+    return part_get_path(id, ".mesh");
+}
+
 const part_info partdata[NUM_PARTS + 1] = {
     // Seats
     {
@@ -663,12 +675,248 @@ const part_info partdata[NUM_PARTS + 1] = {
     },
 };
 
-part_info part_get_info(part_id id) {
+// Every part ID is a case label here, so if two parts ever share an ID the
+// compiler refuses to build this (duplicate case value). It's never called.
+static inline void part_ids_must_be_unique(part_id id) {
+    switch (id) {
+        case SEAT_STANDARD: case SEAT_PASSENGER_SMALL:
+        case SEAT_PASSENGER_LARGE: case SEAT_STRONG: case SEAT_SCUBA:
+        case SEAT_SUPER: case WHEEL_STANDARD: case WHEEL_HIGH_GRIP:
+        case WHEEL_MONSTER: case WHEEL_SUPER: case ENGINE_SMALL:
+        case ENGINE_MEDIUM: case ENGINE_LARGE: case ENGINE_SUPER: case SAIL:
+        case JET_SMALL: case JET_LARGE: case FUEL_SMALL: case FUEL_MEDIUM:
+        case FUEL_LARGE: case FUEL_SUPER: case TRAY: case BOX: case BOX_LARGE:
+        case TRAY_LARGE: case AMMO_SMALL: case AMMO_MEDIUM: case AMMO_LARGE:
+        case AMMO_SUPER: case LIGHT_CUBE: case LIGHT_WEDGE: case LIGHT_CORNER:
+        case LIGHT_POLE: case LIGHT_L_POLE: case LIGHT_T_POLE:
+        case LIGHT_PANEL: case LIGHT_L_PANEL: case LIGHT_T_PANEL:
+        case HEAVY_CUBE: case HEAVY_WEDGE: case HEAVY_CORNER: case HEAVY_POLE:
+        case HEAVY_L_POLE: case HEAVY_T_POLE: case HEAVY_PANEL:
+        case HEAVY_L_PANEL: case HEAVY_T_PANEL: case SUPER_CUBE:
+        case SUPER_WEDGE: case SUPER_CORNER: case SUPER_POLE:
+        case SUPER_L_POLE: case SUPER_T_POLE: case SUPER_PANEL:
+        case SUPER_L_PANEL: case SUPER_T_PANEL: case AERIAL: case GYROSCOPE:
+        case SPOTLIGHT: case SELF_DESTRUCT: case SPEC_O_SPY: case CHAMELEON:
+        case ROBO_FIX: case STICKY_BALL: case LIQUID_SQUIRTER: case SPOILER:
+        case SUCK_N_BLOW: case VACUUM: case SPRING: case DETACHER:
+        case SEAT_EJECTOR: case TOW_BAR: case HORN: case REPLENISHER:
+        case BUMPER: case ARMOR: case ENERGY_SHIELD: case SMOKE_SPHERE:
+        case WING_STANDARD: case WING_FOLDING: case BALLOON: case FLOATER:
+        case PROPELLER_SMALL: case PROPELLER_LARGE: case PROPELLER_FOLDING:
+        case SINKER: case AIR_CUSHION: case TURRET_EGG: case WELDARS_BREATH:
+        case GUN_EGG: case GUN_GRENADE: case RUST_BIN: case TURRET_GRENADE:
+        case TORPEDO: case LASER: case FREEZEEZY: case MUMBO_BOMBO:
+        case CLOCKWORK_KAZ: case EMP: case CITRUS_SLICK: case FULGORES_FIST:
+        case BOOT_IN_A_BOX: case SPIKE: case CRUISIN_LIGHT: case PLANT_POT:
+        case SPIRIT_OF_PANTS: case WINDSHIELD: case MIRROR: case TAG_PLATE:
+        case PAPERY_PAL: case RADIO: case BEACON: case DISCO_BALL: case FLAG:
+        case FLUFFY_DICE: case GOLDFISH: case GOOGLY_EYES: case MOLE_ON_A_POLE:
+        case WHEEL_CATERPILLAR: case AUTOPILOT: case REMOTE_CONTROLLER:
+        case SAWBLADE:
+        break;
+    }
+}
+
+// Rotation matrices for the 24 orientations. These are all the 3x3 matrices
+// with one +1/-1 in each row and column (a permutation of the axes with some
+// flipped), except the mirror images.
+static s8 orientations[PART_ORIENTATIONS][3][3];
+
+// Orientation index for every combination of quarter turns around X, Y and Z
+static u8 euler_to_orientation[4][4][4];
+
+enum {
+    PART_HASH_BITS = 9,
+    PART_HASH_SIZE = 1 << PART_HASH_BITS,
+};
+
+// Part IDs are hashed by multiplying and keeping the top bits. This multiplier
+// was brute-forced so every ID in partdata gets its own slot. New parts might
+// collide, which still works (we probe to the next slot), but it'll log a
+// warning so you know to find a new multiplier.
+static const u32 PART_HASH_MULT = 0x167C2379;
+
+// Index into partdata + 1 for each hash slot. 0 means empty.
+static u8 part_hash_table[PART_HASH_SIZE];
+
+// Cells of every part in every orientation, packed back to back. Each part has
+// the same number of cells in each orientation.
+static vec3s8* cell_pool = NULL;
+static u32 cell_start[ARRAY_SIZE(partdata)]; // First cell of orientation 0
+static u32 cell_count[ARRAY_SIZE(partdata)];
+
+static void mat3s8_mul(const s8 a[3][3], const s8 b[3][3], s8 out[3][3]) {
+    for (u32 r = 0; r < 3; r++) {
+        for (u32 c = 0; c < 3; c++) {
+            out[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c];
+        }
+    }
+}
+
+static s32 mat3s8_det(const s8 m[3][3]) {
+    return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+         - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+         + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+static void part_orientations_build() {
+    // Every ordering of the 3 axes, starting with no change so that index 0 is
+    // the identity
+    static const u8 perms[6][3] = {
+        {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0},
+    };
+    u32 count = 0;
+    for (u32 p = 0; p < ARRAY_SIZE(perms); p++) {
+        for (u32 signs = 0; signs < 8; signs++) {
+            s8 m[3][3] = {0};
+            for (u32 r = 0; r < 3; r++) {
+                m[r][perms[p][r]] = (signs & (1 << r)) ? -1 : 1;
+            }
+            // Determinant of -1 would be a mirror, which isn't a rotation
+            if (mat3s8_det(m) == 1) {
+                memcpy(orientations[count++], m, sizeof(m));
+            }
+        }
+    }
+
+    // Same convention as glm_euler_xyz_quat(), which the game's rotations
+    // were matched against: rotate around Z, then Y, then X.
+    static const s8 cos_quarter[4] = {1, 0, -1, 0};
+    static const s8 sin_quarter[4] = {0, 1, 0, -1};
+    for (u32 x = 0; x < 4; x++) {
+        for (u32 y = 0; y < 4; y++) {
+            for (u32 z = 0; z < 4; z++) {
+                const s8 rx[3][3] = {
+                    {1, 0, 0},
+                    {0, cos_quarter[x], -sin_quarter[x]},
+                    {0, sin_quarter[x], cos_quarter[x]},
+                };
+                const s8 ry[3][3] = {
+                    {cos_quarter[y], 0, sin_quarter[y]},
+                    {0, 1, 0},
+                    {-sin_quarter[y], 0, cos_quarter[y]},
+                };
+                const s8 rz[3][3] = {
+                    {cos_quarter[z], -sin_quarter[z], 0},
+                    {sin_quarter[z], cos_quarter[z], 0},
+                    {0, 0, 1},
+                };
+                s8 rxy[3][3] = {0};
+                s8 m[3][3] = {0};
+                mat3s8_mul(rx, ry, rxy);
+                mat3s8_mul(rxy, rz, m);
+                for (u8 i = 0; i < PART_ORIENTATIONS; i++) {
+                    if (memcmp(orientations[i], m, sizeof(m)) == 0) {
+                        euler_to_orientation[x][y][z] = i;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static u32 part_hash(u32 id) {
+    return (id * PART_HASH_MULT) >> (32 - PART_HASH_BITS);
+}
+
+static void part_hash_build() {
+    static_assert(ARRAY_SIZE(partdata) < UINT8_MAX, "Too many parts for the hash table!");
     for (u32 i = 0; i < ARRAY_SIZE(partdata); i++) {
+        u32 slot = part_hash(partdata[i].id);
+        while (part_hash_table[slot] != 0) {
+            LOG_MSG(warning, "%s collides with %s in the part hash table\n", partdata[i].name, partdata[part_hash_table[slot] - 1].name);
+            slot = (slot + 1) % PART_HASH_SIZE;
+        }
+        part_hash_table[slot] = i + 1;
+    }
+}
+
+// Find a part's index in partdata, or the placeholder at the end if it's unknown
+static u32 part_index(part_id id) {
+    u32 slot = part_hash(id);
+    while (part_hash_table[slot] != 0) {
+        const u32 i = part_hash_table[slot] - 1;
         if (partdata[i].id == id) {
-            return partdata[i];
+            return i;
+        }
+        slot = (slot + 1) % PART_HASH_SIZE;
+    }
+    return ARRAY_SIZE(partdata) - 1;
+}
+
+static bool part_cells_build() {
+    // Count first so we only need one allocation
+    u32 total = 0;
+    for (u32 i = 0; i < ARRAY_SIZE(partdata); i++) {
+        const vec3s8* occupied = partdata[i].relative_occupation;
+        u32 count = 0;
+        while (count < PART_MAX_VOLUME && !vec3s8_eq(occupied[count], (vec3s8){0})) {
+            count++;
+        }
+        cell_start[i] = total;
+        cell_count[i] = count + 1; // +1 for the origin
+        total += cell_count[i] * PART_ORIENTATIONS;
+    }
+
+    cell_pool = calloc(total, sizeof(*cell_pool));
+    if (cell_pool == NULL) {
+        LOG_MSG(error, "Failed to allocate %d part cells\n", total);
+        return false;
+    }
+
+    for (u32 i = 0; i < ARRAY_SIZE(partdata); i++) {
+        for (u32 o = 0; o < PART_ORIENTATIONS; o++) {
+            const s8 (*m)[3] = orientations[o];
+            vec3s8* out = &cell_pool[cell_start[i] + (o * cell_count[i])];
+            // The last cell is the origin, which calloc() already zeroed
+            for (u32 c = 0; c < cell_count[i] - 1; c++) {
+                const vec3s8 in = partdata[i].relative_occupation[c];
+                for (u32 r = 0; r < 3; r++) {
+                    out[c].raw[r] = m[r][0] * in.x + m[r][1] * in.y + m[r][2] * in.z;
+                }
+            }
         }
     }
+    return true;
+}
+
+bool parts_init() {
+    // Safe to call again, as long as it's from the same thread
+    if (cell_pool != NULL) {
+        return true;
+    }
+    part_hash_build();
+    part_orientations_build();
+    return part_cells_build();
+}
+
+const part_info* part_get_info(part_id id) {
+    // The hash table doesn't depend on the allocation in part_cells_build(),
+    // so even if that failed, it's fine to use
+    return &partdata[part_index(id)];
+}
+
+u8 part_orientation_from_euler(const float rot[3]) {
+    const float QUARTER_TURN = 1.57079632679f; // 90 degrees in radians
+    u32 quarters[3] = {0};
+    for (u32 i = 0; i < 3; i++) {
+        // Negative turns wrap around properly with the mask
+        quarters[i] = (u32)lroundf(rot[i] / QUARTER_TURN) & 3;
+    }
+    return euler_to_orientation[quarters[0]][quarters[1]][quarters[2]];
+}
+
+part_cells part_get_cells(part_id id, u8 orientation) {
+    if (cell_pool == NULL) {
+        // parts_init() failed or was never called
+        return (part_cells){0};
+    }
 
-    return partdata[ARRAY_SIZE(partdata) - 1];
+    const u32 i = part_index(id);
+    orientation %= PART_ORIENTATIONS;
+    return (part_cells) {
+        .cells = &cell_pool[cell_start[i] + (orientation * cell_count[i])],
+        .count = cell_count[i],
+    };
 }
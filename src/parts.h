@@ -9,7 +9,8 @@
 
 // Part IDs are written are as they appear in the hex editor, in the order of
 // the in-game menu. Use part_get_info() to get a string for a part ID.
-// Anything I don't know the ID of is set to zero.
+// Anything I don't know the ID of gets a unique placeholder starting with
+// 0xCCCCCC, so they can still be told apart.
 typedef enum {
     // <== Seats ==>
     SEAT_STANDARD        = 0x1FEA444A,
@@ -98,9 +99,9 @@ typedef enum {
     SELF_DESTRUCT   = 0x1F583430,
     SPEC_O_SPY      = 0x1F0002C7,
     // Unknown IDs
-    CHAMELEON       = 0xCCCCCCCC,
-    ROBO_FIX        = 0xCCCCCCCC,
-    STICKY_BALL     = 0xCCCCCCCC,
+    CHAMELEON       = 0xCCCCCC01,
+    ROBO_FIX        = 0xCCCCCC02,
+    STICKY_BALL     = 0xCCCCCC03,
 
     LIQUID_SQUIRTER = 0x1F41AAC0,
     SPOILER         = 0x1FB56B94,
@@ -118,7 +119,7 @@ typedef enum {
     ARMOR         = 0x1F2BF215,
     ENERGY_SHIELD = 0x1F953740,
     // Unknown ID
-    SMOKE_SPHERE  = 0xCCCCCCCC,
+    SMOKE_SPHERE  = 0xCCCCCC04,
 
     // <== Fly & Float ==>
         // Fly & Float -> Wings
@@ -153,7 +154,7 @@ typedef enum {
         CLOCKWORK_KAZ  = 0x1F603CC3,
         EMP            = 0x1F31CA4C,
         // Unknown ID
-        CITRUS_SLICK   = 0xCCCCCCCC,
+        CITRUS_SLICK   = 0xCCCCCC05,
 
         // Weapons -> Ammo-Free
         FULGORES_FIST = 0x1F4BC61E,
@@ -172,31 +173,35 @@ typedef enum {
     RADIO           = 0x1F97C327,
 
     // <== Stop N' Swop ==>
-    BEACON          = 0xCCCCCCCC,
-    DISCO_BALL      = 0xCCCCCCCC,
-    FLAG            = 0xCCCCCCCC,
-    FLUFFY_DICE     = 0xCCCCCCCC,
+    BEACON          = 0xCCCCCC06,
+    DISCO_BALL      = 0xCCCCCC07,
+    FLAG            = 0xCCCCCC08,
+    FLUFFY_DICE     = 0xCCCCCC09,
     GOLDFISH        = 0x1FE338DD,
-    GOOGLY_EYES     = 0xCCCCCCCC,
-    MOLE_ON_A_POLE  = 0xCCCCCCCC,
+    GOOGLY_EYES     = 0xCCCCCC0A,
+    MOLE_ON_A_POLE  = 0xCCCCCC0B,
 
     // <== Unused ==>
-    WHEEL_CATERPILLAR = 0xCCCCCCCC,
-    AUTOPILOT         = 0xCCCCCCCC,
-    REMOTE_CONTROLLER = 0xCCCCCCCC,
-    SAWBLADE          = 0xCCCCCCCC,
+    WHEEL_CATERPILLAR = 0xCCCCCC0C,
+    AUTOPILOT         = 0xCCCCCC0D,
+    REMOTE_CONTROLLER = 0xCCCCCC0E,
+    SAWBLADE          = 0xCCCCCC0F,
 }part_id;
 
 enum {
     NUM_PARTS = 122,
     CONNECT_MASK = 8,
     PART_MAX_VOLUME = 8 * 7 * 2, // The largest part in the game is 8x7x2
+    // Parts can only be placed at 90 degree angles, which gives 6 directions
+    // to face * 4 ways to turn around that direction.
+    PART_ORIENTATIONS = 24,
 };
 
 // This only exists to let us return an array without the compiler complaining
 typedef struct {
-    // String in the format "bin/00000000.obj" (with numbers matching a part ID)
-    char str[sizeof("bin/") + 8 + sizeof(".obj") + 1];
+    // String in the format "bin/00000000.obj" (with numbers matching a part ID),
+    // or the same with ".mesh" at the end
+    char str[sizeof("bin/") + 8 + sizeof(".mesh")];
 }obj_path;
 
 typedef struct {
@@ -220,12 +225,39 @@ typedef struct {
 // ARRAY_SIZE() for your upper bound. Otherwise, use NUM_PARTS.
 extern const part_info partdata[NUM_PARTS + 1];
 
-// Returns a struct with info about a part so I don't have to make multiple
-// 300+ line switch statements
-part_info part_get_info(part_id id);
+// Build the lookup tables behind part_get_info() & friends. Call this once at
+// startup, before starting any threads. Returns false if an allocation failed,
+// in which case part_get_cells() will give every part 0 cells.
+bool parts_init();
+
+// Returns info about a part so I don't have to make multiple 300+ line switch
+// statements. This is a hash table lookup, so it's fine to call it a lot.
+// Unknown IDs get the "[Unknown/Missing part]" entry at the end of partdata.
+const part_info* part_get_info(part_id id);
+
+// The cells a part occupies at one orientation, relative to its origin. The
+// origin itself is always the last cell.
+typedef struct {
+    const vec3s8* cells;
+    u32 count;
+}part_cells;
+
+// Snap an Euler rotation (XYZ order, in radians, like part_entry.rot) to the
+// nearest 90 degrees and get its orientation index [0, PART_ORIENTATIONS).
+// Orientation 0 is always no rotation.
+u8 part_orientation_from_euler(const float rot[3]);
+
+// Get a part's cells, already rotated to an orientation. parts_init() rotates
+// every part's cells into all 24 orientations, so it's just a table lookup.
+// The table lives until the program exits.
+part_cells part_get_cells(part_id id, u8 orientation);
 
 // Get the path to an OBJ file in a "bin" folder named with the hex ID. For
 // example, part ID 0x1F207106 would output "bin/1F207106.obj"
 obj_path part_get_obj_path(u32 id);
+
+// Same as part_get_obj_path(), but for the baked mesh (see mesh_load()).
+// For example, part ID 0x1F207106 would output "bin/1F207106.mesh"
+obj_path part_get_mesh_path(u32 id);
 #endif // PART_IDS_H
 
@@ -11,6 +11,8 @@
 #include <common/logging.h>
 #include <common/int.h>
 
+#include "physfs_bundling.h"
+
 INCBIN(asset_archive, "data.zip");
 
 bool setup_physfs(const char* argv0) {
@@ -54,6 +56,10 @@ void dump_assets() {
 }
 
 u8* physfs_load_file(const char* path) {
+    return physfs_load_file_sized(path, NULL);
+}
+
+u8* physfs_load_file_sized(const char* path, u64* size) {
     PHYSFS_File* resource = PHYSFS_openRead(path);
     if (resource == NULL) {
         LOG_MSG(error, "Failed to open \"%s\" via PHYSFS!\n", path);
@@ -74,6 +80,12 @@ u8* physfs_load_file(const char* path) {
     PHYSFS_close(resource);
     // LOG_MSG(debug, "Loaded %s from real path %s\n", path, PHYSFS_getRealDir(path));
 
+    if (size != NULL) {
+        *size = filesize;
+    }
     return data;
 }
 
+bool physfs_exists(const char* path) {
+    return PHYSFS_exists(path);
+}
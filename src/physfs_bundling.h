@@ -15,5 +15,15 @@ void dump_assets();
 /// \return Pointer to buffer, or NULL on failure.
 u8* physfs_load_file(const char* path);
 
+/// Same as physfs_load_file(), but also gives the size of the file.
+/// \param path Filepath
+/// \param size Receives the size of the file (not including the extra zero
+/// byte added to the end). Can be NULL.
+/// \return Pointer to buffer, or NULL on failure.
+u8* physfs_load_file_sized(const char* path, u64* size);
+
+/// Whether a file exists in the virtual filesystem
+bool physfs_exists(const char* path);
+
 #endif // #ifndef PHYSFS_BUNDLING_H
 
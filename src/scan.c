@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common/file.h"
+#include "common/list.h"
+#include "common/logging.h"
+#include "common/thread.h"
+
+#include "scan.h"
+#include "vehicle.h"
+
+enum {
+    // Way bigger than any vehicle or vehicle save can be
+    SCAN_MAX_FILE_SIZE = 0x400000,
+};
+
+typedef struct {
+    char* path;
+    vehicle_format format;
+    bool loaded;
+    char name[0x20 + 1]; // Vehicle name squashed down to ASCII
+    u16 part_count;
+    float weight;
+}scan_result;
+
+static void scan_add_path(const char* path, void* ctx) {
+    list* paths = ctx;
+    const size_t len = strlen(path) + 1;
+    char* copy = malloc(len);
+    if (copy == NULL) {
+        return;
+    }
+    memcpy(copy, path, len);
+    list_add(paths, &copy);
+}
+
+static int scan_compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Only called from the worker threads. Each job writes to its own result, so
+// there's nothing to lock.
+static void scan_job(void* ctx, u32 job) {
+    scan_result* r = &((scan_result*)ctx)[job];
+    // Most files in a content folder aren't vehicles, so only read enough to
+    // tell before loading the whole thing.
+    u8 head[VEHICLE_FORMAT_PEEK_SIZE] = {0};
+    u64 size = 0;
+    const u32 head_size = file_load_head(r->path, head, sizeof(head), &size);
+    r->format = vehicle_get_format(head, head_size);
+    // Anything huge is from some other game, even if the magic matches
+    if (r->format == VEHICLE_FORMAT_NONE || size > SCAN_MAX_FILE_SIZE) {
+        r->format = VEHICLE_FORMAT_NONE;
+        return;
+    }
+    u8* data = file_load_sized(r->path, &size);
+    if (data == NULL) {
+        return;
+    }
+    // Saves from other games aren't failures, they just aren't vehicles
+    if (r->format == VEHICLE_FORMAT_STFS && !vehicle_stfs_has_vehicle(data, size)) {
+        r->format = VEHICLE_FORMAT_NONE;
+        free(data);
+        return;
+    }
+
+    vehicle* v = vehicle_load_buffer(data, size);
+    free(data);
+    if (v == NULL) {
+        return;
+    }
+    r->loaded = true;
+    r->part_count = v->head.part_count;
+    r->weight = v->head.weight;
+
+    // The table is printed with printf(), so anything outside ASCII is
+    // replaced instead of trying to deal with UTF-16.
+    for (u32 i = 0; i < ARRAY_SIZE(v->head.name) && v->head.name[i] != 0; i++) {
+        const c16 c = v->head.name[i];
+        r->name[i] = (c >= ' ' && c < 0x7F) ? (char)c : '?';
+    }
+    free(v);
+}
+
+bool scan_vehicles(const char* dir, u32 thread_count) {
+    list paths = list_create(sizeof(char*) * 64, sizeof(char*));
+    if (paths.data == 0) {
+        return false;
+    }
+    if (!dir_walk(dir, scan_add_path, &paths)) {
+        free((void*)paths.data);
+        return false;
+    }
+
+    // Sort so the output is the same every time, no matter what order the OS
+    // listed the files in.
+    const u32 count = paths.end_idx;
+    char** sorted = (char**)paths.data;
+    qsort(sorted, count, sizeof(*sorted), scan_compare_paths);
+
+    scan_result* results = calloc(count, sizeof(*results));
+    if (results == NULL && count > 0) {
+        LOG_MSG(error, "Failed to allocate results for %d files\n", count);
+        for (u32 i = 0; i < count; i++) {
+            free(sorted[i]);
+        }
+        free((void*)paths.data);
+        return false;
+    }
+    for (u32 i = 0; i < count; i++) {
+        results[i].path = sorted[i];
+    }
+
+    LOG_MSG(info, "Scanning %d files in %s\n", count, dir);
+    thread_pool* pool = thread_pool_create(thread_count);
+    thread_pool_run(pool, count, scan_job, results);
+    thread_pool_destroy(pool);
+
+    u32 vehicle_count = 0;
+    u32 fail_count = 0;
+    printf("\n%-32s %6s %10s %-6s %s\n", "Name", "Parts", "Weight", "Format", "Path");
+    for (u32 i = 0; i < count; i++) {
+        const scan_result* r = &results[i];
+        if (r->format == VEHICLE_FORMAT_NONE) {
+            continue;
+        }
+        if (!r->loaded) {
+            printf("%-32s %6s %10s %-6s %s\n", "(failed to load)", "-", "-", vehicle_format_name(r->format), r->path);
+            fail_count++;
+            continue;
+        }
+        printf("%-32s %6d %10.2f %-6s %s\n", r->name, r->part_count, r->weight, vehicle_format_name(r->format), r->path);
+        vehicle_count++;
+    }
+    printf("\n");
+    LOG_MSG(info, "%d vehicles loaded, %d failed, %d other files skipped\n", vehicle_count, fail_count, count - vehicle_count - fail_count);
+
+    for (u32 i = 0; i < count; i++) {
+        free(results[i].path);
+    }
+    free(results);
+    free((void*)paths.data);
+    return fail_count == 0;
+}
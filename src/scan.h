@@ -0,0 +1,15 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <stdbool.h>
+
+#include "common/int.h"
+
+// Headless mode for going through lots of vehicles at once, like a whole
+// Xenia content folder or a USB drive's Content tree. Every file under |dir|
+// that looks like a vehicle (raw or STFS) is loaded on a thread pool, then a
+// summary table is printed.
+// A thread_count of 0 means one thread per CPU. Returns false if the directory
+// couldn't be read or any vehicle failed to load.
+bool scan_vehicles(const char* dir, u32 thread_count);
+
+#endif // SCAN_H
@@ -1,56 +1,75 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stddef.h>
 
 #include "common/endian.h"
 #include "common/logging.h"
+#include "common/platform.h"
 
 #include "stfs.h"
 #include "common/sha1.h"
 
+static const endian_field stfs_header_fields[] = {
+    ENDIAN_FIELD(stfs_header, pubkey_cert_size, 2),
+    ENDIAN_FIELD(stfs_header, public_exponent, 4),
+    {
+        offsetof(stfs_header, meta.licenses[0].id), sizeof(s64),
+        ARRAY_SIZE(((stfs_meta*)0)->licenses), sizeof(stfs_license)
+    },
+    ENDIAN_FIELD(stfs_header, meta.header_size, 4),
+    ENDIAN_FIELD(stfs_header, meta.pkg_type, 4),
+    ENDIAN_FIELD(stfs_header, meta.meta_version, 4),
+    ENDIAN_FIELD(stfs_header, meta.content_size, 8),
+    ENDIAN_FIELD(stfs_header, meta.media_id, 4),
+    ENDIAN_FIELD(stfs_header, meta.version, 4),
+    ENDIAN_FIELD(stfs_header, meta.base_version, 4),
+    ENDIAN_FIELD(stfs_header, meta.title_id, 4),
+    ENDIAN_FIELD(stfs_header, meta.savegame_id, 4),
+    ENDIAN_FIELD(stfs_header, meta.vol_desc.file_block_num, 3),
+    ENDIAN_FIELD(stfs_header, meta.vol_desc.allocated_block_count, 4),
+    ENDIAN_FIELD(stfs_header, meta.vol_desc.unallocated_block_count, 4),
+    ENDIAN_FIELD(stfs_header, meta.data_file_count, 4),
+    ENDIAN_FIELD(stfs_header, meta.data_file_size, 4),
+    ENDIAN_FIELD(stfs_header, meta.descriptor_type, 4),
+    ENDIAN_FIELD(stfs_header, meta.reserved, 8),
+    ENDIAN_FIELD(stfs_header, meta.season, 2),
+    ENDIAN_FIELD(stfs_header, meta.episode, 2),
+    ENDIAN_FIELD(stfs_header, meta.thumbnail_size, 4),
+    ENDIAN_FIELD(stfs_header, meta.title_thumbnail_size, 4),
+};
+static const endian_schema stfs_header_schema = ENDIAN_SCHEMA(stfs_header, stfs_header_fields);
+
+// The filetable mixes both endians. Whichever one doesn't match the host gets
+// swapped.
+static const endian_field stfs_filetable_be_fields[] = {
+    ENDIAN_FIELD(stfs_filetable, path, 2),
+    ENDIAN_FIELD(stfs_filetable, size, 4),
+    ENDIAN_FIELD(stfs_filetable, modtime, 4),
+    ENDIAN_FIELD(stfs_filetable, access_time, 4),
+};
+static const endian_schema stfs_filetable_be_schema = ENDIAN_SCHEMA(stfs_filetable, stfs_filetable_be_fields);
+
+// What was Microsoft thinking here?
+static const endian_field stfs_filetable_le_fields[] = {
+    ENDIAN_FIELD(stfs_filetable, blocks, 3),
+    ENDIAN_FIELD(stfs_filetable, blocks2, 3),
+    ENDIAN_FIELD(stfs_filetable, start_block, 3),
+};
+static const endian_schema stfs_filetable_le_schema = ENDIAN_SCHEMA(stfs_filetable, stfs_filetable_le_fields);
+
 void stfs_header_byteswap(stfs_header* h) {
     if (is_little_endian()) {
-        ENDIAN_FLIP(u16, h->pubkey_cert_size);
-        ENDIAN_FLIP(u32, h->public_exponent);
-
-        for (u8 i = 0; i < ARRAY_SIZE(h->meta.licenses); i++) {
-            ENDIAN_FLIP(s64, h->meta.licenses->id);
-        }
-        ENDIAN_FLIP(u32, h->meta.header_size);
-        ENDIAN_FLIP(s32, h->meta.pkg_type);
-        ENDIAN_FLIP(s32, h->meta.meta_version);
-        ENDIAN_FLIP(s64, h->meta.content_size);
-        ENDIAN_FLIP(s32, h->meta.media_id);
-        ENDIAN_FLIP(s32, h->meta.version);
-        ENDIAN_FLIP(s32, h->meta.base_version);
-        ENDIAN_FLIP(u32, h->meta.title_id);
-        ENDIAN_FLIP(u32, h->meta.savegame_id);
-
-        ENDIAN_FLIP_24(h->meta.vol_desc.file_block_num);
-        ENDIAN_FLIP(s32, h->meta.vol_desc.allocated_block_count);
-        ENDIAN_FLIP(s32, h->meta.vol_desc.unallocated_block_count);
-        ENDIAN_FLIP(s32, h->meta.data_file_count);
-        ENDIAN_FLIP(s32, h->meta.data_file_size);
-        ENDIAN_FLIP(u32, h->meta.descriptor_type);
-        ENDIAN_FLIP(u32, h->meta.reserved);
-        ENDIAN_FLIP(s16, h->meta.season);
-        ENDIAN_FLIP(s16, h->meta.episode);
-        ENDIAN_FLIP(u32, h->meta.thumbnail_size);
-        ENDIAN_FLIP(u32, h->meta.title_thumbnail_size);
+        endian_swap_array(&stfs_header_schema, h, 1);
     }
 }
 
 void stfs_filetable_byteswap(stfs_filetable* f) {
     if (is_little_endian()) {
-        ENDIAN_FLIP(s16, f->path);
-        ENDIAN_FLIP(u32, f->size);
-        ENDIAN_FLIP(s32, f->modtime);
-        ENDIAN_FLIP(s32, f->access_time);
+        endian_swap_array(&stfs_filetable_be_schema, f, 1);
     } else {
         // On big endian, byteswap the foreign little-endian fields
-        // What was Microsoft thinking here?
-        ENDIAN_FLIP_24(f->blocks);
-        ENDIAN_FLIP_24(f->blocks2);
-        ENDIAN_FLIP_24(f->start_block);
+        endian_swap_array(&stfs_filetable_le_schema, f, 1);
     }
 }
 
@@ -60,14 +79,17 @@ void stfs_hashtable_byteswap(stfs_hash_table* table) {
     }
 }
 
-u32 stfs_file_block(stfs_header* h, u32 block) {
-    u32 out = stfs_data_block_num(h, block);
-    u32 ftable_block = s24_to_s32((u8*)&h->meta.vol_desc.file_block_num);
-    if (out == ftable_block) {
-        out += h->meta.vol_desc.file_block_count;
-    }
+u32 stfs_hash_next_block(const stfs_hash_table* entry) {
+    return read_be24(&entry->next_block_num);
+}
+
+u32 stfs_file_start_block(const stfs_filetable* entry) {
+    // This is one of the little endian fields
+    return read_le24(&entry->start_block);
+}
 
-    return out;
+u32 stfs_file_size(const stfs_filetable* entry) {
+    return read_be32(&entry->size);
 }
 
 // Round up header size to the next 0x1000 boundary
@@ -76,11 +98,11 @@ u32 stfs_first_block_off(stfs_header* header) {
 }
 
 // Taken from Free60's C# example code @ https://free60.org/System-Software/Formats/STFS
-u32 stfs_block_shift(stfs_header* header) {
+u32 stfs_block_shift(const stfs_package* pkg) {
     u32 block_shift = 0;
-    if (stfs_first_block_off(header) == 0xB000) {
+    if (pkg->first_block_off == 0xB000) {
         block_shift = 1;
-    } else if ((header->meta.vol_desc.block_separation & 1) == 1) {
+    } else if ((pkg->header->meta.vol_desc.block_separation & 1) == 1) {
         block_shift = 0;
     }
     else {
@@ -90,121 +112,883 @@ u32 stfs_block_shift(stfs_header* header) {
 }
 
 // Taken from Free60's C# example code @ https://free60.org/System-Software/Formats/STFS
-u32 stfs_blocknum_to_off(stfs_header* header, s32 block_num) {
+u32 stfs_blocknum_to_off(const stfs_package* pkg, s32 block_num) {
     if (block_num > INT24_MAX || block_num < -INT24_MAX) {
         return -1;
     }
-    return stfs_first_block_off(header) + (block_num * STFS_BLOCK_SIZE);
-}
-
-u32 stfs_data_block_num(stfs_header* header, u32 block) {
-    u32 block_shift = stfs_block_shift(header);
-    // Also from Free60 example code. This might be related to the fact that
-    // there's 2 hash tables every 0xAA blocks?
-    u32 base = 0;
-    u32 out = block;
-
-    // Very condensed version of the C# example code from Free60 (which didn't
-    // use a loop). I don't fully understand this, but I think it handles the
-    // extra space taken up by hash tables which appear every 0xAA blocks.
-    for (u32 i = 1; i < 4; i++) {
-        u32 factor = exponent(0xAA, i);
-        // Make sure we always run the loop on the first iteration
-        if (block > (factor / 0xAA) || i == 1) {
-            base = (block / factor) + 1;
-            if (header->magic == STFS_CON) {
-                base <<= block_shift;
-            }
-            out += base;
+    return pkg->first_block_off + (block_num * STFS_BLOCK_SIZE);
+}
+
+// Based on Velocity's ComputeBackingDataBlockNumber(). Every 0xAA data blocks
+// there's a level-0 hash table, and every 0xAA^2 there's also a level-1 table.
+// Packages with a block shift of 1 store 2 copies of each table.
+u32 stfs_data_block_num(const stfs_package* pkg, u32 block) {
+    const u32 shift = pkg->block_shift;
+    u32 out = (((block + STFS_HASHES_PER_TABLE) / STFS_HASHES_PER_TABLE) << shift) + block;
+    if (block < STFS_HASHES_PER_TABLE) {
+        return out;
+    }
+
+    out += ((block + STFS_BLOCKS_PER_L1) / STFS_BLOCKS_PER_L1) << shift;
+    if (block < STFS_BLOCKS_PER_L1) {
+        return out;
+    }
+
+    // Skip the level-2 table
+    return out + (1 << shift);
+}
+
+u32 stfs_hash_table_block(const stfs_package* pkg, u32 block, u32 level) {
+    const u32 shift = pkg->block_shift;
+    switch (level) {
+    case 0: {
+        if (block < STFS_HASHES_PER_TABLE) {
+            return 0;
+        }
+        u32 out = (block / STFS_HASHES_PER_TABLE) * pkg->block_step[0];
+        out += ((block / STFS_BLOCKS_PER_L1) + 1) << shift;
+        if (block < STFS_BLOCKS_PER_L1) {
+            return out;
+        }
+        return out + (1 << shift);
+    }
+    case 1:
+        if (block < STFS_BLOCKS_PER_L1) {
+            return pkg->block_step[0];
         }
+        return (1 << shift) + (block / STFS_BLOCKS_PER_L1) * pkg->block_step[1];
+    default:
+        return pkg->block_step[1];
+    }
+}
+
+// Get one copy of a hash table. Packages with a block shift of 0 only have 1.
+const stfs_hash_table* stfs_hash_table_ptr(const stfs_package* pkg, u32 table_block, bool second_copy) {
+    if (second_copy && pkg->block_shift == 1) {
+        table_block++;
     }
+    return (const stfs_hash_table*)stfs_block_ptr(pkg, table_block);
+}
 
-    return out;
+// Find the active copy of the hash table at |level| covering data block
+// |block|, by walking down from the root. Each parent entry decides which copy
+// of its child table is active, and the volume descriptor decides for the root.
+const stfs_hash_table* stfs_active_table(const stfs_package* pkg, u32 block, u32 level) {
+    bool second = (pkg->header->meta.vol_desc.block_separation & 2) != 0;
+    const stfs_hash_table* table = stfs_hash_table_ptr(pkg, stfs_hash_table_block(pkg, block, pkg->top_level), second);
+    for (u32 l = pkg->top_level; l > level && table != NULL; l--) {
+        const u32 idx = (l == 2) ? (block / STFS_BLOCKS_PER_L1) : (block / STFS_HASHES_PER_TABLE) % STFS_HASHES_PER_TABLE;
+        second = table[idx].status & STFS_HASH_COPY_ACTIVE;
+        table = stfs_hash_table_ptr(pkg, stfs_hash_table_block(pkg, block, l - 1), second);
+    }
+    return table;
 }
 
-// Get the next block for a file, given the last block's hash and the hashtable
-// NOTE: This only accounts for 1 hashtable, which assumes there's
-// < (0xAA * STFS_BLOCK_SIZE) bytes (or ~680KiB) of data in the STFS file.
-s32 stfs_next_by_hash(stfs_hash_table* table, sha1_digest prev) {
-    // Table ends with a NULL entry, so just loop until we hit a blank one
-    while (!SHA1_blank(table->sha1)) {
-        if (SHA1_equal(prev, table->sha1)) {
-            return s24_to_s32((u8*)&table->next_block_num);
+// Walk the whole hash tree once, saving the active level-0 hash entry and the
+// decoded next block number of each data block.
+bool stfs_index_hashes(stfs_package* pkg) {
+    stfs_block_index* index = &pkg->index;
+    const u32 count = index->count;
+    index->hashes = calloc(count, sizeof(*index->hashes));
+    index->next = calloc(count, sizeof(*index->next));
+    if ((index->hashes == NULL || index->next == NULL) && count != 0) {
+        LOG_MSG(error, "Failed to alloc hash index for %d blocks\n", count);
+        return false;
+    }
+
+    for (u32 block = 0; block < count; block += STFS_HASHES_PER_TABLE) {
+        const stfs_hash_table* level0 = stfs_active_table(pkg, block, 0);
+        if (level0 == NULL) {
+            return false;
+        }
+        for (u32 i = 0; i < STFS_HASHES_PER_TABLE && block + i < count; i++) {
+            index->hashes[block + i] = &level0[i];
+            index->next[block + i] = stfs_hash_next_block(&level0[i]);
         }
-        table++;
     }
 
-    // Hash isn't in the table... something's gone wrong.
-    LOG_MSG(error, "SHA1 ");
-    SHA1_print(prev);
-    printf(" not found in hashtable!\n");
-    return -1;
+    return true;
 }
 
-u8* stfs_get_vehicle(const char* path) {
-    FILE* f = fopen(path, "rb");
-    if (f == NULL) {
-        LOG_MSG(error, "Failed to open %s\n", path);
+const u8* stfs_block_ptr(const stfs_package* pkg, u32 block_num) {
+    if (block_num >= pkg->block_count) {
+        LOG_MSG(error, "Block %d is past the end of the file (%d blocks)\n", block_num, pkg->block_count);
         return NULL;
     }
+    return pkg->file.data + stfs_blocknum_to_off(pkg, block_num);
+}
+
+// Everything stfs_open() does after getting the file into memory. |path| is
+// only used for error messages.
+static stfs_package stfs_open_file(mapped_file file, const char* path) {
+    stfs_package pkg = {
+        .file = file,
+    };
+    if (pkg.file.size < sizeof(stfs_header)) {
+        LOG_MSG(error, "%s is too small to be an STFS file\n", path);
+        stfs_close(&pkg);
+        return pkg;
+    }
 
-    stfs_header header = {0};
-    fread(&header, sizeof(header), 1, f);
-    stfs_header_byteswap(&header);
-    if (header.magic != STFS_CON) {
+    pkg.header = (const stfs_header*)pkg.file.data;
+    // The magic is compared as raw bytes, it's never byteswapped.
+    memcpy(&pkg.magic, &pkg.header->magic, sizeof(pkg.magic));
+    if (pkg.magic != STFS_CON) {
         LOG_MSG(error, "Input file wasn't a vehicle or STFS save file!\n");
-        return NULL;
+        stfs_close(&pkg);
+        return pkg;
     }
 
-    // Read the hashtable
-    u32 hash_count = header.meta.vol_desc.allocated_block_count + 1; // Add 1 to include null entry
-    stfs_hash_table* hashtable = calloc(hash_count, sizeof(*hashtable));
-    if (hashtable == NULL) {
-        return NULL;
+    const u32 header_size = read_be32(&pkg.header->meta.header_size);
+    pkg.first_block_off = ALIGN_UP(header_size, STFS_BLOCK_SIZE);
+    if (pkg.file.size > pkg.first_block_off) {
+        pkg.block_count = (pkg.file.size - pkg.first_block_off) / STFS_BLOCK_SIZE;
     }
-    fseek(f, stfs_first_block_off(&header), SEEK_SET);
-    fread(hashtable, sizeof(*hashtable), hash_count, f);
-    for (u32 i = 0; i < hash_count; i++) {
-        stfs_hashtable_byteswap(&hashtable[i]);
+    pkg.block_shift = stfs_block_shift(&pkg);
+    // These never change for a given shift, so we only compute them once
+    if (pkg.block_shift == 1) {
+        pkg.block_step[0] = 0xAC;
+        pkg.block_step[1] = 0x723A;
+    } else {
+        pkg.block_step[0] = 0xAB;
+        pkg.block_step[1] = 0x718F;
+    }
+
+    // The root table's level depends on how many blocks it has to cover
+    const s32 allocated = (s32)read_be32(&pkg.header->meta.vol_desc.allocated_block_count);
+    pkg.index.count = MAX(allocated, 0);
+    if (pkg.index.count <= STFS_HASHES_PER_TABLE) {
+        pkg.top_level = 0;
+    } else if (pkg.index.count <= STFS_BLOCKS_PER_L1) {
+        pkg.top_level = 1;
+    } else if (pkg.index.count <= STFS_BLOCKS_PER_L2) {
+        pkg.top_level = 2;
+    } else {
+        LOG_MSG(error, "%s claims to have %d blocks, which is too many for STFS\n", path, allocated);
+        stfs_close(&pkg);
+        return pkg;
+    }
+
+    if (!stfs_index_hashes(&pkg)) {
+        LOG_MSG(error, "Failed to read hash tables of %s\n", path);
+        stfs_close(&pkg);
+        return pkg;
     }
 
     // Find out the block number of the file table
-    u32 fblock = s24_to_s32((u8*)&header.meta.vol_desc.file_block_num);
-    u32 ftable_block = stfs_data_block_num(&header, fblock);
-    LOG_MSG(info, "File table is @ block %d\n", ftable_block);
+    const u32 fblock = read_le24(&pkg.header->meta.vol_desc.file_block_num);
+    pkg.ftable_block = stfs_data_block_num(&pkg, fblock);
 
-    // Read the first file table entry (the only one we care about)
-    u32 ftable_off = stfs_blocknum_to_off(&header, ftable_block);
-    fseek(f, ftable_off, SEEK_SET);
-    stfs_filetable entry = {0};
-    fread(&entry, sizeof(entry), 1, f);
-    stfs_filetable_byteswap(&entry);
+    return pkg;
+}
+
+stfs_package stfs_open(const char* path) {
+    const mapped_file file = file_map(path);
+    if (file.data == NULL) {
+        LOG_MSG(error, "Failed to open %s\n", path);
+        return (stfs_package){0};
+    }
+    return stfs_open_file(file, path);
+}
+
+stfs_package stfs_open_buffer(const u8* data, u64 size) {
+    if (data == NULL) {
+        return (stfs_package){0};
+    }
+    return stfs_open_file(file_wrap(data, size), "STFS buffer");
+}
+
+void stfs_close(stfs_package* pkg) {
+    free(pkg->index.hashes);
+    free(pkg->index.next);
+    file_unmap(&pkg->file);
+    *pkg = (stfs_package){0};
+}
+
+u32 stfs_next_block(const stfs_package* pkg, u32 block) {
+    if (block >= pkg->index.count) {
+        return STFS_CHAIN_END;
+    }
+    return pkg->index.next[block];
+}
+
+bool stfs_verify_block(const stfs_package* pkg, u32 block) {
+    if (block >= pkg->index.count) {
+        return false;
+    }
+    const u8* data = stfs_block_ptr(pkg, stfs_data_block_num(pkg, block));
+    if (data == NULL) {
+        return false;
+    }
+
+    const sha1_digest sha1 = SHA1_buf((u8*)data, STFS_BLOCK_SIZE);
+    if (!SHA1_equal(sha1, pkg->index.hashes[block]->sha1)) {
+        LOG_MSG(error, "SHA1 ");
+        SHA1_print(sha1);
+        printf(" of block %d doesn't match the hashtable!\n", block);
+        return false;
+    }
+    return true;
+}
+
+// Fill |blocks| with the data block numbers of a file, in order. Files with
+// consecutive blocks don't need their chain followed at all.
+static bool stfs_file_blocks(const stfs_package* pkg, const stfs_filetable* entry, u32* blocks, u32 count) {
+    u32 block = stfs_file_start_block(entry);
+    const bool consecutive = entry->flags & STFS_FILE_CONSECUTIVE;
+    for (u32 i = 0; i < count; i++) {
+        if (block >= pkg->index.count) {
+            LOG_MSG(error, "File chain points to block %d, but there's only %d\n", block, pkg->index.count);
+            return false;
+        }
+        blocks[i] = block;
+        block = consecutive ? block + 1 : stfs_next_block(pkg, block);
+    }
+    return true;
+}
+
+bool stfs_verify_file(const stfs_package* pkg, const stfs_filetable* entry) {
+    const u32 count = (stfs_file_size(entry) + STFS_BLOCK_SIZE - 1) / STFS_BLOCK_SIZE;
+    const u8** ptrs = calloc(count, sizeof(*ptrs));
+    u32* blocks = calloc(count, sizeof(*blocks));
+    sha1_digest* sha1 = calloc(count, sizeof(*sha1));
+    bool ok = (ptrs != NULL && blocks != NULL && sha1 != NULL) || count == 0;
+
+    // Gather the whole chain first, so every block can be hashed in one batch
+    ok = ok && stfs_file_blocks(pkg, entry, blocks, count);
+    for (u32 i = 0; ok && i < count; i++) {
+        ptrs[i] = stfs_block_ptr(pkg, stfs_data_block_num(pkg, blocks[i]));
+        ok = (ptrs[i] != NULL);
+    }
+
+    if (ok) {
+        SHA1_buf_many(ptrs, count, STFS_BLOCK_SIZE, sha1);
+    }
+    for (u32 i = 0; ok && i < count; i++) {
+        if (!SHA1_equal(sha1[i], pkg->index.hashes[blocks[i]]->sha1)) {
+            LOG_MSG(error, "SHA1 ");
+            SHA1_print(sha1[i]);
+            printf(" of block %d doesn't match the hashtable!\n", blocks[i]);
+            ok = false;
+        }
+    }
+
+    free(ptrs);
+    free(blocks);
+    free(sha1);
+    return ok;
+}
+
+enum {
+    STFS_VERIFY_CHUNK = 64, // Data blocks hashed per thread pool job
+};
+
+typedef enum {
+    BLOCK_UNCHECKED = 0, // Not allocated, so the hash is meaningless
+    BLOCK_OK,
+    BLOCK_BAD,
+}stfs_block_result;
+
+typedef struct {
+    const stfs_package* pkg;
+    u8* results; // stfs_block_result for every data block
+}stfs_verify_ctx;
+
+// Check one chunk of data blocks. Each job only writes its own part of the
+// results, so no locking is needed.
+static void stfs_verify_job(void* arg, u32 job) {
+    const stfs_verify_ctx* ctx = arg;
+    const stfs_package* pkg = ctx->pkg;
+    const u32 first = job * STFS_VERIFY_CHUNK;
+    const u32 end = MIN(first + STFS_VERIFY_CHUNK, pkg->index.count);
+
+    const u8* ptrs[STFS_VERIFY_CHUNK] = {0};
+    u32 blocks[STFS_VERIFY_CHUNK];
+    sha1_digest sha1[STFS_VERIFY_CHUNK];
+    u32 count = 0;
+    for (u32 block = first; block < end; block++) {
+        if (!(pkg->index.hashes[block]->status & STATUS_USED)) {
+            continue;
+        }
+        const u8* data = stfs_block_ptr(pkg, stfs_data_block_num(pkg, block));
+        if (data == NULL) {
+            ctx->results[block] = BLOCK_BAD;
+            continue;
+        }
+        ptrs[count] = data;
+        blocks[count++] = block;
+    }
+
+    SHA1_buf_many(ptrs, count, STFS_BLOCK_SIZE, sha1);
+    for (u32 i = 0; i < count; i++) {
+        const bool ok = SHA1_equal(sha1[i], pkg->index.hashes[blocks[i]]->sha1);
+        ctx->results[blocks[i]] = ok ? BLOCK_OK : BLOCK_BAD;
+    }
+}
+
+// Check each level of hash tables against the level above it. Returns false if
+// the tables couldn't be checked at all.
+static bool stfs_verify_tables(const stfs_package* pkg, stfs_verify_report* report) {
+    const u32 span[] = {STFS_HASHES_PER_TABLE, STFS_BLOCKS_PER_L1, STFS_BLOCKS_PER_L2};
+    const u32 l0_tables = MAX((pkg->index.count + STFS_HASHES_PER_TABLE - 1) / STFS_HASHES_PER_TABLE, 1);
+    const u32 tables[] = {l0_tables, (l0_tables + STFS_HASHES_PER_TABLE - 1) / STFS_HASHES_PER_TABLE, 1};
+
+    const u8** ptrs = calloc(l0_tables, sizeof(*ptrs));
+    sha1_digest* sha1 = calloc(l0_tables, sizeof(*sha1));
+    if (ptrs == NULL || sha1 == NULL) {
+        LOG_MSG(error, "Failed to alloc hashes for %d tables\n", l0_tables);
+        free(ptrs);
+        free(sha1);
+        return false;
+    }
+    for (u32 level = 0; level <= pkg->top_level; level++) {
+        for (u32 t = 0; t < tables[level]; t++) {
+            ptrs[t] = (const u8*)stfs_active_table(pkg, t * span[level], level);
+        }
+        // Missing tables (truncated file) are hashed as the header instead,
+        // then reported as bad below.
+        for (u32 t = 0; t < tables[level]; t++) {
+            if (ptrs[t] == NULL) {
+                ptrs[t] = pkg->file.data;
+            }
+        }
+        SHA1_buf_many(ptrs, tables[level], STFS_BLOCK_SIZE, sha1);
+
+        for (u32 t = 0; t < tables[level]; t++) {
+            const u32 first = t * span[level];
+            sha1_digest expected = pkg->header->meta.vol_desc.first_hashtable_hash;
+            if (level < pkg->top_level) {
+                const stfs_hash_table* parent = stfs_active_table(pkg, first, level + 1);
+                if (parent == NULL) {
+                    continue; // Already reported on the last level
+                }
+                expected = parent[(first / span[level]) % STFS_HASHES_PER_TABLE].sha1;
+            }
+            report->tables_checked++;
+            const bool ok = ptrs[t] != pkg->file.data && SHA1_equal(sha1[t], expected);
+            if (level == pkg->top_level) {
+                report->top_hash_ok = ok;
+            }
+            if (!ok) {
+                const stfs_bad_table bad = {.level = level, .first_block = first};
+                list_add(&report->bad_tables, &bad);
+            }
+        }
+    }
+    free(ptrs);
+    free(sha1);
+    return true;
+}
+
+stfs_verify_report stfs_verify(const stfs_package* pkg, thread_pool* pool) {
+    stfs_verify_report report = {
+        .bad_blocks = list_create(sizeof(u32) * 16, sizeof(u32)),
+        .bad_tables = list_create(sizeof(stfs_bad_table) * 4, sizeof(stfs_bad_table)),
+    };
+
+    // The header hash covers everything after the header size up to the
+    // first block.
+    const u32 hashed_start = offsetof(stfs_header, meta.pkg_type);
+    if (pkg->file.size >= pkg->first_block_off) {
+        const sha1_digest sha1 = SHA1_buf(pkg->file.data + hashed_start, pkg->first_block_off - hashed_start);
+        report.header_ok = SHA1_equal(sha1, pkg->header->meta.header_sha1);
+    }
+
+    if (!stfs_verify_tables(pkg, &report)) {
+        return report;
+    }
+
+    const u32 count = pkg->index.count;
+    stfs_verify_ctx ctx = {
+        .pkg = pkg,
+        .results = calloc(count, sizeof(*ctx.results)),
+    };
+    if (ctx.results == NULL && count != 0) {
+        LOG_MSG(error, "Failed to alloc results for %d blocks\n", count);
+        return report;
+    }
+    thread_pool_run(pool, (count + STFS_VERIFY_CHUNK - 1) / STFS_VERIFY_CHUNK, stfs_verify_job, &ctx);
+
+    for (u32 block = 0; block < count; block++) {
+        if (ctx.results[block] != BLOCK_UNCHECKED) {
+            report.blocks_checked++;
+        }
+        if (ctx.results[block] == BLOCK_BAD) {
+            list_add(&report.bad_blocks, &block);
+        }
+    }
+    free(ctx.results);
+
+    report.complete = true;
+    return report;
+}
+
+bool stfs_report_ok(const stfs_verify_report* report) {
+    return report->complete && report->header_ok && report->top_hash_ok && list_empty(report->bad_blocks) && list_empty(report->bad_tables);
+}
+
+void stfs_report_print(const stfs_verify_report* report) {
+    const u32 bad_blocks = report->bad_blocks.end_idx;
+    const u32 bad_tables = report->bad_tables.end_idx;
+    LOG_MSG(info, "%d/%d blocks OK, %d/%d hash tables OK, header hash %s, top hash %s\n",
+            report->blocks_checked - bad_blocks, report->blocks_checked,
+            report->tables_checked - bad_tables, report->tables_checked,
+            report->header_ok ? "OK" : "BAD", report->top_hash_ok ? "OK" : "BAD");
+    if (!report->complete) {
+        LOG_MSG(error, "Verification didn't finish, so the package can't be trusted\n");
+    }
+    for (u32 i = 0; i < bad_blocks; i++) {
+        LOG_MSG(error, "Block %d doesn't match its hash\n", *(u32*)list_get_element(report->bad_blocks, i));
+    }
+    for (u32 i = 0; i < bad_tables; i++) {
+        const stfs_bad_table* bad = list_get_element(report->bad_tables, i);
+        LOG_MSG(error, "Level %d hash table for block %d doesn't match its hash\n", bad->level, bad->first_block);
+    }
+}
 
+void stfs_report_free(stfs_verify_report* report) {
+    free((void*)report->bad_blocks.data);
+    free((void*)report->bad_tables.data);
+    *report = (stfs_verify_report){0};
+}
+
+// Copy a file whose blocks are all in order. Runs of blocks between hash
+// tables are contiguous in the file, so each run is a single copy.
+static bool stfs_read_consecutive(const stfs_package* pkg, u32 start, u32 count, u8* buf) {
+    if (start + count > pkg->index.count) {
+        LOG_MSG(error, "File ends at block %d, but there's only %d\n", start + count, pkg->index.count);
+        return false;
+    }
+    for (u32 i = 0; i < count;) {
+        const u32 block = start + i;
+        const u32 run = MIN(count - i, STFS_HASHES_PER_TABLE - (block % STFS_HASHES_PER_TABLE));
+        const u8* first = stfs_block_ptr(pkg, stfs_data_block_num(pkg, block));
+        const u8* last = stfs_block_ptr(pkg, stfs_data_block_num(pkg, block + run - 1));
+        if (first == NULL || last == NULL) {
+            return false;
+        }
+        memcpy(buf + ((u64)i * STFS_BLOCK_SIZE), first, (u64)run * STFS_BLOCK_SIZE);
+        i += run;
+    }
+    return true;
+}
+
+u8* stfs_read_file(const stfs_package* pkg, const stfs_filetable* entry, u32 flags) {
+    const u32 size = stfs_file_size(entry);
+    const u32 count = (size + STFS_BLOCK_SIZE - 1) / STFS_BLOCK_SIZE;
+    u32 block = stfs_file_start_block(entry);
+    LOG_MSG(info, "File %.40s is %d bytes, starts @ block %d\n", entry->filename, size, block);
+
+    if ((flags & STFS_READ_VERIFY) && !stfs_verify_file(pkg, entry)) {
+        return NULL;
+    }
     // We round up to the block size to make reading simpler, at the cost of up
     // to 4KiB extra memory usage for the file.
-    u8* buf = calloc(1, ALIGN_UP(entry.size, STFS_BLOCK_SIZE));
-    u32 bytes_read = 0;
-    s32 next_block = s24_to_s32((u8*)&entry.start_block);
-    next_block = stfs_file_block(&header, next_block);
-    LOG_MSG(info, "File %s is %d bytes, starts @ block %d\n", entry.filename, entry.size, next_block);
-    while (entry.size > bytes_read) {
-        fseek(f, stfs_blocknum_to_off(&header, next_block), SEEK_SET);
-        fread(buf + bytes_read, STFS_BLOCK_SIZE, 1, f);
-        sha1_digest sha1 = SHA1_buf(buf + bytes_read, STFS_BLOCK_SIZE); // Hash the block
-
-        LOG_MSG(debug, "Block %d: SHA1 ", bytes_read / STFS_BLOCK_SIZE);
-        SHA1_print(sha1);
-        printf("\n");
+    u8* buf = calloc(1, ALIGN_UP(size, STFS_BLOCK_SIZE));
+    if (buf == NULL) {
+        return NULL;
+    }
 
-        // Get the next block, then adjust for filetable/hashtable blocks to
-        // get the actual index
-        next_block = stfs_next_by_hash(hashtable, sha1);
-        next_block = stfs_data_block_num(&header, next_block);
+    if (entry->flags & STFS_FILE_CONSECUTIVE) {
+        if (!stfs_read_consecutive(pkg, block, count, buf)) {
+            free(buf);
+            return NULL;
+        }
+        return buf;
+    }
 
-        bytes_read += STFS_BLOCK_SIZE;
+    for (u32 i = 0; i < count; i++) {
+        if (block >= pkg->index.count) {
+            LOG_MSG(error, "File chain points to block %d, but there's only %d\n", block, pkg->index.count);
+            free(buf);
+            return NULL;
+        }
+        const u8* data = stfs_block_ptr(pkg, stfs_data_block_num(pkg, block));
+        if (data == NULL) {
+            free(buf);
+            return NULL;
+        }
+        memcpy(buf + ((u64)i * STFS_BLOCK_SIZE), data, STFS_BLOCK_SIZE);
+        block = stfs_next_block(pkg, block);
     }
-    free(hashtable);
 
     return buf;
 }
 
+// Point the iterator at entry number |ctx->entry_idx|, or finish if there
+// isn't one.
+static void stfs_file_iterator_load(stfs_file_iterator* ctx) {
+    const u32 slot = ctx->entry_idx % STFS_FILES_PER_BLOCK;
+    if (slot == 0 && ctx->entry_idx > 0) {
+        ctx->blocks_left--;
+        ctx->block = stfs_next_block(ctx->pkg, ctx->block);
+    }
+    ctx->entry = NULL;
+    ctx->done = true;
+    if (ctx->blocks_left == 0 || ctx->block >= ctx->pkg->index.count) {
+        return;
+    }
+    const stfs_filetable* table = (const stfs_filetable*)stfs_block_ptr(ctx->pkg, stfs_data_block_num(ctx->pkg, ctx->block));
+    // An empty name marks the end of the table
+    if (table == NULL || (table[slot].flags & STFS_FILE_NAME_LEN) == 0) {
+        return;
+    }
+    ctx->entry = &table[slot];
+    ctx->done = false;
+}
+
+stfs_file_iterator stfs_file_iterator_setup(const stfs_package* pkg) {
+    const stfs_vol_desc* vol_desc = &pkg->header->meta.vol_desc;
+    stfs_file_iterator ctx = {
+        .pkg = pkg,
+        .block = read_le24(&vol_desc->file_block_num),
+        .blocks_left = read_le16(&vol_desc->file_block_count),
+    };
+    stfs_file_iterator_load(&ctx);
+    return ctx;
+}
+
+stfs_file_info stfs_file_iterator_next(stfs_file_iterator* ctx) {
+    stfs_file_info info = {0};
+    if (ctx->done) {
+        return info;
+    }
+    const stfs_filetable* e = ctx->entry;
+    info = (stfs_file_info) {
+        .raw = e,
+        .index = ctx->entry_idx,
+        .directory = e->flags & STFS_FILE_DIRECTORY,
+        .consecutive = e->flags & STFS_FILE_CONSECUTIVE,
+        .parent = (s16)read_be16(&e->path),
+        .size = stfs_file_size(e),
+        .start_block = stfs_file_start_block(e),
+        .block_count = read_le24(&e->blocks),
+    };
+    const u32 name_len = MIN(e->flags & STFS_FILE_NAME_LEN, sizeof(e->filename));
+    memcpy(info.name, e->filename, name_len);
+
+    ctx->entry_idx++;
+    stfs_file_iterator_load(ctx);
+    return info;
+}
+
+// Append |name| to |path|, making sure it can't be used to escape the output
+// folder. Returns false if the path is too long.
+static bool stfs_path_append(char* path, u32 path_size, const char* name) {
+    const u32 len = strlen(path);
+    const u32 name_len = strlen(name);
+    if (len + 1 + name_len + 1 > path_size) {
+        return false;
+    }
+    path[len] = PLATFORM_DIRSEP;
+    for (u32 i = 0; i < name_len; i++) {
+        const char c = name[i];
+        path[len + 1 + i] = (c == '/' || c == '\\' || c == ':') ? '_' : c;
+    }
+    path[len + 1 + name_len] = '\0';
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        path[len + 1] = '_';
+        path[len + 2] = '\0';
+    }
+    return true;
+}
+
+// Build the output path for a file table entry, creating the directories
+// above it along the way.
+static bool stfs_entry_path(const list* entries, u32 idx, const char* out_dir, char* path, u32 path_size) {
+    // Walk up to the root. The depth limit stops a corrupted table from
+    // sending us around in circles.
+    u32 stack[32];
+    u32 depth = 0;
+    for (s32 i = idx; i >= 0 && (u32)i < entries->end_idx; i = ((stfs_file_info*)list_get_element(*entries, i))->parent) {
+        if (depth == ARRAY_SIZE(stack)) {
+            return false;
+        }
+        stack[depth++] = i;
+    }
+
+    snprintf(path, path_size, "%s", out_dir);
+    while (depth > 0) {
+        const stfs_file_info* info = list_get_element(*entries, stack[--depth]);
+        if (!stfs_path_append(path, path_size, info->name)) {
+            return false;
+        }
+        if ((depth > 0 || info->directory) && !dir_create(path)) {
+            LOG_MSG(error, "Failed to create directory %s\n", path);
+            return false;
+        }
+    }
+    return true;
+}
+
+u32 stfs_extract_all(const stfs_package* pkg, const char* out_dir, u32 flags) {
+    if (!dir_create(out_dir)) {
+        LOG_MSG(error, "Failed to create directory %s\n", out_dir);
+        return 0;
+    }
+
+    // Directories are looked up by index, so we need the whole table first
+    list entries = list_create(sizeof(stfs_file_info) * STFS_FILES_PER_BLOCK, sizeof(stfs_file_info));
+    stfs_file_iterator iter = stfs_file_iterator_setup(pkg);
+    while (!iter.done) {
+        const stfs_file_info info = stfs_file_iterator_next(&iter);
+        list_add(&entries, &info);
+    }
+
+    u32 extracted = 0;
+    char path[1024] = {0};
+    for (u32 i = 0; i < entries.end_idx; i++) {
+        const stfs_file_info* info = list_get_element(entries, i);
+        if (!stfs_entry_path(&entries, i, out_dir, path, sizeof(path))) {
+            LOG_MSG(error, "Couldn't make a path for %s\n", info->name);
+            continue;
+        }
+        if (info->directory) {
+            continue;
+        }
+
+        u8* data = stfs_read_file(pkg, info->raw, flags);
+        if (data == NULL) {
+            continue;
+        }
+        FILE* f = fopen(path, "wb");
+        if (f == NULL) {
+            LOG_MSG(error, "Failed to open %s for writing\n", path);
+            free(data);
+            continue;
+        }
+        extracted += (info->size == 0) || fwrite(data, info->size, 1, f) == 1;
+        fclose(f);
+        free(data);
+    }
+
+    free((void*)entries.data);
+    return extracted;
+}
+
+u8* stfs_read_vehicle(const stfs_package* pkg, u32 flags) {
+    LOG_MSG(info, "File table is @ block %d\n", pkg->ftable_block);
+
+    // Read the first file table entry (the only one we care about)
+    const stfs_filetable* entry = (const stfs_filetable*)stfs_block_ptr(pkg, pkg->ftable_block);
+    if (entry == NULL) {
+        return NULL;
+    }
+    return stfs_read_file(pkg, entry, flags);
+}
+
+u8* stfs_get_vehicle(const char* path) {
+    stfs_package pkg = stfs_open(path);
+    if (pkg.file.data == NULL) {
+        return NULL;
+    }
+
+    u8* buf = stfs_read_vehicle(&pkg, STFS_READ_VERIFY);
+    stfs_close(&pkg);
+    return buf;
+}
+
+// Same as stfs_hash_table_ptr(), but for our writable copy of the package
+static stfs_hash_table* stfs_out_table(const stfs_package* pkg, u8* out, const stfs_hash_table* table) {
+    return (stfs_hash_table*)(out + ((const u8*)table - pkg->file.data));
+}
+
+// Hash data blocks in our copy of the package all at once, and mark their
+// tables dirty. |ptrs| and |sha1| are scratch space for |count| entries.
+static void stfs_rehash_blocks(const stfs_package* pkg, u8* out, const u32* blocks, u32 count, const u8** ptrs, sha1_digest* sha1, bool* dirty) {
+    for (u32 i = 0; i < count; i++) {
+        ptrs[i] = out + stfs_blocknum_to_off(pkg, stfs_data_block_num(pkg, blocks[i]));
+    }
+    SHA1_buf_many(ptrs, count, STFS_BLOCK_SIZE, sha1);
+    for (u32 i = 0; i < count; i++) {
+        stfs_hash_table* level0 = stfs_out_table(pkg, out, stfs_active_table(pkg, blocks[i], 0));
+        level0[blocks[i] % STFS_HASHES_PER_TABLE].sha1 = sha1[i];
+        dirty[blocks[i] / STFS_HASHES_PER_TABLE] = true;
+    }
+}
+
+bool stfs_write_vehicle(const stfs_package* pkg, const u8* vehicle, u32 size, const char* out_path) {
+    const stfs_filetable* entry = (const stfs_filetable*)stfs_block_ptr(pkg, pkg->ftable_block);
+    if (entry == NULL || size == 0) {
+        return false;
+    }
+    const u32 count = pkg->index.count;
+    const u32 old_blocks = (stfs_file_size(entry) + STFS_BLOCK_SIZE - 1) / STFS_BLOCK_SIZE;
+    const u32 new_blocks = (size + STFS_BLOCK_SIZE - 1) / STFS_BLOCK_SIZE;
+
+    // We can't add new hash tables yet, so any new blocks have to fit in the
+    // last level-0 table.
+    const u32 l0_tables = (count + STFS_HASHES_PER_TABLE - 1) / STFS_HASHES_PER_TABLE;
+    const u32 capacity = l0_tables * STFS_HASHES_PER_TABLE;
+    const u32 new_count = count + MAX((s32)new_blocks - (s32)old_blocks, 0);
+    if (new_count > capacity) {
+        LOG_MSG(error, "A %d byte vehicle needs more hash tables than the template has\n", size);
+        return false;
+    }
+
+    // Reuse the blocks the old file already owns (in order), and append new
+    // blocks after the last allocated one. The rest of the allocation holds
+    // the blocks we need to rehash (at most every data block + file table).
+    const u32 chain_len = MAX(new_blocks, old_blocks);
+    u32* chain = calloc(chain_len + new_blocks + 1, sizeof(*chain));
+    if (chain == NULL) {
+        return false;
+    }
+    u32* rehash = chain + chain_len;
+    u32 rehash_count = 0;
+    u32 block = stfs_file_start_block(entry);
+    for (u32 i = 0; i < old_blocks; i++) {
+        if (block >= count) {
+            LOG_MSG(error, "File chain points to block %d, but there's only %d\n", block, count);
+            free(chain);
+            return false;
+        }
+        chain[i] = block;
+        block = stfs_next_block(pkg, block);
+    }
+    for (u32 i = old_blocks; i < new_blocks; i++) {
+        chain[i] = count + (i - old_blocks);
+    }
+
+    // Dirty flags for each level of hash tables, so we only rebuild the parts
+    // of the tree above something that changed.
+    const u32 l1_tables = (l0_tables + STFS_HASHES_PER_TABLE - 1) / STFS_HASHES_PER_TABLE;
+    bool* dirty[3] = {0};
+    dirty[0] = calloc(l0_tables + l1_tables + 1, sizeof(bool));
+    // Scratch space for hashing blocks and tables in batches
+    const u32 batch_max = MAX(new_blocks + 1, l0_tables);
+    const u8** batch_ptrs = calloc(batch_max, sizeof(*batch_ptrs));
+    sha1_digest* batch_sha1 = calloc(batch_max, sizeof(*batch_sha1));
+    const u32 last_phys = stfs_data_block_num(pkg, new_count - 1);
+    const u64 out_size = MAX(pkg->file.size, stfs_blocknum_to_off(pkg, last_phys) + (u64)STFS_BLOCK_SIZE);
+    u8* out = calloc(1, out_size);
+    if (dirty[0] == NULL || batch_ptrs == NULL || batch_sha1 == NULL || out == NULL) {
+        LOG_MSG(error, "Failed to alloc output package\n");
+        free(chain);
+        free(dirty[0]);
+        free(batch_ptrs);
+        free(batch_sha1);
+        free(out);
+        return false;
+    }
+    dirty[1] = dirty[0] + l0_tables;
+    dirty[2] = dirty[1] + l1_tables;
+    memcpy(out, pkg->file.data, pkg->file.size);
+
+    // Copy in the new data, skipping blocks that didn't change
+    u8 data[STFS_BLOCK_SIZE];
+    for (u32 i = 0; i < new_blocks; i++) {
+        const u32 len = MIN(size - (i * STFS_BLOCK_SIZE), STFS_BLOCK_SIZE);
+        memset(data, 0, sizeof(data));
+        memcpy(data, vehicle + (i * STFS_BLOCK_SIZE), len);
+
+        u8* dst = out + stfs_blocknum_to_off(pkg, stfs_data_block_num(pkg, chain[i]));
+        // New blocks never had a hash, even if their contents happen to match
+        if (i >= old_blocks || memcmp(dst, data, sizeof(data)) != 0) {
+            memcpy(dst, data, sizeof(data));
+            rehash[rehash_count++] = chain[i];
+        }
+
+        stfs_hash_table* level0 = stfs_out_table(pkg, out, stfs_active_table(pkg, chain[i], 0));
+        stfs_hash_table* hash = &level0[chain[i] % STFS_HASHES_PER_TABLE];
+        const u32 next = (i + 1 < new_blocks) ? chain[i + 1] : STFS_CHAIN_END;
+        if (stfs_hash_next_block(hash) != next || !(hash->status & STATUS_USED)) {
+            write_be24(&hash->next_block_num, next);
+            hash->status |= STATUS_USED;
+            dirty[0][chain[i] / STFS_HASHES_PER_TABLE] = true;
+        }
+    }
+
+    // Blocks the vehicle doesn't need anymore are marked as freed
+    for (u32 i = new_blocks; i < old_blocks; i++) {
+        stfs_hash_table* level0 = stfs_out_table(pkg, out, stfs_active_table(pkg, chain[i], 0));
+        stfs_hash_table* hash = &level0[chain[i] % STFS_HASHES_PER_TABLE];
+        write_be24(&hash->next_block_num, STFS_CHAIN_END);
+        hash->status = STATUS_FREED;
+        dirty[0][chain[i] / STFS_HASHES_PER_TABLE] = true;
+    }
+
+    // Update the file table entry. The block count is stored twice.
+    stfs_filetable* out_entry = (stfs_filetable*)(out + ((const u8*)entry - pkg->file.data));
+    bool consecutive = true;
+    for (u32 i = 1; i < new_blocks; i++) {
+        consecutive &= (chain[i] == chain[i - 1] + 1);
+    }
+    const u8 flags = (entry->flags & ~STFS_FILE_CONSECUTIVE) | (consecutive ? STFS_FILE_CONSECUTIVE : 0);
+    if (stfs_file_size(entry) != size || old_blocks != new_blocks || entry->flags != flags) {
+        write_be32(&out_entry->size, size);
+        write_le24(&out_entry->blocks, new_blocks);
+        write_le24(&out_entry->blocks2, new_blocks);
+        out_entry->flags = flags;
+        rehash[rehash_count++] = read_le24(&pkg->header->meta.vol_desc.file_block_num);
+    }
+    stfs_rehash_blocks(pkg, out, rehash, rehash_count, batch_ptrs, batch_sha1, dirty[0]);
+    free(chain);
+
+    // New blocks are appended, so they add to the allocated count. Freed
+    // blocks stay inside that count, but are also counted as unallocated.
+    stfs_header* header = (stfs_header*)out;
+    if (new_count != count) {
+        write_be32(&header->meta.vol_desc.allocated_block_count, new_count);
+    }
+    if (new_blocks < old_blocks) {
+        const u32 unallocated = read_be32(&pkg->header->meta.vol_desc.unallocated_block_count);
+        write_be32(&header->meta.vol_desc.unallocated_block_count, unallocated + (old_blocks - new_blocks));
+    }
+
+    // Rebuild dirty tables from the bottom up. Each table's hash goes into
+    // its parent, and the root's hash goes in the volume descriptor.
+    bool changed = false;
+    const u32 span[] = {STFS_HASHES_PER_TABLE, STFS_BLOCKS_PER_L1, STFS_BLOCKS_PER_L2};
+    const u32 tables[] = {l0_tables, l1_tables, 1};
+    for (u32 level = 0; level <= pkg->top_level; level++) {
+        // Tables on the same level don't depend on each other, so hash them
+        // in one batch.
+        u32 dirty_count = 0;
+        for (u32 t = 0; t < tables[level]; t++) {
+            if (dirty[level][t]) {
+                const stfs_hash_table* table = stfs_active_table(pkg, t * span[level], level);
+                batch_ptrs[dirty_count++] = (const u8*)stfs_out_table(pkg, out, table);
+            }
+        }
+        SHA1_buf_many(batch_ptrs, dirty_count, STFS_BLOCK_SIZE, batch_sha1);
+        changed |= (dirty_count > 0);
+
+        u32 i = 0;
+        for (u32 t = 0; t < tables[level]; t++) {
+            if (!dirty[level][t]) {
+                continue;
+            }
+            const sha1_digest sha1 = batch_sha1[i++];
+            if (level == pkg->top_level) {
+                header->meta.vol_desc.first_hashtable_hash = sha1;
+                continue;
+            }
+            const u32 first = t * span[level];
+            stfs_hash_table* parent = stfs_out_table(pkg, out, stfs_active_table(pkg, first, level + 1));
+            parent[(first / span[level]) % STFS_HASHES_PER_TABLE].sha1 = sha1;
+            dirty[level + 1][first / span[level + 1]] = true;
+        }
+    }
+    free(dirty[0]);
+    free(batch_ptrs);
+    free(batch_sha1);
+
+    // The header hash covers everything after the header size up to the
+    // first block, including the volume descriptor we just changed.
+    if (changed) {
+        const u32 hashed_start = offsetof(stfs_header, meta.pkg_type);
+        header->meta.header_sha1 = SHA1_buf(out + hashed_start, pkg->first_block_off - hashed_start);
+    }
+
+    FILE* f = fopen(out_path, "wb");
+    if (f == NULL) {
+        LOG_MSG(error, "Failed to open %s for writing\n", out_path);
+        free(out);
+        return false;
+    }
+    const bool ok = fwrite(out, out_size, 1, f) == 1;
+    fclose(f);
+    free(out);
+    return ok;
+}
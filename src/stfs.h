@@ -15,7 +15,9 @@
 
 #include "common/int.h"
 #include "common/file.h"
+#include "common/list.h"
 #include "common/sha1.h"
+#include "common/thread.h"
 
 typedef enum {
     STFS_CON  = MAGIC('C', 'O', 'N', ' '), // "CON " (console-signed)
@@ -92,6 +94,13 @@ typedef enum {
     STATUS_NEW_ALLOC = 0xC0,
 }stfs_status;
 
+// Top 2 bits of stfs_filetable.flags
+typedef enum {
+    STFS_FILE_CONSECUTIVE = 0x40, // All the blocks making up this file are consecutive
+    STFS_FILE_DIRECTORY = 0x80, // This is a directory, not a file
+    STFS_FILE_NAME_LEN = 0x3F, // Mask for the name length
+}stfs_file_flags;
+
 // Disable struct padding
 #pragma pack(push, r1, 1)
 
@@ -99,10 +108,10 @@ typedef enum {
 typedef struct {
     unsigned char filename[40];
 
-    // These 3 fields pack into 1 byte
-    u8 consecutive : 1; // All the blocks making up this file are consecutive
-    u8 directory : 1; // This is a directory, not a file
-    u8 name_len : 6;
+    // Name length in the low 6 bits, and stfs_file_flags in the top 2. This
+    // used to be bitfields, but compilers are free to order those however
+    // they like (and ours put them the opposite way from the file).
+    u8 flags;
 
     s8 blocks[3]; // This is a little endian s24
     s8 blocks2[3]; // Copy of the last field
@@ -226,23 +235,175 @@ enum {
     CON_DEVKIT = 1,
     CON_RETAIL = 2,
     STFS_BLOCK_SIZE = 0x1000,
+    STFS_HASHES_PER_TABLE = 0xAA, // Number of blocks covered by one hash table
+    STFS_BLOCKS_PER_L1 = 0xAA * 0xAA, // Data blocks covered by a level-1 table
+    STFS_BLOCKS_PER_L2 = 0xAA * 0xAA * 0xAA, // Data blocks covered by a level-2 table
+    STFS_HASH_COPY_ACTIVE = 0x40, // Status bit marking the second copy of a child table as active
+    STFS_CHAIN_END = 0xFFFFFF, // Next block number for the last block of a file
+    STFS_FILES_PER_BLOCK = STFS_BLOCK_SIZE / sizeof(stfs_filetable),
     BKNB_TITLE_ID = 0x4D5307ED,
 };
 
-// Gets the real block number for a file block (skipping hash table and file table blocks)
-u32 stfs_file_block(stfs_header* h, u32 block);
+// Options for reading files out of a package
+typedef enum {
+    STFS_READ_DEFAULT = 0,
+    STFS_READ_VERIFY = 1 << 0, // Check each block against its SHA1 while reading
+}stfs_read_flags;
+
+// Parsed hash tables of a package, indexed by data block number. This is built
+// once by stfs_open() by walking the whole hash tree, so following a file's
+// chain is just an array lookup.
+typedef struct {
+    u32 count; // Number of allocated data blocks
+    const stfs_hash_table** hashes; // Active level-0 hash entry of each block
+    u32* next; // Next block of the file chain, or STFS_CHAIN_END
+}stfs_block_index;
+
+// A hash table that doesn't match the hash stored in its parent (or the
+// volume descriptor, for the root table)
+typedef struct {
+    u32 level;
+    u32 first_block; // First data block the table covers
+}stfs_bad_table;
+
+// Results of checking every hash in a package with stfs_verify()
+typedef struct {
+    bool header_ok; // Header SHA1 matches the rest of the header
+    bool top_hash_ok; // Root hash table matches the volume descriptor
+    bool complete; // False if a check was skipped because an allocation failed
+    u32 blocks_checked; // Only allocated blocks have a meaningful hash
+    u32 tables_checked;
+    list bad_blocks; // Data block numbers (u32) that don't match their hash
+    list bad_tables; // stfs_bad_table
+}stfs_verify_report;
+
+// A file table entry with all the fields decoded
+typedef struct {
+    const stfs_filetable* raw; // Entry inside the mapping
+    u32 index; // Position in the file table, which |parent| refers to
+    char name[sizeof(((stfs_filetable*)0)->filename) + 1];
+    bool directory;
+    bool consecutive; // All the blocks are in order, so the chain can be skipped
+    s16 parent; // Index of the directory this is in. -1 means root directory
+    u32 size;
+    u32 start_block;
+    u32 block_count;
+}stfs_file_info;
+
+// An STFS package mapped into memory. Everything inside the mapping is left in
+// its on-disk form, so use the stfs_*() accessors (or the read_be*() helpers
+// in common/endian.h) when reading from the raw structures. Only the handful
+// of header fields we need all the time are cached here, already byteswapped.
+typedef struct {
+    mapped_file file;
+    const stfs_header* header; // Raw header inside the mapping (not byteswapped!)
+
+    u32 magic; // stfs_magic enum
+    u32 first_block_off; // Offset of the first block, see stfs_first_block_off()
+    u32 block_shift; // See stfs_block_shift()
+    u32 block_count; // Number of physical blocks actually present in the file
+    u32 ftable_block; // Physical block number of the file table
+
+    // Blocks between tables at level 0 & 1 (including the tables themselves)
+    u32 block_step[2];
+    u32 top_level; // Level of the root hash table (0-2)
+
+    stfs_block_index index;
+}stfs_package;
+
+// Walks every entry of the file table, including directories. There's no need
+// to free the iteration context.
+typedef struct {
+    const stfs_package* pkg;
+    const stfs_filetable* entry; // Entry the next call returns
+    u32 block; // Data block of the file table we're reading from
+    u32 blocks_left; // File table blocks left, including the current one
+    u32 entry_idx;
+    bool done;
+}stfs_file_iterator;
+
+// Map an STFS file into memory and validate its header.
+// On failure, the returned package has a NULL |file.data|.
+stfs_package stfs_open(const char* path);
+
+// Same as stfs_open(), for a package that's already in memory. The buffer
+// isn't copied, so it has to outlive the package.
+stfs_package stfs_open_buffer(const u8* data, u64 size);
+void stfs_close(stfs_package* pkg);
+
+// Get a pointer to a physical block inside the mapping, or NULL if the block is
+// past the end of the file. The pointer is valid until stfs_close().
+const u8* stfs_block_ptr(const stfs_package* pkg, u32 block_num);
+
+// Accessors for on-disk structures inside a package
+u32 stfs_hash_next_block(const stfs_hash_table* entry);
+u32 stfs_file_start_block(const stfs_filetable* entry);
+u32 stfs_file_size(const stfs_filetable* entry);
 
 // Offset of the first block in the STFS file. Should always be 0xA000.
 u32 stfs_first_block_off(stfs_header* header);
 
 // Converts a block number to a file offset. |block_num| must be < INT24_MAX.
-u32 stfs_blocknum_to_off(stfs_header* header, s32 block_num);
+u32 stfs_blocknum_to_off(const stfs_package* pkg, s32 block_num);
+
+// Converts a data block number to a physical block number, accounting for
+// the hash tables interleaved with the data.
+u32 stfs_data_block_num(const stfs_package* pkg, u32 block);
+
+// Physical block number of the hash table at |level| which covers data block
+// |block|. For packages with a block shift of 1, this is the first of the 2
+// copies of the table.
+u32 stfs_hash_table_block(const stfs_package* pkg, u32 block, u32 level);
+
+// Next data block in a file's chain, or STFS_CHAIN_END
+u32 stfs_next_block(const stfs_package* pkg, u32 block);
+
+// Check a data block against the SHA1 stored in its hash table
+bool stfs_verify_block(const stfs_package* pkg, u32 block);
+
+// Check every block of a file against its SHA1, without reading it out
+bool stfs_verify_file(const stfs_package* pkg, const stfs_filetable* entry);
+
+// Check every allocated block against its hash, every hash table against its
+// parent up to the top hash in the volume descriptor, and the header hash.
+// Block hashing is split across |pool| (NULL to use only this thread). Free the
+// report with stfs_report_free().
+stfs_verify_report stfs_verify(const stfs_package* pkg, thread_pool* pool);
+
+// Whether every check in the report passed
+bool stfs_report_ok(const stfs_verify_report* report);
+
+// Print a summary of the report, and every bad block/table
+void stfs_report_print(const stfs_verify_report* report);
+
+void stfs_report_free(stfs_verify_report* report);
+
+// Read a file out of the package into a new buffer, following its block chain.
+// |flags| is a combination of stfs_read_flags. Caller must free the buffer.
+u8* stfs_read_file(const stfs_package* pkg, const stfs_filetable* entry, u32 flags);
+
+stfs_file_iterator stfs_file_iterator_setup(const stfs_package* pkg);
+
+// Get the next entry and advance. Check ctx->done before using the result.
+stfs_file_info stfs_file_iterator_next(stfs_file_iterator* ctx);
+
+// Write every file in the package under |out_dir|, recreating the directory
+// structure. |flags| is a combination of stfs_read_flags. Returns the number
+// of files extracted.
+u32 stfs_extract_all(const stfs_package* pkg, const char* out_dir, u32 flags);
+
+// Returns a buffer with the first file in the package. In our use case, we
+// assume the first file is always a vehicle. Caller must free the buffer.
+u8* stfs_read_vehicle(const stfs_package* pkg, u32 flags);
 
-// Gets a block number, accounting for hash tables
-u32 stfs_data_block_num(stfs_header* header, u32 block);
+// Write a copy of |pkg| to |out_path| with the first file (the vehicle)
+// replaced by |vehicle|. Only blocks whose contents changed are rehashed, and
+// only the hash tables above them are rebuilt, along with the header hash.
+// The package's RSA signature is NOT updated, that needs the console's keys.
+bool stfs_write_vehicle(const stfs_package* pkg, const u8* vehicle, u32 size, const char* out_path);
 
 // Returns a buffer with the first file in the STFS archive. In our use case,
-// we assume the first file is always a vehicle.
+// we assume the first file is always a vehicle. Every block is verified.
 u8* stfs_get_vehicle(const char* path);
 
 // NOTE: See common/endian.h for info on endian-ness
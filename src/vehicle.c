@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <common/endian.h>
 #include <common/file.h>
@@ -11,66 +12,166 @@
 #include "parts.h"
 #include "stfs.h"
 
+// Every multi-byte field in a part entry. The padding is byteswapped too, just
+// in case :P
+static const endian_field part_fields[] = {
+    ENDIAN_FIELD(part_entry, unknown, 4),
+    ENDIAN_FIELD(part_entry, pad, 2),
+    ENDIAN_FIELD(part_entry, id, 4),
+    ENDIAN_FIELD(part_entry, rot, 4),
+    ENDIAN_FIELD(part_entry, pad3, 4),
+};
+static const endian_schema part_schema = ENDIAN_SCHEMA(part_entry, part_fields);
+
+static const endian_field vehicle_header_fields[] = {
+    ENDIAN_FIELD(vehicle_header, magic, 8),
+    ENDIAN_FIELD(vehicle_header, part_count, 2),
+    ENDIAN_FIELD(vehicle_header, power, 4),
+    ENDIAN_FIELD(vehicle_header, weight, 4),
+    ENDIAN_FIELD(vehicle_header, integrity, 4),
+    // 16-bit characters are also subject to endian-ness
+    ENDIAN_FIELD(vehicle_header, name, sizeof(c16)),
+};
+static const endian_schema vehicle_header_schema = ENDIAN_SCHEMA(vehicle_header, vehicle_header_fields);
+
 void part_byteswap(part_entry* part) {
-    if (is_little_endian()) {
-        ENDIAN_FLIP(u32, part->unknown);
-        ENDIAN_FLIP(u32, part->id);
-        vec3_byteswap(&part->rot);
+    parts_byteswap(part, 1);
+}
 
-        // Byte-swap the padding just in case :P
-        ENDIAN_FLIP(u16, part->pad);
-        ENDIAN_FLIP(u32, part->pad3);
+void parts_byteswap(part_entry* parts, u32 count) {
+    if (is_little_endian()) {
+        endian_swap_array(&part_schema, parts, count);
     }
 }
 
 void vehicle_header_byteswap(vehicle_header* v) {
     if (is_little_endian()) {
-        ENDIAN_FLIP(u64, v->magic);
-        ENDIAN_FLIP(u16, v->part_count);
-        for (u32 i = 0; i < ARRAY_SIZE(v->name); i++) {
-            // 16-bit characters are also subject to endian-ness
-            ENDIAN_FLIP(c16, v->name[i]);
-        }
-        ENDIAN_FLIP_FLOAT(v->weight);
-        ENDIAN_FLIP_FLOAT(v->power);
-        ENDIAN_FLIP_FLOAT(v->integrity);
+        endian_swap_array(&vehicle_header_schema, v, 1);
     }
 }
 
-vehicle* vehicle_load(const char* path) {
-    FILE* f = fopen(path, "rb");
-    if (f == NULL) {
-        LOG_MSG(error, "Failed to open %s\n", path);
-        return NULL;
+vehicle_format vehicle_get_format(const u8* data, size_t size) {
+    // The STFS magic is compared as raw bytes, same as stfs_open()
+    u32 stfs_magic = 0;
+    if (size >= sizeof(stfs_magic)) {
+        memcpy(&stfs_magic, data, sizeof(stfs_magic));
+    }
+    // Saves are always CON. LIVE & PIRS packages are DLC or updates, which
+    // stfs_open() can't read anyway.
+    if (stfs_magic == STFS_CON) {
+        return VEHICLE_FORMAT_STFS;
     }
 
-    vehicle_header head = {0};
-    fread(&head, sizeof(head), 1, f);
-    fclose(f);
-    vehicle_header_byteswap(&head);
+    if (size >= sizeof(u64) && read_be64(data) == VEHICLE_MAGIC) {
+        return VEHICLE_FORMAT_RAW;
+    }
+    return VEHICLE_FORMAT_NONE;
+}
 
-    vehicle* v = NULL;
-    if (head.magic == VEHICLE_MAGIC) {
-        // Header claims it's a vehicle file, just load it directly
-        LOG_MSG(debug, "Loading vehicle from raw save file %s\n", path);
-        v = (vehicle*)file_load(path); // Reads file into a buffer for us
+bool vehicle_stfs_has_vehicle(const u8* data, size_t size) {
+    stfs_package pkg = stfs_open_buffer(data, size);
+    if (pkg.file.data == NULL) {
+        return false;
     }
-    else {
-        // Not a vehicle file, try to load it as an STFS save file.
-        LOG_MSG(debug, "Loading vehicle from STFS save entry\n");
-        v = (vehicle*)stfs_get_vehicle(path);
+    // The vehicle is always the first file
+    bool result = false;
+    const stfs_filetable* entry = (const stfs_filetable*)stfs_block_ptr(&pkg, pkg.ftable_block);
+    if (entry != NULL && stfs_file_size(entry) >= sizeof(u64)) {
+        const u8* first = stfs_block_ptr(&pkg, stfs_data_block_num(&pkg, stfs_file_start_block(entry)));
+        result = (first != NULL && read_be64(first) == VEHICLE_MAGIC);
     }
+    stfs_close(&pkg);
+    return result;
+}
 
-    if (v == NULL) {
-        LOG_MSG(error, "Failed to load vehicle\n");
-        return NULL;
+const char* vehicle_format_name(vehicle_format format) {
+    switch (format) {
+    case VEHICLE_FORMAT_RAW:
+        return "raw";
+    case VEHICLE_FORMAT_STFS:
+        return "STFS";
+    default:
+        return "none";
     }
+}
 
+// Byte-swap a vehicle we just read, after making sure the parts really fit in
+// the buffer. Takes ownership of |v| (it's freed on failure).
+static vehicle* vehicle_finish_load(vehicle* v, size_t size) {
+    if (size < sizeof(vehicle_header)) {
+        LOG_MSG(error, "Vehicle is too small to have a header (0x%X bytes)\n", (u32)size);
+        free(v);
+        return NULL;
+    }
     // Byte-swap everything & return result
     vehicle_header_byteswap(&v->head);
-    for (u16 i = 0; i < v->head.part_count; i++) {
-        part_byteswap(&v->parts[i]);
+    const size_t parts_size = (size_t)v->head.part_count * sizeof(part_entry);
+    if (parts_size > size - sizeof(vehicle_header)) {
+        LOG_MSG(error, "Header says there are %d parts, but there's only room for %d\n", v->head.part_count, (u32)((size - sizeof(vehicle_header)) / sizeof(part_entry)));
+        free(v);
+        return NULL;
     }
+    parts_byteswap(v->parts, v->head.part_count);
     return v;
 }
 
+vehicle* vehicle_load_buffer(const u8* data, size_t size) {
+    u8* buf = NULL;
+    switch (vehicle_get_format(data, size)) {
+    case VEHICLE_FORMAT_RAW:
+        // We byteswap in place, so we need our own copy
+        buf = malloc(size);
+        if (buf == NULL) {
+            return NULL;
+        }
+        memcpy(buf, data, size);
+        break;
+    case VEHICLE_FORMAT_STFS: {
+        LOG_MSG(debug, "Loading vehicle from STFS save entry\n");
+        stfs_package pkg = stfs_open_buffer(data, size);
+        if (pkg.file.data == NULL) {
+            return NULL;
+        }
+        buf = stfs_read_vehicle(&pkg, STFS_READ_VERIFY);
+        if (buf != NULL && read_be64(buf) != VEHICLE_MAGIC) {
+            LOG_MSG(error, "First file in the STFS package isn't a vehicle\n");
+            free(buf);
+            buf = NULL;
+        }
+        if (buf != NULL) {
+            // The first file is the vehicle, that's all stfs_read_vehicle() reads
+            const stfs_filetable* entry = (const stfs_filetable*)stfs_block_ptr(&pkg, pkg.ftable_block);
+            size = stfs_file_size(entry);
+        }
+        stfs_close(&pkg);
+        break;
+    }
+    default:
+        LOG_MSG(error, "Input isn't a vehicle or STFS package\n");
+        return NULL;
+    }
+
+    if (buf == NULL) {
+        LOG_MSG(error, "Failed to load vehicle\n");
+        return NULL;
+    }
+    return vehicle_finish_load((vehicle*)buf, size);
+}
+
+vehicle* vehicle_load(const char* path) {
+    u64 size = 0;
+    u8* data = file_load_sized(path, &size);
+    if (data == NULL) {
+        LOG_MSG(error, "Failed to open %s\n", path);
+        return NULL;
+    }
+
+    if (vehicle_get_format(data, size) == VEHICLE_FORMAT_RAW) {
+        // Nobody else has this buffer, so we can use it without a copy
+        LOG_MSG(debug, "Loading vehicle from raw save file %s\n", path);
+        return vehicle_finish_load((vehicle*)data, size);
+    }
+    vehicle* v = vehicle_load_buffer(data, size);
+    free(data);
+    return v;
+}
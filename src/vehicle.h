@@ -1,6 +1,8 @@
 #ifndef VEHICLE_H
 #define VEHICLE_H
 #include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "common/int.h"
 #include "common/vector.h"
 // Vehicle data structures for Nuts & Bolts. The header has a lot of holes, but
@@ -20,7 +22,7 @@ typedef struct {
     u8 unk2[0x8]; // This is very incomplete, there's lots of other data here.
     c16 name[0x20];
     u8 unk3[0x18];
-    // If you add new fields, make sure to update vehicle_header_byteswap().
+    // If you add new fields, make sure to update vehicle_header_fields in vehicle.c.
 }vehicle_header;
 static_assert(sizeof(vehicle_header) == 0x80, "vehicle_header size is wrong!");
 
@@ -50,17 +52,48 @@ typedef struct {
     part_entry parts[];
 }vehicle;
 
+// How a vehicle is stored on disk
+typedef enum {
+    VEHICLE_FORMAT_NONE, // Not a vehicle (or we couldn't read it)
+    VEHICLE_FORMAT_RAW, // Bare vehicle file, starting with VEHICLE_MAGIC
+    VEHICLE_FORMAT_STFS, // Save file with the vehicle inside an STFS package
+}vehicle_format;
+
+enum {
+    // Bytes vehicle_get_format() needs from the start of a file
+    VEHICLE_FORMAT_PEEK_SIZE = sizeof(u64),
+};
+
+// Peek at the start of a file to see what kind of vehicle file it is. STFS
+// packages are only recognized by their magic, they might not actually
+// contain a vehicle (see vehicle_stfs_has_vehicle()).
+vehicle_format vehicle_get_format(const u8* data, size_t size);
+
+// Check that the first file in an STFS save is a vehicle. Other games keep
+// their saves in the same kind of package. Needs the whole package.
+bool vehicle_stfs_has_vehicle(const u8* data, size_t size);
+
+const char* vehicle_format_name(vehicle_format format);
+
 // Load a vehicle into a newly allocated buffer. Automatically handles STFS if
 // needed (it's assumed that the vehicle is stored as the first file entry, and
 // is under 680KiB).
 // Returns NULL on failure, caller must free the buffer.
 vehicle* vehicle_load(const char* path);
 
+// Same as vehicle_load(), for a file that's already in memory (from PhysFS, an
+// archive, etc.). Raw or STFS is detected from the data. The input buffer isn't
+// modified or kept, the result is always a new allocation.
+vehicle* vehicle_load_buffer(const u8* data, size_t size);
+
 // NOTE: See common/endian.h for details on endian-ness.
 
 // Byte-swap an existing part entry
 void part_byteswap(part_entry* part);
 
+// Byte-swap a whole array of part entries in one pass
+void parts_byteswap(part_entry* parts, u32 count);
+
 // Byte-swap an existing vehicle header
 void vehicle_header_byteswap(vehicle_header* v);
 
@@ -3,17 +3,37 @@
 #include <common/int.h>
 #include <common/logging.h>
 
+#include "parts.h"
+
 bool test_stfs();
 bool test_list();
+bool test_sha1();
+bool test_endian();
+bool test_parts();
+bool test_brick_map();
+bool test_frustum();
+bool test_model();
+bool test_vehicle_edit();
 
 typedef bool (*testproc)(void);
 testproc tests[] = {
     test_stfs,
     test_list,
+    test_sha1,
+    test_endian,
+    test_parts,
+    test_brick_map,
+    test_frustum,
+    test_model,
+    test_vehicle_edit,
 };
 
 int main() {
     enable_win_ansi();
+    if (!parts_init()) {
+        LOG_MSG(error, "Failed to build part tables\n");
+        return 1;
+    }
 
     LOG_MSG(info, "Running %d tests\n", ARRAY_SIZE(tests));
     u32 passed_count = 0;
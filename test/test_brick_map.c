@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/brick_map.h>
+#include <common/logging.h>
+
+#include "testing.h"
+
+// Every brick position has to survive being turned into a key and back
+static bool test_brick_keys() {
+    for (u32 x = 0; x < 128; x += BRICK_DIM) {
+        for (u32 y = 0; y < 128; y += BRICK_DIM) {
+            for (u32 z = 0; z < 128; z += BRICK_DIM) {
+                u8 corner[3] = {0};
+                // Any cell in the brick has to give the same key
+                const u16 key = brick_key(x + 7, y + 3, z);
+                brick_key_decode(key, corner);
+                if (corner[0] != x || corner[1] != y || corner[2] != z) {
+                    LOG_MSG(error, "Brick (%d, %d, %d) decoded to (%d, %d, %d)\n", x, y, z, corner[0], corner[1], corner[2]);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Add & remove bricks in a scrambled order, checking against a plain array
+static bool test_brick_add_remove() {
+    enum { KEY_COUNT = BRICK_GRID_DIM * BRICK_GRID_DIM * BRICK_GRID_DIM };
+    static bool present[KEY_COUNT];
+    memset(present, 0x00, sizeof(present));
+    brick_map map = brick_map_create(sizeof(u32));
+
+    bool result = true;
+    u32 count = 0;
+    for (u32 i = 0; i < KEY_COUNT * 4 && result; i++) {
+        const u16 key = (i * 2654435761u) >> 20;
+        if (present[key] && (i % 3) != 0) {
+            brick_map_remove(&map, key);
+            present[key] = false;
+            count--;
+        }
+        else if (!present[key]) {
+            u32* brick = brick_map_get_or_add(&map, key);
+            if (brick == NULL || *brick != 0) {
+                LOG_MSG(error, "Brick 0x%X wasn't added empty\n", key);
+                result = false;
+                break;
+            }
+            *brick = key + 1;
+            present[key] = true;
+            count++;
+        }
+
+        // Spot check a few keys every time, and everything now and then
+        const u32 check_count = (i % 512 == 0) ? KEY_COUNT : 8;
+        for (u32 j = 0; j < check_count; j++) {
+            const u16 check = (check_count == KEY_COUNT) ? j : (key + j * 97) % KEY_COUNT;
+            const u32* brick = brick_map_get(&map, check);
+            if ((brick != NULL) != present[check] || (brick != NULL && *brick != check + 1u)) {
+                LOG_MSG(error, "Brick 0x%X is wrong after %d changes\n", check, i);
+                result = false;
+                break;
+            }
+        }
+    }
+    result &= (map.count == count);
+
+    brick_map_clear(&map);
+    result &= (map.count == 0 && brick_map_get(&map, 0) == NULL);
+    brick_map_destroy(&map);
+    return result;
+}
+
+bool test_brick_map() {
+    bool result = true;
+    result &= test_brick_keys();
+    result &= test_brick_add_remove();
+
+    REPORT_RESULT(result);
+    return result;
+}
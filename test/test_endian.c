@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include <common/endian.h>
+#include <common/logging.h>
+
+#include <stfs.h>
+#include <vehicle.h>
+
+#include "testing.h"
+
+// The old way of byteswapping a part, one field at a time
+static void part_byteswap_reference(part_entry* part) {
+    ENDIAN_FLIP(u32, part->unknown);
+    ENDIAN_FLIP(u32, part->id);
+    for (u8 i = 0; i < 3; i++) {
+        ENDIAN_FLIP_FLOAT(part->rot[i]);
+    }
+    ENDIAN_FLIP(u16, part->pad);
+    ENDIAN_FLIP(u32, part->pad3);
+}
+
+// The SIMD path has to agree with swapping each field by hand, including for
+// the leftover parts that don't fill a whole shuffle pattern.
+static bool test_parts_byteswap() {
+    enum { PART_COUNT = 37 };
+    static part_entry parts[PART_COUNT];
+    static part_entry expected[PART_COUNT];
+    u8* bytes = (u8*)parts;
+    for (u32 i = 0; i < sizeof(parts); i++) {
+        bytes[i] = (i * 2654435761u) >> 24;
+    }
+    memcpy(expected, parts, sizeof(parts));
+    // Nothing should happen on big endian
+    for (u32 i = 0; i < PART_COUNT && is_little_endian(); i++) {
+        part_byteswap_reference(&expected[i]);
+    }
+    parts_byteswap(parts, PART_COUNT);
+
+    for (u32 i = 0; i < PART_COUNT; i++) {
+        if (memcmp(&parts[i], &expected[i], sizeof(part_entry)) != 0) {
+            LOG_MSG(error, "Part %d was byteswapped wrong\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_header_byteswap() {
+    bool result = true;
+    if (!is_little_endian()) {
+        return result;
+    }
+
+    vehicle_header head = {0};
+    head.magic = VEHICLE_MAGIC;
+    head.part_count = 0x1234;
+    head.name[0] = 'A';
+    head.name[0x1F] = 'Z';
+    vehicle_header_byteswap(&head);
+    if (read_be64(&head.magic) != VEHICLE_MAGIC || read_be16(&head.part_count) != 0x1234) {
+        LOG_MSG(error, "Vehicle header fields weren't swapped\n");
+        result = false;
+    }
+    if (read_be16(&head.name[0]) != 'A' || read_be16(&head.name[0x1F]) != 'Z') {
+        LOG_MSG(error, "Vehicle name wasn't swapped\n");
+        result = false;
+    }
+
+    // Every license ID has to be swapped, not just the first one
+    static stfs_header stfs = {0};
+    for (u32 i = 0; i < ARRAY_SIZE(stfs.meta.licenses); i++) {
+        stfs.meta.licenses[i].id = i + 1;
+    }
+    stfs_header_byteswap(&stfs);
+    for (u32 i = 0; i < ARRAY_SIZE(stfs.meta.licenses); i++) {
+        if (read_be64(&stfs.meta.licenses[i].id) != i + 1) {
+            LOG_MSG(error, "License %d wasn't swapped\n", i);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+bool test_endian() {
+    bool result = true;
+    result &= test_parts_byteswap();
+    result &= test_header_byteswap();
+
+    REPORT_RESULT(result);
+    return result;
+}
@@ -0,0 +1,101 @@
+#include <math.h>
+
+#include <common/frustum.h>
+#include <common/logging.h>
+
+#include "testing.h"
+
+enum {
+    SPHERE_COUNT = 1023, // Not a multiple of 4, so the scalar tail runs too
+};
+
+// Small LCG so the test is the same every run
+static float rand_range(u32* state, float min, float max) {
+    *state = (*state * 1664525u) + 1013904223u;
+    return min + ((float)(*state >> 8) / (float)(1 << 24)) * (max - min);
+}
+
+// With a scale & translation matrix, the frustum is a box and every sphere can
+// be checked by hand
+static bool test_frustum_box() {
+    // Maps [1, 5] x [-2, 2] x [-3, 1] to the [-1, 1] clip space cube
+    const float m[16] = {
+        0.5f, 0, 0, 0,
+        0, 0.5f, 0, 0,
+        0, 0, 0.5f, 0,
+        -1.5f, 0, 0.5f, 1,
+    };
+    const float lo[3] = {1, -2, -3};
+    const float hi[3] = {5, 2, 1};
+    const frustum f = frustum_from_matrix(m);
+
+    static float pos[3][SPHERE_COUNT];
+    static float radius[SPHERE_COUNT];
+    static u8 visible[SPHERE_COUNT];
+    u32 seed = 12345;
+    for (u32 i = 0; i < SPHERE_COUNT; i++) {
+        for (u8 axis = 0; axis < 3; axis++) {
+            pos[axis][i] = rand_range(&seed, lo[axis] - 4, hi[axis] + 4);
+        }
+        radius[i] = rand_range(&seed, 0, 2);
+    }
+    frustum_cull_spheres(&f, pos[0], pos[1], pos[2], radius, SPHERE_COUNT, visible);
+
+    u32 visible_count = 0;
+    for (u32 i = 0; i < SPHERE_COUNT; i++) {
+        bool expected = true;
+        bool close_call = false;
+        for (u8 axis = 0; axis < 3; axis++) {
+            const float below = lo[axis] - pos[axis][i];
+            const float above = pos[axis][i] - hi[axis];
+            expected &= (below <= radius[i] && above <= radius[i]);
+            // Rounding can go either way right on the edge
+            close_call |= fabsf(below - radius[i]) < 0.001f || fabsf(above - radius[i]) < 0.001f;
+        }
+        // The compiler is allowed to fuse the scalar code's multiplies & adds
+        // (e.g. on ARM), so only spheres right on a plane can differ
+        if (!close_call && visible[i] != frustum_test_sphere(&f, pos[0][i], pos[1][i], pos[2][i], radius[i])) {
+            LOG_MSG(error, "Sphere %d culled differently one at a time\n", i);
+            return false;
+        }
+        if (!close_call && visible[i] != expected) {
+            LOG_MSG(error, "Sphere %d at (%.2f, %.2f, %.2f) r=%.2f should be %s\n", i, pos[0][i], pos[1][i], pos[2][i], radius[i], expected ? "visible" : "culled");
+            return false;
+        }
+        visible_count += visible[i];
+    }
+    // Make sure the test actually covers both outcomes
+    return visible_count > 0 && visible_count < SPHERE_COUNT;
+}
+
+// A perspective camera at the origin looking down -Z
+static bool test_frustum_perspective() {
+    const float near = 0.1f;
+    const float far = 100.0f;
+    const float focal = 1.0f / tanf(0.5f); // 1 radian field of view
+    const float m[16] = {
+        focal, 0, 0, 0,
+        0, focal, 0, 0,
+        0, 0, (far + near) / (near - far), -1,
+        0, 0, (2 * far * near) / (near - far), 0,
+    };
+    const frustum f = frustum_from_matrix(m);
+
+    bool result = true;
+    result &= frustum_test_sphere(&f, 0, 0, -10, 0.5f); // Straight ahead
+    result &= !frustum_test_sphere(&f, 0, 0, 10, 0.5f); // Behind
+    result &= frustum_test_sphere(&f, 0, 0, 1, 2); // Behind, but big enough to reach past the near plane
+    result &= !frustum_test_sphere(&f, 0, 0, -150, 10); // Past the far plane
+    result &= !frustum_test_sphere(&f, 50, 0, -10, 1); // Way off to the side
+    result &= frustum_test_sphere(&f, 5, 0, -10, 1); // Just inside the edge (~5.46 units at this depth)
+    return result;
+}
+
+bool test_frustum() {
+    bool result = true;
+    result &= test_frustum_box();
+    result &= test_frustum_perspective();
+
+    REPORT_RESULT(result);
+    return result;
+}
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/file.h>
+#include <common/logging.h>
+#include <common/model.h>
+
+#include "testing.h"
+
+static const char* model_path = "../bin/98905F1F.obj";
+
+static bool models_equal(model a, model b) {
+    return a.vert_count == b.vert_count && a.idx_count == b.idx_count
+        && memcmp(a.vertices, b.vertices, a.vert_count * sizeof(vertex)) == 0
+        && memcmp(a.indices, b.indices, a.idx_count * sizeof(u16)) == 0;
+}
+
+static int triangle_compare(const vertex* a, const vertex* b) {
+    return memcmp(a, b, sizeof(vertex) * 3);
+}
+
+static void model_free(model m) {
+    free((void*)m.vertices);
+    free((void*)m.indices);
+}
+
+// Every triangle written out as its 3 vertices, sorted. Models with the same
+// triangles in a different order (or with the vertices numbered differently)
+// give the same list. Caller must free the output.
+static vertex* model_triangles(model m) {
+    vertex* tris = calloc(m.idx_count, sizeof(vertex));
+    if (tris == NULL) {
+        return NULL;
+    }
+    const vertex* vertices = m.vertices;
+    for (u32 i = 0; i < m.idx_count; i++) {
+        tris[i] = vertices[m.indices[i]];
+    }
+    qsort(tris, m.idx_count / 3, sizeof(vertex) * 3, (int (*)(const void*, const void*))triangle_compare);
+    return tris;
+}
+
+static bool same_triangles(model a, model b) {
+    vertex* tris_a = model_triangles(a);
+    vertex* tris_b = model_triangles(b);
+    const bool result = (tris_a != NULL && tris_b != NULL && a.idx_count == b.idx_count
+                         && memcmp(tris_a, tris_b, a.idx_count * sizeof(vertex)) == 0);
+    free(tris_a);
+    free(tris_b);
+    return result;
+}
+
+// Average number of vertices per triangle that miss a FIFO cache of
+// [cache_size] vertices, like older GPUs have. 3 is the worst possible, and it
+// can't go below the number of vertices per triangle.
+static float model_acmr(model m, u32 cache_size) {
+    u16 cache[64] = {0};
+    u32 cache_count = 0;
+    u32 next = 0;
+    u32 misses = 0;
+    for (u32 i = 0; i < m.idx_count; i++) {
+        bool hit = false;
+        for (u32 j = 0; j < cache_count; j++) {
+            hit |= (cache[j] == m.indices[i]);
+        }
+        if (!hit) {
+            misses++;
+            cache[next] = m.indices[i];
+            next = (next + 1) % cache_size;
+            cache_count = MIN(cache_count + 1, cache_size);
+        }
+    }
+    return (float)misses / (m.idx_count / 3);
+}
+
+// Quads, the other face formats, relative indices & colorless vertices all
+// have to come out as plain triangles, without the text being touched.
+static bool test_obj_syntax() {
+    static const char txt[] =
+        "# A quad & a triangle\r\n"
+        "o test\r\n"
+        "v 1.5 -2.25 3e1 0.5 1 0\r\n"
+        "v -.125 +4 -25E-2 0 0 1\r\n"
+        "  v 0 0 0\r\n"
+        "v 10 20 30 1 1 1\r\n"
+        "vt 0.5 0.5\n"
+        "vn 0 1 0\n"
+        "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+        "f -1//1 -2//1 1 # trailing comment";
+    char copy[sizeof(txt)];
+    memcpy(copy, txt, sizeof(txt));
+
+    const model m = obj_load((const u8*)copy);
+    bool result = (memcmp(copy, txt, sizeof(txt)) == 0);
+    result &= (m.vert_count == 4 && m.idx_count == 9);
+    if (!result) {
+        model_free(m);
+        return false;
+    }
+
+    // 0.5 rounds up to 128
+    const vertex vertices[] = {
+        {.position = {{VERTEX_POS(1.5f), VERTEX_POS(-2.25f), VERTEX_POS(30)}}, .color = {128, 0xFF, 0, 0xFF}},
+        {.position = {{VERTEX_POS(-0.125f), VERTEX_POS(4), VERTEX_POS(-0.25f)}}, .color = {0, 0, 0xFF, 0xFF}},
+        {.position = {{0, 0, 0}}, .color = {0xFF, 0xFF, 0xFF, 0xFF}},
+        {.position = {{VERTEX_POS(10), VERTEX_POS(20), VERTEX_POS(30)}}, .color = {0xFF, 0xFF, 0xFF, 0xFF}},
+    };
+    const u16 indices[] = {0, 1, 2, 0, 2, 3, 3, 2, 0};
+    const model expected = {vertices, indices, ARRAY_SIZE(vertices), ARRAY_SIZE(indices)};
+    result &= same_triangles(m, expected);
+    model_free(m);
+
+    // Pointing at a vertex that doesn't exist
+    result &= (obj_load((const u8*)"v 0 0 0\nf 1 2 3\n").vertices == NULL);
+    return result;
+}
+
+// Scramble the triangles of a model, then check that model_optimize() gets the
+// cache misses back down without losing or flipping any triangles.
+static bool test_model_optimize(model obj) {
+    const u32 tri_count = obj.idx_count / 3;
+    vertex* vertices = malloc(obj.vert_count * sizeof(vertex));
+    u16* indices = malloc(obj.idx_count * sizeof(u16));
+    if (vertices == NULL || indices == NULL) {
+        free(vertices);
+        free(indices);
+        return false;
+    }
+    memcpy(vertices, obj.vertices, obj.vert_count * sizeof(vertex));
+    memcpy(indices, obj.indices, obj.idx_count * sizeof(u16));
+    for (u32 i = tri_count - 1; i > 0; i--) {
+        const u32 j = (i * 2654435761u) % (i + 1);
+        u16 tmp[3] = {0};
+        memcpy(tmp, &indices[i * 3], sizeof(tmp));
+        memcpy(&indices[i * 3], &indices[j * 3], sizeof(tmp));
+        memcpy(&indices[j * 3], tmp, sizeof(tmp));
+    }
+    const model shuffled = {vertices, indices, obj.vert_count, obj.idx_count};
+    const float shuffled_acmr = model_acmr(shuffled, 16);
+
+    model_optimize(vertices, indices, obj.vert_count, obj.idx_count);
+    const float optimized_acmr = model_acmr(shuffled, 16);
+    LOG_MSG(info, "ACMR with a 16 vertex cache: %.3f shuffled, %.3f optimized\n", shuffled_acmr, optimized_acmr);
+    bool result = (optimized_acmr < shuffled_acmr / 2);
+    result &= same_triangles(obj, shuffled);
+
+    // Vertices are numbered in the order they're first used
+    u16 next = 0;
+    for (u32 i = 0; i < obj.idx_count; i++) {
+        result &= (indices[i] <= next);
+        next = MAX(next, indices[i] + 1);
+    }
+
+    free(vertices);
+    free(indices);
+    return result;
+}
+
+// A baked mesh has to load back exactly the same as the OBJ it came from, and
+// anything that isn't a complete mesh has to be turned down.
+bool test_model() {
+    u8* txt = file_load(model_path);
+    if (txt == NULL) {
+        REPORT_RESULT(false);
+        return false;
+    }
+    const model obj = obj_load(txt);
+    free(txt);
+    bool result = (obj.vertices != NULL && obj.indices != NULL && obj.vert_count > 0);
+    result &= test_obj_syntax();
+    result &= (obj.vertices != NULL && test_model_optimize(obj));
+
+    u64 size = 0;
+    u8* mesh = mesh_save(obj, &size);
+    result &= (mesh != NULL && size == sizeof(mesh_header) + (obj.vert_count * sizeof(vertex)) + (obj.idx_count * sizeof(u16)));
+    if (!result) {
+        free(mesh);
+        model_free(obj);
+        REPORT_RESULT(result);
+        return result;
+    }
+
+    const model loaded = mesh_load(mesh, size);
+    result &= models_equal(obj, loaded);
+    model_free(loaded);
+
+    // Cut off before the last index
+    result &= (mesh_load(mesh, size - 1).vertices == NULL);
+
+    // Index pointing past the last vertex
+    u16* last_idx = (u16*)(mesh + size - sizeof(u16));
+    const u16 saved_idx = *last_idx;
+    *last_idx = obj.vert_count;
+    result &= (mesh_load(mesh, size).vertices == NULL);
+    *last_idx = saved_idx;
+
+    // Different version
+    ((mesh_header*)mesh)->version++;
+    result &= (mesh_load(mesh, size).vertices == NULL);
+
+    free(mesh);
+    model_free(obj);
+    REPORT_RESULT(result);
+    return result;
+}
@@ -0,0 +1,92 @@
+#include <math.h>
+
+#include <cglm/cglm.h>
+
+#include <common/logging.h>
+
+#include <parts.h>
+
+#include "testing.h"
+
+// Rotate a point with the same matrix render_garage.c builds for part models,
+// so the tables are checked against what actually ends up on screen
+static vec3s8 rotate_euler(vec3s8 p, const float rot[3]) {
+    mat4 model = {0};
+    glm_mat4_identity(model);
+    glm_rotate_x(model, rot[0], model);
+    glm_rotate_y(model, rot[1], model);
+    glm_rotate_z(model, rot[2], model);
+
+    vec3 v = {p.x, p.y, p.z};
+    glm_mat4_mulv3(model, v, 1.0f, v);
+    return (vec3s8){{roundf(v[0]), roundf(v[1]), roundf(v[2])}};
+}
+
+// Every combination of quarter turns (including negative ones) has to land on
+// an orientation whose cells match rotating the part directly.
+static bool test_part_orientations() {
+    const float quarter = 1.57079632679f;
+    bool seen[PART_ORIENTATIONS] = {0};
+    for (s32 x = -4; x < 4; x++) {
+        for (s32 y = -4; y < 4; y++) {
+            for (s32 z = -4; z < 4; z++) {
+                const float rot[3] = {x * quarter, y * quarter, z * quarter};
+                const u8 orientation = part_orientation_from_euler(rot);
+                if (orientation >= PART_ORIENTATIONS) {
+                    return false;
+                }
+                seen[orientation] = true;
+
+                for (u32 i = 0; i < NUM_PARTS; i++) {
+                    const part_cells base = part_get_cells(partdata[i].id, 0);
+                    const part_cells turned = part_get_cells(partdata[i].id, orientation);
+                    if (base.count == 0 || base.count != turned.count) {
+                        return false;
+                    }
+                    for (u32 c = 0; c < base.count; c++) {
+                        if (!vec3s8_eq(rotate_euler(base.cells[c], rot), turned.cells[c])) {
+                            LOG_MSG(error, "%s cell %d is wrong at rotation (%d, %d, %d)\n", partdata[i].name, c, x, y, z);
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (u32 i = 0; i < PART_ORIENTATIONS; i++) {
+        if (!seen[i]) {
+            LOG_MSG(error, "Orientation %d can't be reached with Euler angles\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every part has to be found by its own ID, and anything else has to land on
+// the placeholder at the end
+static bool test_part_lookup() {
+    for (u32 i = 0; i < ARRAY_SIZE(partdata); i++) {
+        if (part_get_info(partdata[i].id) != &partdata[i]) {
+            LOG_MSG(error, "Looking up %s (0x%X) found the wrong part\n", partdata[i].name, partdata[i].id);
+            return false;
+        }
+    }
+    const part_info* unknown = &partdata[NUM_PARTS];
+    return part_get_info(0x12345678) == unknown && part_get_info(0xCCCCCCCC) == unknown;
+}
+
+bool test_parts() {
+    bool result = true;
+    const float no_rot[3] = {0};
+    result &= (part_orientation_from_euler(no_rot) == 0);
+
+    // Orientation 0 is the data as written, with the origin added at the end
+    const part_cells scuba = part_get_cells(SEAT_SCUBA, 0);
+    result &= (scuba.count == 3 && vec3s8_eq(scuba.cells[0], (vec3s8){{0, 1, -1}}) && vec3s8_eq(scuba.cells[2], (vec3s8){0}));
+    result &= test_part_orientations();
+    result &= test_part_lookup();
+
+    REPORT_RESULT(result);
+    return result;
+}
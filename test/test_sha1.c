@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/logging.h>
+#include <common/sha1.h>
+
+#include "testing.h"
+
+typedef struct {
+    const char* msg;
+    u32 repeat; // Number of times |msg| is repeated
+    const char* hash; // Expected digest as lowercase hex
+}sha1_vector;
+
+// Test vectors from FIPS 180-2
+static const sha1_vector vectors[] = {
+    {"", 1, "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
+    {"abc", 1, "a9993e364706816aba3e25717850c26c9cd0d89d"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1, "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+    {"a", 1000000, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"},
+};
+
+static bool sha1_matches(sha1_digest d, const char* hex) {
+    char str[SHA1_HASH_SIZE * 2 + 1] = {0};
+    for (u32 i = 0; i < SHA1_HASH_SIZE; i++) {
+        snprintf(&str[i * 2], 3, "%02x", d.bytes[i]);
+    }
+    return strcmp(str, hex) == 0;
+}
+
+// Check one backend against the test vectors, hashing both in one shot and in
+// awkwardly-sized pieces to exercise the partial block handling.
+static bool test_sha1_backend(sha1_backend backend) {
+    bool result = true;
+    for (u32 i = 0; i < ARRAY_SIZE(vectors); i++) {
+        const u32 len = strlen(vectors[i].msg);
+        const u32 total = len * vectors[i].repeat;
+        u8* buf = malloc(total + 1);
+        if (buf == NULL) {
+            return false;
+        }
+        for (u32 r = 0; r < vectors[i].repeat; r++) {
+            memcpy(buf + (r * len), vectors[i].msg, len);
+        }
+
+        if (!sha1_matches(SHA1_buf(buf, total), vectors[i].hash)) {
+            LOG_MSG(error, "%s: one-shot hash of vector %d is wrong\n", SHA1_backend_name(backend), i);
+            result = false;
+        }
+
+        sha1_ctx ctx;
+        SHA1_init(&ctx);
+        u32 done = 0;
+        for (u32 step = 1; done < total; step = (step * 7 + 3) % 200) {
+            const u32 n = MIN(step, total - done);
+            SHA1_update(&ctx, buf + done, n);
+            done += n;
+        }
+        if (!sha1_matches(SHA1_final(&ctx), vectors[i].hash)) {
+            LOG_MSG(error, "%s: streamed hash of vector %d is wrong\n", SHA1_backend_name(backend), i);
+            result = false;
+        }
+        free(buf);
+    }
+    return result;
+}
+
+// The multi-buffer path has to agree with hashing each buffer on its own,
+// including when the count doesn't fill every SIMD lane.
+static bool test_sha1_many() {
+    enum { MAX_BUFS = 37, MAX_LEN = 0x1000 };
+    u8* data = malloc(MAX_BUFS * MAX_LEN);
+    if (data == NULL) {
+        return false;
+    }
+    for (u32 i = 0; i < MAX_BUFS * MAX_LEN; i++) {
+        data[i] = (i * 2654435761u) >> 24;
+    }
+    const u8* bufs[MAX_BUFS];
+    for (u32 i = 0; i < MAX_BUFS; i++) {
+        bufs[i] = data + (i * MAX_LEN);
+    }
+
+    bool result = true;
+    const u32 lens[] = {0, 55, 60, 64, 1000, MAX_LEN};
+    const u32 counts[] = {1, 5, 8, 13, 16, MAX_BUFS};
+    for (u32 l = 0; l < ARRAY_SIZE(lens); l++) {
+        for (u32 c = 0; c < ARRAY_SIZE(counts); c++) {
+            sha1_digest out[MAX_BUFS];
+            SHA1_buf_many(bufs, counts[c], lens[l], out);
+            for (u32 i = 0; i < counts[c]; i++) {
+                if (!SHA1_equal(out[i], SHA1_buf(bufs[i], lens[l]))) {
+                    LOG_MSG(error, "Buffer %d of %d (%d bytes) hashed wrong\n", i, counts[c], lens[l]);
+                    result = false;
+                    break;
+                }
+            }
+        }
+    }
+    free(data);
+    return result;
+}
+
+bool test_sha1() {
+    bool result = true;
+    const sha1_backend detected = SHA1_get_backend();
+    LOG_MSG(info, "Using %s SHA1 backend\n", SHA1_backend_name(detected));
+
+    for (sha1_backend b = 0; b < SHA1_BACKEND_COUNT; b++) {
+        if (SHA1_set_backend(b)) {
+            result &= test_sha1_backend(b);
+        }
+    }
+    SHA1_set_backend(detected);
+    result &= test_sha1_many();
+
+    REPORT_RESULT(result);
+    return result;
+}
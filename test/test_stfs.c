@@ -1,6 +1,13 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <common/endian.h>
+#include <common/file.h>
 #include <common/logging.h>
 
 #include <stfs.h>
+#include <vehicle.h>
 
 #include "testing.h"
 
@@ -8,6 +15,187 @@ const char* stfs_path = "../bin/explore_2.bin";
 
 #define TEST_EXIT(file, result) fclose(f); REPORT_RESULT(result); return result
 
+// Block counts from a package's volume descriptor
+static u32 stfs_allocated(const stfs_package* pkg) {
+    return read_be32(&pkg->header->meta.vol_desc.allocated_block_count);
+}
+static u32 stfs_unallocated(const stfs_package* pkg) {
+    return read_be32(&pkg->header->meta.vol_desc.unallocated_block_count);
+}
+
+// Write an edited vehicle that's 1 block larger back into the package, then
+// make sure it reads back correctly and all the hashes up to the header match.
+// Shrinking it back down should free that block again.
+bool test_stfs_write(const stfs_package* pkg, u32 size) {
+    const char* out_path = "stfs_write_test.bin";
+    const char* shrunk_path = "stfs_shrink_test.bin";
+    u8* vehicle = stfs_read_vehicle(pkg, STFS_READ_DEFAULT);
+    u8* edited = calloc(1, size + STFS_BLOCK_SIZE);
+    if (vehicle == NULL || edited == NULL) {
+        free(vehicle);
+        free(edited);
+        return false;
+    }
+    memcpy(edited, vehicle, size);
+    free(vehicle);
+    edited[size - 1] ^= 0xFF;
+    size += STFS_BLOCK_SIZE;
+
+    bool ok = stfs_write_vehicle(pkg, edited, size, out_path);
+    stfs_package out = stfs_open(out_path);
+    if (ok && out.file.data != NULL) {
+        u8* readback = stfs_read_vehicle(&out, STFS_READ_VERIFY);
+        ok = (readback != NULL && memcmp(readback, edited, size) == 0);
+        free(readback);
+
+        const stfs_meta* meta = &out.header->meta;
+        const u32 hashed_start = offsetof(stfs_header, meta.pkg_type);
+        ok &= SHA1_equal(meta->header_sha1, SHA1_buf((u8*)out.file.data + hashed_start, out.first_block_off - hashed_start));
+        const u8* root = stfs_block_ptr(&out, stfs_hash_table_block(&out, 0, out.top_level) + (meta->vol_desc.block_separation & 2 ? 1 : 0));
+        ok &= (root != NULL && SHA1_equal(meta->vol_desc.first_hashtable_hash, SHA1_buf((u8*)root, STFS_BLOCK_SIZE)));
+        ok &= stfs_allocated(&out) == stfs_allocated(pkg) + 1 && stfs_unallocated(&out) == stfs_unallocated(pkg);
+
+        stfs_package shrunk = {0};
+        if (stfs_write_vehicle(&out, edited, size - STFS_BLOCK_SIZE, shrunk_path)) {
+            shrunk = stfs_open(shrunk_path);
+        }
+        ok &= shrunk.file.data != NULL;
+        if (shrunk.file.data != NULL) {
+            ok &= stfs_allocated(&shrunk) == stfs_allocated(&out) && stfs_unallocated(&shrunk) == stfs_unallocated(&out) + 1;
+        }
+        stfs_close(&shrunk);
+        remove(shrunk_path);
+    } else {
+        ok = false;
+    }
+    stfs_close(&out);
+    remove(out_path);
+    free(edited);
+    return ok;
+}
+
+// A clean package should pass every check, and a package with one corrupted
+// data block should report exactly that block.
+bool test_stfs_verify(const char* path) {
+    const char* bad_path = "stfs_verify_test.bin";
+    thread_pool* pool = thread_pool_create(4);
+    stfs_package pkg = stfs_open(path);
+    if (pkg.file.data == NULL) {
+        thread_pool_destroy(pool);
+        return false;
+    }
+    stfs_verify_report report = stfs_verify(&pkg, pool);
+    bool ok = stfs_report_ok(&report) && report.blocks_checked > 0;
+    stfs_report_free(&report);
+
+    // Flip a byte in the first block of the vehicle
+    const stfs_filetable* entry = (const stfs_filetable*)stfs_block_ptr(&pkg, pkg.ftable_block);
+    const u32 bad_block = stfs_file_start_block(entry);
+    const u32 bad_off = stfs_blocknum_to_off(&pkg, stfs_data_block_num(&pkg, bad_block));
+    u8* copy = malloc(pkg.file.size);
+    FILE* out = fopen(bad_path, "wb");
+    if (copy != NULL && out != NULL) {
+        memcpy(copy, pkg.file.data, pkg.file.size);
+        copy[bad_off + 0x10] ^= 0xFF;
+        fwrite(copy, pkg.file.size, 1, out);
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    free(copy);
+    stfs_close(&pkg);
+
+    pkg = stfs_open(bad_path);
+    report = stfs_verify(&pkg, pool);
+    ok &= report.complete && report.header_ok && report.top_hash_ok && list_empty(report.bad_tables);
+    ok &= report.bad_blocks.end_idx == 1 && *(u32*)list_get_element(report.bad_blocks, 0) == bad_block;
+    stfs_report_free(&report);
+    stfs_close(&pkg);
+    remove(bad_path);
+    thread_pool_destroy(pool);
+    return ok;
+}
+
+// Our test package has 1 file in the root directory, which is the vehicle.
+// Extracting everything should give us the same bytes as reading it directly.
+bool test_stfs_files(const stfs_package* pkg, const u8* vehicle) {
+    const char* out_dir = "stfs_extract_test";
+    u32 count = 0;
+    stfs_file_info first = {0};
+    stfs_file_iterator iter = stfs_file_iterator_setup(pkg);
+    while (!iter.done) {
+        const stfs_file_info info = stfs_file_iterator_next(&iter);
+        if (count++ == 0) {
+            first = info;
+        }
+    }
+    if (count != 1 || first.directory || first.parent != -1 || strcmp(first.name, "0000002d") != 0) {
+        LOG_MSG(error, "File table has %d entries, first is \"%s\" (parent %d)\n", count, first.name, first.parent);
+        return false;
+    }
+
+    if (stfs_extract_all(pkg, out_dir, STFS_READ_VERIFY) != 1) {
+        return false;
+    }
+    char path[64] = {0};
+    snprintf(path, sizeof(path), "%s/%s", out_dir, first.name);
+    u8* extracted = file_load(path);
+    const bool ok = extracted != NULL && file_size(path) == first.size && memcmp(extracted, vehicle, first.size) == 0;
+    free(extracted);
+    remove(path);
+    remove(out_dir);
+    return ok;
+}
+
+// Only CON packages are saves, and only ones whose first file starts with
+// VEHICLE_MAGIC hold a vehicle
+static bool test_vehicle_sniff(const u8* data, u64 size) {
+    u8* copy = malloc(size);
+    if (copy == NULL) {
+        return false;
+    }
+    memcpy(copy, data, size);
+    bool ok = vehicle_stfs_has_vehicle(copy, size);
+
+    const u32 live = STFS_LIVE;
+    memcpy(copy, &live, sizeof(live));
+    ok &= (vehicle_get_format(copy, size) == VEHICLE_FORMAT_NONE);
+    memcpy(copy, data, sizeof(live));
+
+    // Break the vehicle's magic, so it looks like some other game's save
+    stfs_package pkg = stfs_open_buffer(copy, size);
+    const stfs_filetable* entry = (const stfs_filetable*)stfs_block_ptr(&pkg, pkg.ftable_block);
+    const u8* first = stfs_block_ptr(&pkg, stfs_data_block_num(&pkg, stfs_file_start_block(entry)));
+    stfs_close(&pkg);
+    if (first == NULL) {
+        free(copy);
+        return false;
+    }
+    copy[first - copy] ^= 0xFF;
+    ok &= (vehicle_get_format(copy, size) == VEHICLE_FORMAT_STFS && !vehicle_stfs_has_vehicle(copy, size));
+    ok &= (vehicle_load_buffer(copy, size) == NULL);
+    free(copy);
+    return ok;
+}
+
+// Loading from memory has to give the same vehicle as loading the file
+bool test_vehicle_load_buffer(const char* path) {
+    u64 size = 0;
+    u8* data = file_load_sized(path, &size);
+    vehicle* from_path = vehicle_load(path);
+    vehicle* from_buf = NULL;
+    if (data != NULL && vehicle_get_format(data, size) == VEHICLE_FORMAT_STFS) {
+        from_buf = vehicle_load_buffer(data, size);
+    }
+    bool ok = from_path != NULL && from_buf != NULL &&
+        memcmp(from_path, from_buf, sizeof(vehicle_header) + from_path->head.part_count * sizeof(part_entry)) == 0;
+    ok &= (data != NULL && test_vehicle_sniff(data, size));
+    free(data);
+    free(from_path);
+    free(from_buf);
+    return ok;
+}
+
 bool test_stfs() {
     bool result = false;
     stfs_header head = {0};
@@ -30,7 +218,89 @@ bool test_stfs() {
         TEST_EXIT(f, result);
     }
 
-    // TODO: Test extracting the file data and make sure endian is flipped correctly for all the right fields.
+    // Extract the vehicle and make sure it starts with the vehicle magic
+    // (stored big-endian, so we compare the raw bytes)
+    const u8 vehicle_magic[] = {0x3F, 0x9A, 0xE1, 0x48, 0x40, 0x54, 0x7A, 0xE1};
+    u8* vehicle = stfs_get_vehicle(stfs_path);
+    if (vehicle == NULL) {
+        LOG_MSG(error, "Failed to extract vehicle from \"%s\"\n", stfs_path);
+        TEST_EXIT(f, result);
+    }
+    if (memcmp(vehicle, vehicle_magic, sizeof(vehicle_magic)) != 0) {
+        LOG_MSG(error, "Extracted file doesn't start with the vehicle magic!\n");
+        free(vehicle);
+        TEST_EXIT(f, result);
+    }
+    free(vehicle);
+    if (!test_vehicle_load_buffer(stfs_path)) {
+        LOG_MSG(error, "Loading \"%s\" from a buffer didn't match loading the file\n", stfs_path);
+        TEST_EXIT(f, result);
+    }
+
+    // The vehicle should pass verification, and its chain should end exactly
+    // after the number of blocks its size needs.
+    stfs_package pkg = stfs_open(stfs_path);
+    if (pkg.file.data == NULL) {
+        LOG_MSG(error, "Failed to open \"%s\"\n", stfs_path);
+        TEST_EXIT(f, result);
+    }
+    const stfs_filetable* entry = (const stfs_filetable*)stfs_block_ptr(&pkg, pkg.ftable_block);
+    u32 chain_len = 0;
+    for (u32 b = stfs_file_start_block(entry); b != STFS_CHAIN_END && chain_len <= pkg.index.count; b = stfs_next_block(&pkg, b)) {
+        chain_len++;
+    }
+    const bool chain_ok = chain_len == (stfs_file_size(entry) + STFS_BLOCK_SIZE - 1) / STFS_BLOCK_SIZE;
+    const bool verified = stfs_verify_file(&pkg, entry);
+    const bool written = test_stfs_write(&pkg, stfs_file_size(entry));
+    u8* vehicle_copy = stfs_read_vehicle(&pkg, STFS_READ_DEFAULT);
+    const bool listed = vehicle_copy != NULL && test_stfs_files(&pkg, vehicle_copy);
+    free(vehicle_copy);
+    stfs_close(&pkg);
+    if (!chain_ok) {
+        LOG_MSG(error, "Vehicle block chain is %d blocks long, doesn't match its size\n", chain_len);
+        TEST_EXIT(f, result);
+    }
+    if (!verified) {
+        LOG_MSG(error, "Vehicle failed SHA1 verification\n");
+        TEST_EXIT(f, result);
+    }
+    if (!listed) {
+        LOG_MSG(error, "File table listing or extraction failed\n");
+        TEST_EXIT(f, result);
+    }
+    if (!written) {
+        LOG_MSG(error, "Vehicle didn't survive being written back to a package\n");
+        TEST_EXIT(f, result);
+    }
+
+    if (!test_stfs_verify(stfs_path)) {
+        LOG_MSG(error, "Package verification didn't find the right problems\n");
+        TEST_EXIT(f, result);
+    }
+
+    // Check the hash table layout math against known block numbers. For a
+    // block shift of 1, each table takes 2 blocks.
+    const stfs_package layout = {.block_shift = 1, .block_step = {0xAC, 0x723A}};
+    const u32 data_blocks[][2] = {
+        {0, 0x2},
+        {0xA9, 0xAB},
+        {0xAA, 0xB0}, // After the level-1 table & second level-0 table
+        {0x153, 0x159},
+        {0x154, 0x15C},
+    };
+    for (u32 i = 0; i < ARRAY_SIZE(data_blocks); i++) {
+        const u32 block = stfs_data_block_num(&layout, data_blocks[i][0]);
+        if (block != data_blocks[i][1]) {
+            LOG_MSG(error, "Data block 0x%X mapped to 0x%X, expected 0x%X\n", data_blocks[i][0], block, data_blocks[i][1]);
+            TEST_EXIT(f, result);
+        }
+    }
+    if (stfs_hash_table_block(&layout, 0xAA, 0) != 0xAE || stfs_hash_table_block(&layout, 0xAA, 1) != 0xAC) {
+        LOG_MSG(error, "Hash table block numbers are wrong!\n");
+        TEST_EXIT(f, result);
+    }
+
+    // TODO: Make sure endian is flipped correctly for all the right fields.
     result = true;
     TEST_EXIT(f, result);
 }
@@ -0,0 +1,583 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/logging.h>
+#include <editor/vehicle_edit.h>
+#include <parts.h>
+
+#include "testing.h"
+
+// Just enough of an editor for the part lists, grids & masks. Nothing here
+// touches the GPU.
+static editor_state* test_editor_create() {
+    editor_state* editor = calloc(1, sizeof(*editor));
+    if (editor == NULL) {
+        LOG_MSG(error, "Failed to allocate editor state\n");
+        return NULL;
+    }
+    editor->selected_parts = list_create(sizeof(part_entry) * 64, sizeof(part_entry));
+    editor->unselected_parts = list_create(sizeof(part_entry) * 64, sizeof(part_entry));
+    editor->selected_mask = vehiclemask_create();
+    editor->vacancy_mask = vehiclemask_create();
+    editor->selected_grid = part_grid_create();
+    editor->vacancy_grid = part_grid_create();
+    editor->parts_generation = 1;
+    return editor;
+}
+
+static void test_editor_destroy(editor_state* editor) {
+    free((void*)editor->selected_parts.data);
+    free((void*)editor->unselected_parts.data);
+    vehiclemask_destroy(&editor->selected_mask);
+    vehiclemask_destroy(&editor->vacancy_mask);
+    part_grid_destroy(&editor->selected_grid);
+    part_grid_destroy(&editor->vacancy_grid);
+    free(editor);
+}
+
+// First part with exactly [count] cells, or more than 1 cell if [count] is 0
+static part_id test_part_with_cells(u32 count) {
+    for (u32 i = 0; i < NUM_PARTS; i++) {
+        const part_cells cells = part_get_cells(partdata[i].id, 0);
+        if ((count == 0) ? (cells.count > 1) : (cells.count == count)) {
+            return partdata[i].id;
+        }
+    }
+    return 0;
+}
+
+static part_entry test_part(part_id id, s8 x, s8 y, s8 z) {
+    return (part_entry){.id = id, .pos = {x, y, z}};
+}
+
+static bool test_part_covers(const part_entry* p, vec3s8 cell) {
+    part_cell_iterator iter = part_cell_iterator_setup(*p);
+    while (!iter.done) {
+        if (vec3s8_eq(part_cell_iterator_next(&iter), cell)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Every cell of every part in one list has to lead to a part covering it, and
+// nothing else can be in the grid or mask. Where parts overlap, only one of
+// them is found, so each cell is counted once.
+static bool layer_consistent(editor_state* editor, bool selected) {
+    const list parts = selected ? editor->selected_parts : editor->unselected_parts;
+    const vehicle_bitmask* mask = selected ? &editor->selected_mask : &editor->vacancy_mask;
+    const partsearch_type search = selected ? SEARCH_SELECTED : SEARCH_UNSELECTED;
+
+    u32 cell_count = 0;
+    for (u32 i = 0; i < parts.end_idx; i++) {
+        const part_entry* p = list_get_element(parts, i);
+        part_cell_iterator iter = part_cell_iterator_setup(*p);
+        while (!iter.done) {
+            const vec3s8 cell = part_cell_iterator_next(&iter);
+            const part_entry* found = part_by_pos(editor, cell, search);
+            if (found->id == 0 || !test_part_covers(found, cell) || !vehiclemask_get_3d(mask, cell)) {
+                LOG_MSG(error, "Cell (%d, %d, %d) of part %d doesn't lead to a part there\n", cell.x, cell.y, cell.z, i);
+                return false;
+            }
+            cell_count += (found == p);
+        }
+    }
+
+    vehiclemask_iterator iter = vehiclemask_iterator_setup(mask);
+    u32 mask_count = 0;
+    while (!iter.done) {
+        const vec3s8 cell = vehiclemask_iterator_next(&iter);
+        mask_count++;
+        if (part_by_pos(editor, cell, search)->id == 0) {
+            LOG_MSG(error, "Cell (%d, %d, %d) is in the mask, but has no part\n", cell.x, cell.y, cell.z);
+            return false;
+        }
+    }
+    if (mask_count != cell_count) {
+        LOG_MSG(error, "Mask has %d cells, parts have %d\n", mask_count, cell_count);
+        return false;
+    }
+    return true;
+}
+
+static bool editor_consistent(editor_state* editor) {
+    return layer_consistent(editor, true) && layer_consistent(editor, false);
+}
+
+// Removing a part from the middle of a list moves the last part into its
+// handle, and the next part added takes the handle the last part left behind.
+static bool test_part_handle_reuse() {
+    editor_state* editor = test_editor_create();
+    const part_id id = test_part_with_cells(0);
+    if (editor == NULL || id == 0) {
+        return false;
+    }
+
+    const part_entry a = test_part(id, 10, 10, 10);
+    const part_entry b = test_part(id, 30, 10, 10);
+    const part_entry c = test_part(id, 50, 10, 10);
+    vehicle_add_part(editor, a);
+    vehicle_add_part(editor, b);
+    vehicle_add_part(editor, c);
+    bool result = editor_consistent(editor) && editor->v.part_count == 3;
+
+    vehicle_delete_part(editor, part_by_pos(editor, b.pos, SEARCH_ALL));
+    result &= editor_consistent(editor) && editor->v.part_count == 2;
+    // C took over B's spot in the list, B's cells are empty
+    result &= (memcmp(list_get_element(editor->selected_parts, 1), &c, sizeof(c)) == 0);
+    result &= (part_by_pos(editor, b.pos, SEARCH_ALL)->id == 0);
+    result &= !vehiclemask_get_3d(&editor->selected_mask, b.pos);
+
+    const part_entry d = test_part(id, 70, 10, 10);
+    vehicle_add_part(editor, d);
+    result &= editor_consistent(editor);
+    result &= (part_by_pos(editor, d.pos, SEARCH_SELECTED) == list_get_element(editor->selected_parts, 2));
+    result &= (part_by_pos(editor, c.pos, SEARCH_SELECTED) == list_get_element(editor->selected_parts, 1));
+
+    vehicle_place_selection(editor);
+    result &= editor_consistent(editor);
+    result &= (editor->selected_grid.count == 0 && editor->unselected_parts.end_idx == 3);
+
+    // Emptying the grid should free every brick
+    while (!list_empty(editor->unselected_parts)) {
+        vehicle_delete_part(editor, list_get_element(editor->unselected_parts, 0));
+    }
+    result &= editor_consistent(editor);
+    result &= (editor->vacancy_grid.count == 0 && editor->v.part_count == 0);
+
+    test_editor_destroy(editor);
+    return result;
+}
+
+// Enough parts that handles don't fit in a byte, removed in a scattered order
+static bool test_part_handle_many() {
+    enum { SIDE = 20 };
+    editor_state* editor = test_editor_create();
+    const part_id id = test_part_with_cells(1);
+    if (editor == NULL || id == 0) {
+        return false;
+    }
+
+    for (s8 x = 0; x < SIDE; x++) {
+        for (s8 y = 0; y < SIDE; y++) {
+            for (s8 z = 0; z < SIDE; z++) {
+                vehicle_add_part(editor, test_part(id, x * 3, y * 3, z * 3));
+            }
+        }
+    }
+    vehicle_place_selection(editor);
+    bool result = editor_consistent(editor) && editor->v.part_count == SIDE * SIDE * SIDE;
+
+    // Delete every cell where the coordinates add up to an odd number
+    for (s8 x = 0; x < SIDE; x++) {
+        for (s8 y = 0; y < SIDE; y++) {
+            for (s8 z = 0; z < SIDE; z++) {
+                if ((x + y + z) % 2 == 1) {
+                    vehicle_delete_part(editor, part_by_pos(editor, (vec3s8){x * 3, y * 3, z * 3}, SEARCH_ALL));
+                }
+            }
+        }
+    }
+    result &= editor_consistent(editor) && editor->v.part_count == (SIDE * SIDE * SIDE) / 2;
+    for (s8 x = 0; x < SIDE; x++) {
+        for (s8 y = 0; y < SIDE; y++) {
+            for (s8 z = 0; z < SIDE; z++) {
+                const bool kept = (x + y + z) % 2 == 0;
+                result &= ((part_by_pos(editor, (vec3s8){x * 3, y * 3, z * 3}, SEARCH_ALL)->id != 0) == kept);
+            }
+        }
+    }
+
+    test_editor_destroy(editor);
+    return result;
+}
+
+// Whether a part would fit at [pos] inside the vehicle's bounds. Landing on
+// other parts is fine.
+static bool test_part_fits(part_entry p, vec3s16 pos) {
+    const part_cells cells = part_get_cells(p.id, part_orientation_from_euler(p.rot));
+    for (u32 i = 0; i < cells.count; i++) {
+        for (u8 axis = 0; axis < 3; axis++) {
+            const s16 raw = pos.raw[axis] + cells.cells[i].raw[axis];
+            if (raw < 0 || raw >= VEH_MAX_DIM / 2) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    vec3s8 cell;
+    part_handle handle;
+}test_grid_cell;
+
+// Every cell in one layer's mask, with the list index + 1 of the part there
+static list test_grid_snapshot(editor_state* editor, bool selected) {
+    const list parts = selected ? editor->selected_parts : editor->unselected_parts;
+    list out = list_create(sizeof(test_grid_cell) * 64, sizeof(test_grid_cell));
+    vehiclemask_iterator iter = vehiclemask_iterator_setup(selected ? &editor->selected_mask : &editor->vacancy_mask);
+    while (!iter.done) {
+        const vec3s8 cell = vehiclemask_iterator_next(&iter);
+        const part_entry* p = part_by_pos(editor, cell, selected ? SEARCH_SELECTED : SEARCH_UNSELECTED);
+        const part_handle handle = (p->id == 0) ? 0 : ((uintptr_t)p - parts.data) / parts.element_size + 1;
+        list_add(&out, &(test_grid_cell){cell, handle});
+    }
+    return out;
+}
+
+// Rebuild both grids from scratch and check nothing changed
+static bool test_grids_match_rebuild(editor_state* editor) {
+    list before[2] = {test_grid_snapshot(editor, true), test_grid_snapshot(editor, false)};
+    update_part_grids(editor);
+
+    bool result = true;
+    for (u8 i = 0; i < 2 && result; i++) {
+        list after = test_grid_snapshot(editor, i == 0);
+        result &= (after.end_idx == before[i].end_idx);
+        for (u32 j = 0; j < before[i].end_idx && result; j++) {
+            const test_grid_cell* c = list_get_element(before[i], j);
+            const part_entry* p = part_by_pos(editor, c->cell, (i == 0) ? SEARCH_SELECTED : SEARCH_UNSELECTED);
+            const list parts = (i == 0) ? editor->selected_parts : editor->unselected_parts;
+            if (c->handle == 0 || p != list_get_element(parts, c->handle - 1)) {
+                LOG_MSG(error, "Cell (%d, %d, %d) changed after a rebuild\n", c->cell.x, c->cell.y, c->cell.z);
+                result = false;
+            }
+        }
+        free((void*)after.data);
+        free((void*)before[i].data);
+    }
+    return result;
+}
+
+// Two parts stacked in the same list (like a loaded vehicle can have). Taking
+// either one away has to leave the other one's cells alone.
+static bool test_part_overlap() {
+    editor_state* editor = test_editor_create();
+    const part_id id = test_part_with_cells(0);
+    if (editor == NULL || id == 0) {
+        return false;
+    }
+
+    // Different modifiers, so they can be told apart when searched by value
+    const part_entry a = test_part(id, 10, 10, 10);
+    part_entry b = a;
+    b.modifier = 1;
+    vehicle_add_part(editor, a);
+    vehicle_add_part(editor, b);
+    vehicle_place_selection(editor);
+    bool result = editor_consistent(editor);
+    // The last one added is on top
+    result &= (part_by_pos(editor, a.pos, SEARCH_UNSELECTED) == list_get_element(editor->unselected_parts, 1));
+
+    // Move the top one away, then delete it
+    part_entry* top = list_get_element(editor->unselected_parts, 1);
+    vehicle_move_part(editor, *top, (vec3s16){20, 0, 0}, NULL);
+    result &= editor_consistent(editor);
+    result &= (part_by_pos(editor, a.pos, SEARCH_UNSELECTED) == list_get_element(editor->unselected_parts, 0));
+    vehicle_delete_part(editor, list_get_element(editor->unselected_parts, 1));
+    result &= editor_consistent(editor) && vehiclemask_get_3d(&editor->vacancy_mask, a.pos);
+
+    // A new part can't go on top of the one that's left
+    vehicle_add_part(editor, a);
+    result &= vehicle_selection_overlap(editor);
+
+    // Stack a third one, then delete the bottom one. The top one takes its
+    // handle, which puts it under the middle one.
+    vehicle_place_selection(editor);
+    part_entry c = a;
+    c.modifier = 2;
+    vehicle_add_part(editor, c);
+    vehicle_place_selection(editor);
+    vehicle_delete_part(editor, list_get_element(editor->unselected_parts, 0));
+    result &= editor_consistent(editor);
+    result &= (part_by_pos(editor, a.pos, SEARCH_UNSELECTED) == list_get_element(editor->unselected_parts, 1));
+    result &= test_grids_match_rebuild(editor);
+
+    test_editor_destroy(editor);
+    return result;
+}
+
+// Random part from a random list, or NULL if that list is empty
+static part_entry* test_random_part(editor_state* editor, u32 rand, bool* selected) {
+    *selected = rand & 1;
+    const list parts = *selected ? editor->selected_parts : editor->unselected_parts;
+    if (list_empty(parts)) {
+        return NULL;
+    }
+    return list_get_element(parts, (rand >> 1) % parts.end_idx);
+}
+
+// Random edits, made through the incremental grid updates, have to leave the
+// grids the same as rebuilding them from the part lists. Parts are added,
+// moved & placed on top of each other freely, like in a loaded vehicle with
+// overlapping parts.
+static bool test_part_grid_random_edits(u32 seed) {
+    const float QUARTER_TURN = 1.57079632679f;
+    editor_state* editor = test_editor_create();
+    if (editor == NULL) {
+        return false;
+    }
+
+    bool result = true;
+    u32 state = seed;
+    for (u32 i = 0; i < 4000 && result; i++) {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        const u32 rand = state >> 4;
+        const vec3s16 diff = {(s16)(rand % 5) - 2, (s16)((rand >> 3) % 5) - 2, (s16)((rand >> 6) % 5) - 2};
+
+        bool selected = false;
+        part_entry* p = test_random_part(editor, rand >> 9, &selected);
+        switch (state % 8) {
+            case 0:
+            case 1: {
+                const u32 idx = (rand >> 9) % NUM_PARTS;
+                const part_entry add = {
+                    .id = partdata[idx].id,
+                    .pos = {(rand >> 16) % 48, (rand >> 22) % 48, (state >> 1) % 48},
+                    .rot = {(rand % 4) * QUARTER_TURN, ((rand >> 2) % 4) * QUARTER_TURN, ((rand >> 4) % 4) * QUARTER_TURN},
+                };
+                const vec3s16 pos = {add.pos.x, add.pos.y, add.pos.z};
+                if (test_part_fits(add, pos)) {
+                    vehicle_add_part(editor, add);
+                }
+                break;
+            }
+            case 2:
+                if (p != NULL) {
+                    vehicle_delete_part(editor, p);
+                }
+                break;
+            case 3:
+                if (p != NULL) {
+                    selected ? vehicle_unselect_part(editor, p) : vehicle_select_part(editor, p);
+                }
+                break;
+            case 4:
+                vehicle_place_selection(editor);
+                break;
+            case 5: {
+                // Only moves that keep the whole selection in bounds
+                bool fits = true;
+                for (u32 j = 0; j < editor->selected_parts.end_idx && fits; j++) {
+                    const part_entry* s = list_get_element(editor->selected_parts, j);
+                    const vec3s16 pos = {s->pos.x + diff.x, s->pos.y + diff.y, s->pos.z + diff.z};
+                    const part_cells cells = part_get_cells(s->id, part_orientation_from_euler(s->rot));
+                    for (u32 c = 0; c < cells.count; c++) {
+                        for (u8 axis = 0; axis < 3; axis++) {
+                            const s16 raw = pos.raw[axis] + cells.cells[c].raw[axis];
+                            fits &= (raw >= 0 && raw < VEH_MAX_DIM / 2);
+                        }
+                    }
+                }
+                if (fits) {
+                    vehicle_move_selection(editor, diff, NULL);
+                }
+                break;
+            }
+            case 6:
+                if (p != NULL) {
+                    const vec3s16 pos = {p->pos.x + diff.x, p->pos.y + diff.y, p->pos.z + diff.z};
+                    if (test_part_fits(*p, pos)) {
+                        vehicle_move_part(editor, *p, diff, NULL);
+                    }
+                }
+                break;
+            case 7: {
+                // Push a lone selected part past 0, which moves the rest of
+                // the vehicle instead. It lands with its origin on 0, so its
+                // cells can't reach below the origin.
+                if (editor->selected_parts.end_idx != 1 || editor->vacancy_mask.max.x >= VEH_MAX_DIM / 2) {
+                    break;
+                }
+                part_entry* s = list_get_element(editor->selected_parts, 0);
+                const part_cells cells = part_get_cells(s->id, part_orientation_from_euler(s->rot));
+                bool fits = true;
+                for (u32 c = 0; c < cells.count; c++) {
+                    fits &= (cells.cells[c].x >= 0);
+                }
+                if (fits) {
+                    vehicle_move_selection(editor, (vec3s16){-s->pos.x - 1, 0, 0}, NULL);
+                }
+                break;
+            }
+        }
+
+        if (i % 16 == 15) {
+            result &= editor_consistent(editor);
+            result &= test_grids_match_rebuild(editor);
+        }
+    }
+    result &= editor->v.part_count == editor->selected_parts.end_idx + editor->unselected_parts.end_idx;
+
+    test_editor_destroy(editor);
+    return result;
+}
+
+enum {
+    // Wireframe test masks stay inside this corner of the vehicle
+    WIRE_TEST_DIM = 48,
+};
+
+static bool test_mask_get(const vehicle_bitmask* mask, s16 x, s16 y, s16 z) {
+    if (x < 0 || y < 0 || z < 0 || x >= WIRE_TEST_DIM || y >= WIRE_TEST_DIM || z >= WIRE_TEST_DIM) {
+        return false;
+    }
+    return vehiclemask_get_3d(mask, (vec3s8){x, y, z});
+}
+
+// The wireframe's rectangles have to cover every outside face of every cell
+// exactly once, and nothing else. Each face is marked by the cell it belongs
+// to, the axis it faces along and which way.
+static bool test_wireframe_matches_voxels(const vehicle_bitmask* mask) {
+    static u8 faces[2][3][WIRE_TEST_DIM][WIRE_TEST_DIM][WIRE_TEST_DIM];
+    memset(faces, 0x00, sizeof(faces));
+
+    list vertices = list_create(sizeof(vec3s) * 64, sizeof(vec3s));
+    vehiclemask_build_wireframe(mask, &vertices);
+    bool result = (vertices.end_idx % 8 == 0);
+
+    // Every rectangle is 4 lines, corner 0 to 1, 1 to 2, 2 to 3, 3 to 0.
+    // Corners 0 & 2 (vertices 0 & 4) are opposite each other.
+    for (u32 i = 0; i + 8 <= vertices.end_idx && result; i += 8) {
+        const vec3s* rect = list_get_element(vertices, i);
+        for (u8 line = 0; line < 4; line++) {
+            result &= (memcmp(&rect[line * 2 + 1], &rect[((line + 1) % 4) * 2], sizeof(vec3s)) == 0);
+        }
+
+        // The only coordinate that isn't a whole number is the one pushed
+        // off the face
+        s8 axis = -1;
+        for (u8 j = 0; j < 3; j++) {
+            if (rect[0].raw[j] != roundf(rect[0].raw[j])) {
+                result &= (axis == -1);
+                axis = j;
+            }
+        }
+        if (axis == -1 || !result) {
+            LOG_MSG(error, "Wireframe rectangle %d isn't on a face\n", i / 8);
+            result = false;
+            break;
+        }
+        const u8 u = (axis + 1) % 3;
+        const u8 v = (axis + 2) % 3;
+        const s16 plane = roundf(rect[0].raw[axis]);
+        const u8 dir = rect[0].raw[axis] > plane;
+        // Faces pointing up are on the far corner of their cell
+        const s16 owner = plane - dir;
+        s16 cell[3] = {0};
+        cell[axis] = owner;
+        for (cell[u] = rect[0].raw[u]; cell[u] < rect[4].raw[u] && result; cell[u]++) {
+            for (cell[v] = rect[0].raw[v]; cell[v] < rect[4].raw[v] && result; cell[v]++) {
+                if (cell[0] < 0 || cell[1] < 0 || cell[2] < 0 ||
+                    cell[0] >= WIRE_TEST_DIM || cell[1] >= WIRE_TEST_DIM || cell[2] >= WIRE_TEST_DIM) {
+                    LOG_MSG(error, "Wireframe rectangle %d is out of bounds\n", i / 8);
+                    result = false;
+                    break;
+                }
+                faces[dir][axis][cell[0]][cell[1]][cell[2]]++;
+            }
+        }
+    }
+    free((void*)vertices.data);
+
+    // Check against every face of every cell, one at a time
+    for (s16 x = 0; x < WIRE_TEST_DIM && result; x++) {
+        for (s16 y = 0; y < WIRE_TEST_DIM && result; y++) {
+            for (s16 z = 0; z < WIRE_TEST_DIM && result; z++) {
+                const bool set = test_mask_get(mask, x, y, z);
+                for (u8 axis = 0; axis < 3; axis++) {
+                    for (u8 dir = 0; dir < 2; dir++) {
+                        s16 neighbor[3] = {x, y, z};
+                        neighbor[axis] += dir ? 1 : -1;
+                        const bool exposed = set && !test_mask_get(mask, neighbor[0], neighbor[1], neighbor[2]);
+                        if (faces[dir][axis][x][y][z] != exposed) {
+                            LOG_MSG(error, "Face %d/%d of cell (%d, %d, %d) is covered %d times\n", axis, dir, x, y, z, faces[dir][axis][x][y][z]);
+                            result = false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// Count the rectangles in a mask's wireframe
+static u32 test_wireframe_rects(const vehicle_bitmask* mask) {
+    list vertices = list_create(sizeof(vec3s) * 64, sizeof(vec3s));
+    vehiclemask_build_wireframe(mask, &vertices);
+    const u32 count = vertices.end_idx / 8;
+    free((void*)vertices.data);
+    return count;
+}
+
+static void test_mask_fill(vehicle_bitmask* mask, vec3s8 lo, vec3s8 hi, u8 val) {
+    for (s8 x = lo.x; x <= hi.x; x++) {
+        for (s8 y = lo.y; y <= hi.y; y++) {
+            for (s8 z = lo.z; z <= hi.z; z++) {
+                vehiclemask_set_3d(mask, (vec3s8){x, y, z}, val);
+            }
+        }
+    }
+}
+
+static bool test_wireframe() {
+    vehicle_bitmask mask = vehiclemask_create();
+
+    // Nothing in, nothing out
+    bool result = test_wireframe_matches_voxels(&mask) && test_wireframe_rects(&mask) == 0;
+
+    // One cell in the corner, with no padding in the vehicle below it
+    vehiclemask_set_3d(&mask, (vec3s8){0, 0, 0}, true);
+    result &= test_wireframe_matches_voxels(&mask) && test_wireframe_rects(&mask) == 6;
+    vehiclemask_clear(&mask);
+
+    // One full brick is a cube, so every side merges into one rectangle
+    test_mask_fill(&mask, (vec3s8){8, 8, 8}, (vec3s8){15, 15, 15}, true);
+    result &= test_wireframe_matches_voxels(&mask) && test_wireframe_rects(&mask) == 6;
+
+    // A hollow box has faces pointing into the hole too
+    test_mask_fill(&mask, (vec3s8){10, 10, 10}, (vec3s8){13, 13, 13}, false);
+    result &= test_wireframe_matches_voxels(&mask) && test_wireframe_rects(&mask) == 12;
+    vehiclemask_clear(&mask);
+
+    // Staircase across several bricks, plus a cell that only touches it on
+    // an edge
+    for (s8 i = 0; i < 6; i++) {
+        test_mask_fill(&mask, (vec3s8){3 + i * 3, 5, 6}, (vec3s8){6 + i * 3, 9 + i, 17}, true);
+    }
+    vehiclemask_set_3d(&mask, (vec3s8){25, 15, 18}, true);
+    result &= test_wireframe_matches_voxels(&mask);
+    vehiclemask_clear(&mask);
+
+    // Scattered cells, so barely anything can merge
+    u32 state = 0xBADF00D;
+    for (u32 i = 0; i < 3000; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        vehiclemask_set_3d(&mask, (vec3s8){state % 20, (state >> 8) % 20, (state >> 16) % 20}, true);
+    }
+    result &= test_wireframe_matches_voxels(&mask);
+
+    vehiclemask_destroy(&mask);
+    return result;
+}
+
+bool test_vehicle_edit() {
+    bool result = true;
+    result &= test_part_handle_reuse();
+    result &= test_part_handle_many();
+    result &= test_part_overlap();
+    result &= test_part_grid_random_edits(0x1234567);
+    result &= test_part_grid_random_edits(0xC0FFEE);
+    result &= test_wireframe();
+
+    REPORT_RESULT(result);
+    return result;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/int.h>
+#include <common/file.h>
+#include <common/logging.h>
+#include <common/model.h>
+#include <common/path.h>
+
+// Build tool that converts OBJ part models to the binary mesh format (see
+// mesh_load()). Each "name.obj" is written to "[output dir]/name.mesh".
+
+static bool bake_mesh(const char* obj_path, const char* out_dir) {
+    u8* txt = file_load(obj_path);
+    if (txt == NULL) {
+        return false;
+    }
+    const model m = obj_load(txt);
+    free(txt);
+    if (m.vertices == NULL || m.indices == NULL) {
+        LOG_MSG(error, "Failed to parse \"%s\"\n", obj_path);
+        return false;
+    }
+
+    u64 size = 0;
+    u8* mesh = mesh_save(m, &size);
+    free((void*)m.vertices);
+    free((void*)m.indices);
+    if (mesh == NULL) {
+        return false;
+    }
+
+    // Swap the extension, "name.obj" -> "name.mesh"
+    char name[256] = {0};
+    if (path_has_slashes(obj_path)) {
+        path_get_filename(obj_path, name);
+    }
+    else {
+        strncpy(name, obj_path, sizeof(name) - 1);
+    }
+    char* ext = strrchr(name, '.');
+    if (ext != NULL) {
+        *ext = 0x00;
+    }
+    char out_path[1024] = {0};
+    snprintf(out_path, sizeof(out_path), "%s/%s.mesh", out_dir, name);
+
+    FILE* out = fopen(out_path, "wb");
+    if (out == NULL) {
+        LOG_MSG(error, "Failed to open \"%s\" for writing\n", out_path);
+        free(mesh);
+        return false;
+    }
+    const bool result = fwrite(mesh, size, 1, out) == 1;
+    fclose(out);
+    free(mesh);
+    if (!result) {
+        LOG_MSG(error, "Failed to write 0x%X bytes to \"%s\"\n", (u32)size, out_path);
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Usage: %s [output dir] [OBJ files...]\n", argv[0]);
+        return 1;
+    }
+    if (!dir_create(argv[1])) {
+        LOG_MSG(error, "Failed to create \"%s\"\n", argv[1]);
+        return 1;
+    }
+
+    u32 fail_count = 0;
+    for (s32 i = 2; i < argc; i++) {
+        fail_count += !bake_mesh(argv[i], argv[1]);
+    }
+    return fail_count != 0;
+}